@@ -39,8 +39,11 @@
 
 #include <cstdint>
 #include <ctime>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -262,7 +265,7 @@
 /** @brief Not used */
 #define UPNP_E_FILE_WRITE_ERROR        -209
 
-/** @brief Not used */
+/** @brief An asynchronous operation was cancelled, see @ref UpnpCancelAction */
 #define UPNP_E_CANCELED            -210
 
 /** @brief Not used */
@@ -441,6 +444,25 @@ typedef enum {
     /** Reject Web requests with a host name (non-numeric) value in the HOST header, 
      * instead of redirecting them. */
     UPNP_FLAG_REJECT_HOSTNAMES = 0x8,
+    /** Pass the action arguments to the device callback as views into the request body, in
+     * Upnp_Action_Request::argviews, instead of copies in args and xmlAction. See
+     * @ref UpnpGetActionXML */
+    UPNP_FLAG_ACTION_ARG_VIEWS = 0x10,
+    /** Check the UTF-8 encoding of action responses before parsing them, and fix it if needed,
+     * instead of doing this only after the parse failed. This avoids parsing twice the large
+     * responses of servers which send bad UTF-8. */
+    UPNP_FLAG_CHECK_RESPONSE_UTF8 = 0x20,
+    /** Parse the SOAP action requests while their body arrives, instead of accumulating it and
+     * parsing it when complete. The body is not kept in memory. The streaming parse is only
+     * done when the library is built with expat (USE_EXPAT) and this flag is set, and not with
+     * UPNP_FLAG_ACTION_ARG_VIEWS. In all other cases the body is accumulated, up to the
+     * UpnpSetMaxContentLength() limit, and parsed when complete. */
+    UPNP_FLAG_STREAM_ACTION_REQUESTS = 0x40,
+    /** Send the event notifications from a single thread multiplexing all the transfers, instead
+     * of using a send thread pool worker for each NOTIFY until it is answered or times out. This
+     * prevents unresponsive control points from holding up the pool. The events for a
+     * subscription are still sent in order, one at a time. */
+    UPNP_FLAG_ASYNC_EVENTS = 0x80,
 } Upnp_InitFlag;
 
 /** Values for the @ref UpnpInitWithOptions vararg options list. For all the current integer values,
@@ -458,8 +480,84 @@ typedef enum {
     UPNP_OPTION_NEXTBOOTID,
     /** @brief SEARCHPORT value to be sent in SSDP messages, int arg follows. Currently ignored */
     UPNP_OPTION_SEARCHPORT,
+    /** @brief Thread counts for one of the SDK thread pools. Three int args follow: the
+     * @ref Upnp_ThreadPoolId pool identifier, the minimum and the maximum threads count. */
+    UPNP_OPTION_THREADPOOL_SIZE,
+    /** @brief Job queue sizing for one of the SDK thread pools. Three int args follow: the
+     * @ref Upnp_ThreadPoolId pool identifier, the maximum number of queued jobs, and the number
+     * of queued jobs per thread above which a new thread is started. */
+    UPNP_OPTION_THREADPOOL_JOBS,
+    /** @brief Latency-driven autoscaling for one of the SDK thread pools. Three int args follow:
+     * the @ref Upnp_ThreadPoolId pool identifier, the target 95th percentile of the job queue
+     * wait time in microseconds, and the evaluation interval in milliseconds. The pool size
+     * stays within the limits set by @ref UPNP_OPTION_THREADPOOL_SIZE. */
+    UPNP_OPTION_THREADPOOL_AUTOSCALE,
+    /** @brief CPU affinity for the threads of one of the SDK pools, or one of the persistent
+     * threads. Two args follow: an int @ref Upnp_ThreadPoolId identifier, and a const char*
+     * CPU list, in the usual "0-3,8,10-11" format. Only supported on Linux. */
+    UPNP_OPTION_THREADPOOL_CPUS,
+    /** @brief Scheduling class for the threads of one of the SDK pools, or one of the persistent
+     * threads. Three int args follow: the @ref Upnp_ThreadPoolId identifier, the scheduling
+     * policy (e.g. SCHED_FIFO), and the static priority. Not supported on Windows. */
+    UPNP_OPTION_THREADPOOL_SCHED,
 } Upnp_InitOption;
 
+/** Identifiers for the library thread pools, used with @ref UPNP_OPTION_THREADPOOL_SIZE,
+ * @ref UPNP_OPTION_THREADPOOL_JOBS and @ref UpnpSetThreadPoolSize */
+typedef enum {
+    /** @brief Outgoing traffic: GENA notifications, SSDP replies, timer jobs. Also runs the
+     * timer thread, which permanently uses one thread. */
+    UPNP_THREADPOOL_SEND = 0,
+    /** @brief Incoming traffic: SSDP packets processing. */
+    UPNP_THREADPOOL_RECV,
+    /** @brief Mini server: runs the SSDP listener, which permanently uses one thread. */
+    UPNP_THREADPOOL_MINISERVER,
+    /** @brief Application callbacks: client-side discovery (search results, advertisements,
+     * search timeouts) and subscription auto-renewal failures. These run separately from the
+     * internal protocol jobs, so that a slow callback does not delay the library traffic. */
+    UPNP_THREADPOOL_CALLBACK,
+    /** @brief Not a pool: the miniserver SSDP listener thread. Only for
+     * @ref UPNP_OPTION_THREADPOOL_CPUS and @ref UPNP_OPTION_THREADPOOL_SCHED */
+    UPNP_THREAD_MINISERVER_LISTENER,
+    /** @brief Not a pool: the timer thread. Only for @ref UPNP_OPTION_THREADPOOL_CPUS and
+     * @ref UPNP_OPTION_THREADPOOL_SCHED */
+    UPNP_THREAD_TIMER,
+} Upnp_ThreadPoolId;
+
+/** Producer for a streamed action result value, see @ref UpnpStreamedArg. Each call sets
+ * \b piece to the next part of the raw (not XML-escaped) value, and returns false when there
+ * is no more data. The piece must stay valid until the next call. */
+typedef std::function<bool (std::string_view& piece)> UpnpValueGenerator;
+
+/** A result argument which is escaped and sent to the network progressively, without
+ * building the whole response in memory. See @ref Upnp_Action_Request::resstream. */
+struct UpnpStreamedArg {
+    /** @brief The argument name. */
+    std::string name;
+    /** @brief The value producer. It is called from the HTTP server thread, after the action
+     * callback has returned, so it must own or share the data it uses. */
+    UpnpValueGenerator value;
+};
+
+/** Make a generator returning a view on data kept alive by \b owner. */
+inline UpnpValueGenerator UpnpStreamView(std::string_view view, std::shared_ptr<const void> owner)
+{
+    return [view, owner = std::move(owner), done = false](std::string_view& piece) mutable {
+        if (done)
+            return false;
+        piece = view;
+        done = true;
+        return true;
+    };
+}
+
+/** Make a generator returning a value it takes ownership of. */
+inline UpnpValueGenerator UpnpStreamValue(std::string value)
+{
+    auto data = std::make_shared<const std::string>(std::move(value));
+    return UpnpStreamView(*data, data);
+}
+
 /** Used in the device callback API as parameter for
  * @ref UPNP_CONTROL_ACTION_REQUEST. This holds the action type and data
  * sent by the Control Point and, after processing, the data returned
@@ -483,7 +581,8 @@ struct Upnp_Action_Request {
     /** @brief [input] The service ID. */
     char ServiceID[NAME_SIZE];
 
-    /** @brief [input] The action arguments */
+    /** @brief [input] The action arguments. Not set if the library was initialized with
+        UPNP_FLAG_ACTION_ARG_VIEWS. */
     std::vector<std::pair<std::string, std::string> > args;
 
     /** @brief [output] The action results. */
@@ -497,7 +596,8 @@ struct Upnp_Action_Request {
 
     /** @brief [input] The XML request document in case the callback has something
         else to get from there. This is always set in addition to the
-        args vector */
+        args vector, except with UPNP_FLAG_ACTION_ARG_VIEWS, in which case
+        @ref UpnpGetActionXML can produce it. */
     std::string xmlAction;
 
     /** @brief [output] Alternative data return: return an XML document instead of
@@ -505,6 +605,21 @@ struct Upnp_Action_Request {
         return, it is used instead of resdata. This is to ease the
         transition from the ixml-based interface */
     std::string xmlResponse;
+
+    /** @brief [output] Alternative data return for big results (e.g. Browse
+        DIDL-Lite data): if this is not empty on callback return and
+        xmlResponse is empty, it is used instead of resdata, and the response
+        is sent with chunked encoding while the values are produced. All
+        the arguments must be in this vector, in order. */
+    std::vector<UpnpStreamedArg> resstream;
+
+    /** @brief [input] The action arguments, only set if the library was
+        initialized with UPNP_FLAG_ACTION_ARG_VIEWS. The views point into the
+        request data and are valid until the callback returns. For a deferred
+        action, @ref UpnpDeferAction copies the data and updates the views,
+        which then stay valid until @ref UpnpCompleteAction is called: views
+        taken from the vector before the UpnpDeferAction call must not be kept. */
+    std::vector<std::pair<std::string_view, std::string_view> > argviews;
 };
 
 /* compat code for libupnp-1.8 */
@@ -917,6 +1032,125 @@ EXPORT_SPEC int UpnpInitWithOptions(
  */
 EXPORT_SPEC int UpnpFinish(void);
 
+/**
+ * @brief Change the sizing of one of the library thread pools.
+ *
+ * This can be called before or after initialization. The values are memorized and used for
+ * starting the pool, and they also survive an UpnpFinish()/UpnpInit2() cycle. If the pool is
+ * running, its attributes are changed immediately: new threads are started if needed to
+ * satisfy minThreads, and extra threads exit when they become idle if maxThreads is reduced.
+ *
+ * For all parameters, a value <= 0 leaves the current setting unchanged.
+ *
+ * @param pool the @ref Upnp_ThreadPoolId pool identifier.
+ * @param minThreads the number of threads always kept running.
+ * @param maxThreads the maximum number of threads.
+ * @param maxJobsTotal the maximum number of jobs waiting in the queues. Jobs submitted beyond
+ *    this are discarded.
+ * @param jobsPerThread a new thread is started when the ratio of queued jobs to threads reaches
+ *    this value.
+ * @return
+ *    \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *    \li \c UPNP_E_INVALID_PARAM: bad pool identifier or minThreads greater than maxThreads.
+ *    \li \c UPNP_E_INTERNAL_ERROR: the running pool could not be updated.
+ */
+EXPORT_SPEC int UpnpSetThreadPoolSize(
+    int pool, int minThreads, int maxThreads, int maxJobsTotal, int jobsPerThread);
+
+/** Job queue statistics for one of the library thread pools */
+struct UpnpThreadPoolQueueStats {
+    /** Jobs currently waiting in the queues. */
+    int queuedJobs;
+    /** Highest number of waiting jobs seen since the pool was started. */
+    int maxQueuedJobs;
+    /** Jobs discarded because the queues were full (see @ref UpnpSetThreadPoolSize). */
+    int droppedJobs;
+    /** Threads currently running jobs, not counting the permanent ones. */
+    int busyThreads;
+    /** Total threads. */
+    int totalThreads;
+};
+
+/**
+ * @brief Return the queue statistics for one of the library thread pools.
+ *
+ * @param pool the @ref Upnp_ThreadPoolId pool identifier.
+ * @param[out] stats the statistics.
+ * @return
+ *    \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *    \li \c UPNP_E_INVALID_PARAM: bad pool identifier or null stats pointer.
+ *    \li \c UPNP_E_FINISH: the library is not initialized.
+ */
+EXPORT_SPEC int UpnpGetThreadPoolQueueStats(int pool, struct UpnpThreadPoolQueueStats *stats);
+
+/** Job tracing event types, see @ref UpnpSetJobTraceCallback */
+typedef enum {
+    /** A job was added to a pool queue. */
+    UPNP_JOBTRACE_ENQUEUE,
+    /** A job is starting. */
+    UPNP_JOBTRACE_START,
+    /** A job is done. */
+    UPNP_JOBTRACE_END,
+} Upnp_JobTraceType;
+
+/** Job tracing event */
+struct UpnpJobTraceEvent {
+    Upnp_JobTraceType type;
+    /** The @ref Upnp_ThreadPoolId of the pool. */
+    int pool;
+    /** Job type: name of the internal class implementing the job, or "persistent". */
+    const char *jobType;
+    /** Job identifier, unique inside a pool. */
+    int jobId;
+    /** Job priority, from 0 (low) to 2 (high). */
+    int priority;
+    /** Event time in microseconds, from a monotonic clock with an unspecified origin. */
+    int64_t timeUs;
+    /** Time spent waiting in the queue in microseconds (START and END events). */
+    int64_t waitUs;
+    /** Job execution time in microseconds (END events). */
+    int64_t runUs;
+    /** Identifier for the thread which generated the event. */
+    uint64_t threadId;
+};
+
+/** Job tracing callback. The event structure is only valid during the call. */
+typedef void (*Upnp_JobTraceCallback)(const struct UpnpJobTraceEvent *event, void *cookie);
+
+/**
+ * @brief Set a function to be called when jobs are queued, started and finished by the library
+ * thread pools, for analyzing where the library threads spend their time.
+ *
+ * The callback is called from the library threads and should be quick. Pass a null callback to
+ * stop tracing. This can be called before or after initialization.
+ *
+ * @return \c UPNP_E_SUCCESS.
+ */
+EXPORT_SPEC int UpnpSetJobTraceCallback(Upnp_JobTraceCallback callback, void *cookie);
+
+/**
+ * @brief Start writing a job trace in Chrome trace-event JSON format, which can be loaded in
+ * chrome://tracing or https://ui.perfetto.dev. Each executed job is shown as a slice named
+ * after its type, on a track for the thread which ran it. The file is complete after
+ * @ref UpnpStopJobTraceFile is called.
+ *
+ * @param path the output file path. It is truncated if it exists.
+ * @return
+ *    \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *    \li \c UPNP_E_INVALID_PARAM: null path or a trace is already active.
+ *    \li \c UPNP_E_FILE_NOT_FOUND: the file could not be created.
+ */
+EXPORT_SPEC int UpnpStartJobTraceFile(const char *path);
+
+/**
+ * @brief Stop writing the job trace and close the file.
+ *
+ * @return
+ *    \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *    \li \c UPNP_E_INVALID_PARAM: no trace was active.
+ */
+EXPORT_SPEC int UpnpStopJobTraceFile(void);
+
 /**
  * @brief Returns the internal server IPv4 UPnP listening port.
  *
@@ -999,8 +1233,15 @@ EXPORT_SPEC const char *UpnpGetServerUlaGuaIp6Address(void);
  *
  * If set to 0 then checking will be disabled.
  *
- * The default maximum content-length is \c DEFAULT_SOAP_CONTENT_LENGTH 
- * = 16K bytes.
+ * The device side checks the Content-Length of the SOAP requests before
+ * reading their body, and answers with a 413 (Request Entity Too Large) HTTP
+ * error if it exceeds the limit. A body without a Content-Length (chunked) is
+ * counted as it arrives: the data beyond the limit is dropped and the 413 is
+ * sent after the body has been received.
+ *
+ * The default maximum content-length is \c DEFAULT_SOAP_CONTENT_LENGTH
+ * = 1 MB. The limit was not enforced by previous versions, which documented a
+ * 16000 bytes default.
  *  
  * @return \c UPNP_E_SUCCESS.
  */
@@ -1009,6 +1250,49 @@ EXPORT_SPEC int UpnpSetMaxContentLength(
      * in bytes. */
     size_t contentLength);
 
+/**
+ * @brief Enables or disables the compression of HTTP response bodies.
+ *
+ * When enabled, SOAP action responses and the description documents served by
+ * the internal web server are compressed with gzip or deflate if the request
+ * Accept-Encoding header allows it. Bodies smaller than \b minSize bytes are
+ * always sent as is. Compressed description documents are cached. Streamed
+ * action responses are compressed on the fly, whatever their size.
+ *
+ * Compression is disabled by default.
+ *
+ * @return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_NOT_FOUND: The library was built without zlib, and
+ *         \b enable was set.
+ */
+EXPORT_SPEC int UpnpSetResponseCompression(
+    /** [in] Non-zero to enable compression. */
+    int enable,
+    /** [in] Minimum body size for compression, in bytes. */
+    size_t minSize);
+
+/**
+ * @brief Sets the parameters of the control point connection cache.
+ *
+ * After a SOAP action, the HTTP connection to the device is kept open for
+ * some time, so that the next actions sent to the same host can reuse it.
+ * By default, up to 4 idle connections are kept per host, for 30 seconds.
+ * This applies to @ref UpnpSendAction. The connections used by
+ * @ref UpnpSendActionAsync and @ref UpnpSendActionBatch are managed by libcurl
+ * in the thread which sends them, and are not shared with UpnpSendAction.
+ *
+ * @return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_PARAM: \b idleTimeout is not positive.
+ */
+EXPORT_SPEC int UpnpSetActionConnectionCache(
+    /** [in] Maximum number of idle connections kept for a host. 0 disables
+     * the cache, and closes the currently idle connections. */
+    int maxIdlePerHost,
+    /** [in] Time in seconds after which an idle connection is closed. */
+    int idleTimeout);
+
 /** @} Initialization, common to client and device interfaces. */
 
 /** \name Initialization and termination, device interface.
@@ -1458,8 +1742,86 @@ EXPORT_SPEC int UpnpSendAdvertisementLowPower(
  *                            C O N T R O L                                   *
  *                                                                            *
  ******************************************************************************/
-/** \name Client interface: Control 
- * @{ 
+/** \name Device interface: Control
+ * @{
+ */
+
+/** Opaque handle for an action request which will be answered later, see
+ * @ref UpnpDeferAction */
+typedef struct UpnpDeferredAction_s *UpnpDeferredAction;
+
+/**
+ * @brief Defer the response to an action request.
+ *
+ * This must be called from the @ref UPNP_CONTROL_ACTION_REQUEST callback,
+ * with the request structure it received. The callback then returns
+ * immediately (its return value is ignored), and the application calls
+ * @ref UpnpCompleteAction from any thread, once the results are known. The
+ * HTTP connection is suspended in the meantime and does not hold one of the
+ * HTTP server threads, while a synchronous callback holds up the other
+ * connections of its thread until it returns. With libmicrohttpd versions
+ * older than 0.9.53, each connection has its own thread, which waits for the
+ * deferred response. The request structure is
+ * only valid during the callback, so the application must copy what it
+ * needs from it. The argviews vector can be copied after this call, see
+ * Upnp_Action_Request::argviews.
+ *
+ * @return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_PARAM: Not called from an action request
+ *             callback for this request, or the request was already deferred.
+ */
+EXPORT_SPEC int UpnpDeferAction(
+    /** [in] The request structure received by the callback. */
+    struct Upnp_Action_Request *request,
+    /** [out] Handle to be passed to @ref UpnpCompleteAction. */
+    UpnpDeferredAction *handle);
+
+/**
+ * @brief Send the response for an action deferred by @ref UpnpDeferAction.
+ *
+ * The handle is released by this call, which must be made exactly once for
+ * each deferred action, even if the response can't be sent any more.
+ *
+ * @return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The response was queued.
+ *     \li \c UPNP_E_INVALID_PARAM: Null handle or result. With a null
+ *             result, the action fails with an error response.
+ *     \li \c UPNP_E_SOCKET_ERROR: The connection was closed in the meantime,
+ *             for example by @ref UpnpFinish. The handle is still released.
+ */
+EXPORT_SPEC int UpnpCompleteAction(
+    /** [in] The handle set by @ref UpnpDeferAction. */
+    UpnpDeferredAction handle,
+    /** [in] What the callback would have returned: UPNP_E_SUCCESS or an error. */
+    int status,
+    /** [in] The results. Only the ErrCode, ErrStr, resdata, xmlResponse and
+     * resstream fields are used, with the same meaning as for a synchronous
+     * response. */
+    const struct Upnp_Action_Request *result);
+
+/**
+ * @brief Compute the value of Upnp_Action_Request::xmlAction, when it was not set because the
+ * library was initialized with UPNP_FLAG_ACTION_ARG_VIEWS.
+ *
+ * This must be called from the @ref UPNP_CONTROL_ACTION_REQUEST callback, with the request
+ * structure it received.
+ *
+ * @return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_PARAM: Not called from an action request
+ *             callback for this request.
+ */
+EXPORT_SPEC int UpnpGetActionXML(
+    /** [in] The request structure received by the callback. */
+    const struct Upnp_Action_Request *request,
+    /** [out] The XML sub-document for the action element. */
+    std::string& xml);
+
+/** @} Device interface: Control */
+
+/** \name Client interface: Control
+ * @{
  */
 
 /**
@@ -1505,6 +1867,112 @@ EXPORT_SPEC int UpnpSendAction(
     int* errcodep,
     std::string& errdesc);
 
+/** @brief Result of an action sent with @ref UpnpSendActionAsync. */
+struct UpnpActionResult {
+    /** @brief Same as the @ref UpnpSendAction return value, or \c UPNP_E_TIMEDOUT if the
+     * timeout expired, or \c UPNP_E_CANCELED if the action was cancelled or the library was
+     * shut down before it completed. */
+    int status{UPNP_E_SUCCESS};
+    /** @brief The UPnP error code if we got an error response, else 0. */
+    int errorCode{0};
+    /** @brief The error description if we got an error response. */
+    std::string errorDescription;
+    /** @brief The return values. */
+    std::vector<std::pair<std::string, std::string>> responseData;
+};
+
+/** Completion callback for @ref UpnpSendActionAsync. */
+typedef std::function<void (UpnpActionResult result)> UpnpActionCallback;
+
+/** Identifies an action sent with @ref UpnpSendActionAsync, for @ref UpnpCancelAction. */
+typedef uint64_t UpnpActionId;
+
+/**
+ * @brief Sends an action without waiting for the response.
+ *
+ * The request is sent by a single library thread which multiplexes all the
+ * asynchronous actions in progress, so that many concurrent actions do not
+ * need as many application threads. The callback is called exactly once,
+ * from the callback thread pool (@ref UPNP_THREADPOOL_CALLBACK), unless the
+ * function returns an error. A std::promise can be fulfilled from the
+ * callback if a future is more convenient.
+ *
+ * @return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The action was sent. The callback will be called.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid client handle.
+ *     \li \c UPNP_E_INVALID_PARAM: An empty URL, service type or action name,
+ *             or no callback.
+ *     \li \c UPNP_E_INVALID_URL: The action URL could not be parsed.
+ *     \li \c UPNP_E_INIT_FAILED: The sending thread could not be started.
+ *  @param Hnd client handle
+ *  @param headerString SOAP header, as for @ref UpnpSendAction.
+ *  @param actionURL the service action url from the device description document.
+ *  @param serviceType the service type from the device description document
+ *  @param actionName the action to perform (from the service description)
+ *  @param actionParams the action name/value argument pairs, in order.
+ *  @param timeoutMs the time allowed for the whole exchange, in milliseconds.
+ *     0 or a negative value for the default (30 seconds).
+ *  @param callback called with the result.
+ *  @param[out] id if not null, set to a value for @ref UpnpCancelAction.
+ */
+EXPORT_SPEC int UpnpSendActionAsync(
+    UpnpClient_Handle Hnd,
+    const std::string& headerString,
+    const std::string& actionURL,
+    const std::string& serviceType,
+    const std::string& actionName,
+    const std::vector<std::pair<std::string, std::string>>& actionParams,
+    int timeoutMs,
+    UpnpActionCallback callback,
+    UpnpActionId *id);
+
+/**
+ * @brief Cancels an action sent with @ref UpnpSendActionAsync.
+ *
+ * The callback is then called with a \c UPNP_E_CANCELED status, unless the
+ * action completed meanwhile. The device may have executed the action anyway.
+ *
+ * @return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The action will be cancelled.
+ *     \li \c UPNP_E_NOT_FOUND: The action is already complete.
+ */
+EXPORT_SPEC int UpnpCancelAction(UpnpActionId id);
+
+/** @brief One of the actions sent by @ref UpnpSendActionBatch. The fields have the same
+ * meaning as the @ref UpnpSendAction parameters. */
+struct UpnpBatchAction {
+    std::string headerString;
+    std::string actionURL;
+    std::string serviceType;
+    std::string actionName;
+    std::vector<std::pair<std::string, std::string>> actionParams;
+};
+
+/**
+ * @brief Sends a set of actions concurrently, possibly to different devices, and waits for
+ * all the results.
+ *
+ * The actions are sent together by the thread used for @ref UpnpSendActionAsync, so that a
+ * polling cycle costs one round trip time instead of one per action. This thread keeps its
+ * connections open, so the next batches and asynchronous actions to the same devices reuse
+ * them. The responses are then parsed by the calling thread.
+ *
+ * @return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: All the actions were processed. See the individual results.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid client handle.
+ *     \li \c UPNP_E_INVALID_PARAM: An action has an empty URL, service type or action name.
+ *  @param Hnd client handle
+ *  @param actions the actions to send.
+ *  @param timeoutMs the time allowed for each action, in milliseconds. 0 or a negative value
+ *     for the default (30 seconds).
+ *  @param[out] results the results, in the same order as the actions.
+ */
+EXPORT_SPEC int UpnpSendActionBatch(
+    UpnpClient_Handle Hnd,
+    const std::vector<UpnpBatchAction>& actions,
+    int timeoutMs,
+    std::vector<UpnpActionResult>& results);
+
 /** @} Control */
 
 /******************************************************************************
@@ -1778,6 +2246,34 @@ EXPORT_SPEC int UpnpSetMaxSubscriptionTimeOut(
     /** The maximum subscription time-out to be accepted. */
     int MaxSubscriptionTimeOut);
 
+/** Event delivery statistics, see @ref UpnpGetEventDeliveryStats */
+struct UpnpEventDeliveryStats {
+    /** NOTIFY requests sent, including the failed ones. */
+    unsigned long long notifications;
+    /** NOTIFY requests which failed at the network level (unreachable or unresponsive
+     * subscriber). */
+    unsigned long long failures;
+    /** Successful NOTIFY requests which needed a new connection. */
+    unsigned long long newConnections;
+    /** Successful NOTIFY requests which reused the connection kept open after the previous
+     * event for the same subscription. */
+    unsigned long long reusedConnections;
+};
+
+/**
+ * @brief Return the event delivery statistics for the device side.
+ *
+ * The connection to a subscribed control point is kept open between events, and closed when
+ * the subscription is cancelled or expires. The reuse ratio is
+ * reusedConnections / (newConnections + reusedConnections).
+ *
+ * @param[out] stats the statistics, accumulated since the library was loaded.
+ * @return
+ *    \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *    \li \c UPNP_E_INVALID_PARAM: null stats pointer.
+ */
+EXPORT_SPEC int UpnpGetEventDeliveryStats(struct UpnpEventDeliveryStats *stats);
+
 /**
  * @brief Sets the HTTP timeout for subscription operations. 
  *
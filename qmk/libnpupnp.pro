@@ -22,10 +22,13 @@ SOURCES += \
 ../src/gena/service_table.cpp \
 ../src/soap/soap_ctrlpt.cpp \
 ../src/soap/soap_device.cpp \
+../src/soap/soap_message.cpp \
 ../src/ssdp/ssdp_ctrlpt.cpp \
 ../src/ssdp/ssdp_device.cpp \
 ../src/ssdp/ssdp_server.cpp \
 ../src/ssdp/ssdpparser.cpp \
+../src/threadutil/CurlMultiLoop.cpp \
+../src/threadutil/SocketWatcher.cpp \
 ../src/threadutil/ThreadPool.cpp \
 ../src/threadutil/TimerThread.cpp \
 ../src/utils/description.cpp \
@@ -34,10 +34,13 @@
 
 #include <algorithm>
 #include <array>
+#include <cctype>
+#include <cstdio>
 #include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -96,11 +99,14 @@ TimerThread *gTimerThread;
 ThreadPool gRecvThreadPool;
 /*! Mini server thread pool. */
 ThreadPool gMiniServerThreadPool;
+/*! Application callbacks thread pool. */
+ThreadPool gCallbackThreadPool;
 using tpooldesc = std::pair<ThreadPool*, const char*>;
-static const std::array<std::pair<ThreadPool*, const char*>, 3> o_threadpools{
+static const std::array<std::pair<ThreadPool*, const char*>, 4> o_threadpools{
     tpooldesc{&gSendThreadPool, "Send thread pool"},
     tpooldesc{&gRecvThreadPool, "Receive thread pool"},
     tpooldesc{&gMiniServerThreadPool, "Mini server thread pool"},
+    tpooldesc{&gCallbackThreadPool, "Callback thread pool"},
 };
 
 /*! Flag to indicate the state of web server */
@@ -124,6 +130,83 @@ int g_configidUpnpOrg{1};
 /* Local global options, usually set from the options list of initWithOptions */
 static int o_networkWaitSeconds = 60;
 
+/* Thread pool attributes, indexed by Upnp_ThreadPoolId (same order as o_threadpools). Set from
+   the config.h defaults and modified by the init options or UpnpSetThreadPoolSize() */
+static ThreadPoolAttr defaultThreadPoolAttr()
+{
+    ThreadPoolAttr attr;
+    attr.maxThreads = MAX_THREADS;
+    attr.minThreads =  MIN_THREADS;
+    attr.stackSize = THREAD_STACK_SIZE;
+    attr.jobsPerThread = JOBS_PER_THREAD;
+    attr.maxIdleTime = THREAD_IDLE_TIME;
+    attr.maxJobsTotal = MAX_JOBS_TOTAL;
+    return attr;
+}
+static std::array<ThreadPoolAttr, 4> o_threadpoolattrs{
+    defaultThreadPoolAttr(), defaultThreadPoolAttr(), defaultThreadPoolAttr(),
+    defaultThreadPoolAttr()};
+/* Set while the pools are running (between initThreadPools() and UpnpFinish()) */
+static bool o_threadpoolsstarted;
+ThreadSchedAttr g_miniServerThreadSched;
+ThreadSchedAttr g_timerThreadSched;
+
+/* Return the scheduling attributes for a pool or persistent thread identifier */
+static ThreadSchedAttr *threadSchedForId(int id)
+{
+    if (id >= 0 && id < static_cast<int>(o_threadpoolattrs.size()))
+        return &o_threadpoolattrs[id].workerSched;
+    if (id == UPNP_THREAD_MINISERVER_LISTENER)
+        return &g_miniServerThreadSched;
+    if (id == UPNP_THREAD_TIMER)
+        return &g_timerThreadSched;
+    return nullptr;
+}
+
+/* Parse a CPU number at the start of s. Returns the position after it, or nullptr if there is
+ * no number there (we don't accept signs or spaces). */
+static const char *parseCpuNumber(const char *s, int *cpu)
+{
+    if (!isdigit(static_cast<unsigned char>(*s)))
+        return nullptr;
+    char *endp;
+    long l = strtol(s, &endp, 10);
+    if (l > 65535)
+        return nullptr;
+    *cpu = static_cast<int>(l);
+    return endp;
+}
+
+/* Parse a CPU list like "0-3,8,10-11" */
+static bool parseCpuList(const char *spec, std::vector<int>& cpus)
+{
+    cpus.clear();
+    if (nullptr == spec)
+        return false;
+    std::vector<std::string> items;
+    stringToTokens(spec, items, ",");
+    for (const auto& item : items) {
+        int first, last;
+        const char *cp = parseCpuNumber(item.c_str(), &first);
+        if (nullptr == cp)
+            return false;
+        last = first;
+        if (*cp == '-') {
+            // Both bounds are needed: "0-" or "-3" are errors
+            cp = parseCpuNumber(cp + 1, &last);
+            if (nullptr == cp)
+                return false;
+        }
+        if (*cp || last < first) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return !cpus.empty();
+}
+
 /* Marker to be replaced by an appropriate address in LOCATION URLs */
 const std::string g_HostForTemplate{"@HOST_ADDR_FOR@"};
 
@@ -407,33 +490,240 @@ static int WinsockInit(void)
 }
 #endif /* _WIN32 */
 
+/* Job tracing sink writing a Chrome trace-event file (JSON array format, which can be loaded in
+   chrome://tracing or Perfetto). Each executed job becomes a complete event on the track of its
+   thread, and the threads are named after their pool. */
+class JobTraceFile {
+public:
+    explicit JobTraceFile(FILE *fp)
+        : m_fp(fp) {
+        fputs("[\n", m_fp);
+    }
+    ~JobTraceFile() {
+        close();
+    }
+    JobTraceFile(const JobTraceFile&) = delete;
+    JobTraceFile& operator=(const JobTraceFile&) = delete;
+    void close() {
+        std::scoped_lock lck(m_mutex);
+        if (m_fp) {
+            fputs("\n]\n", m_fp);
+            fclose(m_fp);
+            m_fp = nullptr;
+        }
+    }
+    void write(int pool, const ThreadPoolTraceEvent& ev, uint64_t threadId) {
+        if (ev.type != ThreadPoolTraceEvent::END)
+            return;
+        auto end = std::chrono::duration_cast<std::chrono::microseconds>(
+            ev.time.time_since_epoch()).count();
+        std::scoped_lock lck(m_mutex);
+        if (nullptr == m_fp)
+            return;
+        auto it = m_tids.find(threadId);
+        if (it == m_tids.end()) {
+            it = m_tids.emplace(threadId, static_cast<int>(m_tids.size()) + 1).first;
+            fprintf(m_fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}", m_first ? "" : ",\n", it->second,
+                    o_threadpools[pool].second);
+            m_first = false;
+        }
+        fprintf(m_fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%lld,\"dur\":%llu,\"args\":{\"job\":%d,\"priority\":%d,\"wait_us\":%llu}}",
+                jsonEscape(*ev.jobType).c_str(), o_threadpools[pool].second, it->second,
+                static_cast<long long>(end - static_cast<long long>(ev.runUs)),
+                static_cast<unsigned long long>(ev.runUs), ev.jobId, ev.priority,
+                static_cast<unsigned long long>(ev.waitUs));
+    }
+private:
+    static std::string jsonEscape(const std::string& in) {
+        std::string out;
+        for (auto c : in) {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out;
+    }
+    std::mutex m_mutex;
+    FILE *m_fp;
+    bool m_first{true};
+    std::unordered_map<uint64_t, int> m_tids;
+};
+
+/* Job tracing state, protected by gSDKInitMutex */
+static Upnp_JobTraceCallback o_jobTraceCallback;
+static void *o_jobTraceCookie;
+static std::shared_ptr<JobTraceFile> o_jobTraceFile;
+
+/* Set or reset the trace hooks of the running pools according to the current tracing state */
+static void installJobTraceHooks()
+{
+    if (!o_threadpoolsstarted)
+        return;
+    for (size_t i = 0; i < o_threadpools.size(); i++) {
+        if (nullptr == o_jobTraceCallback && !o_jobTraceFile) {
+            o_threadpools[i].first->setTraceHook(ThreadPoolTraceHook());
+            continue;
+        }
+        auto pool = static_cast<int>(i);
+        auto callback = o_jobTraceCallback;
+        auto cookie = o_jobTraceCookie;
+        auto file = o_jobTraceFile;
+        o_threadpools[i].first->setTraceHook(
+            [pool, callback, cookie, file](const ThreadPoolTraceEvent& ev) {
+                uint64_t threadId = std::hash<std::thread::id>()(std::this_thread::get_id());
+                if (callback) {
+                    UpnpJobTraceEvent uev;
+                    uev.type = ev.type == ThreadPoolTraceEvent::ENQUEUE ? UPNP_JOBTRACE_ENQUEUE :
+                        ev.type == ThreadPoolTraceEvent::START ? UPNP_JOBTRACE_START :
+                        UPNP_JOBTRACE_END;
+                    uev.pool = pool;
+                    uev.jobType = ev.jobType->c_str();
+                    uev.jobId = ev.jobId;
+                    uev.priority = ev.priority;
+                    uev.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                        ev.time.time_since_epoch()).count();
+                    uev.waitUs = static_cast<int64_t>(ev.waitUs);
+                    uev.runUs = static_cast<int64_t>(ev.runUs);
+                    uev.threadId = threadId;
+                    callback(&uev, cookie);
+                }
+                if (file) {
+                    file->write(pool, ev, threadId);
+                }
+            });
+    }
+}
+
 /* Initializes the global thread pools used by the UPnP SDK. */
 static int initThreadPools()
 {
-    // We are actually unable to delete the pools. So init once and never delete. We'd need to first
-    // wait for all temp tasks to exit, then have a way to tell the permanent ones to exit too
-    // (esp. timer thread). See comments in ThreadPool.cpp ~ThreadPool().
-    static int init{0};
-    if (init)
-        return UPNP_E_SUCCESS;
-    
-    ThreadPoolAttr attr;
-
-    attr.maxThreads = MAX_THREADS;
-    attr.minThreads =  MIN_THREADS;
-    attr.stackSize = THREAD_STACK_SIZE;
-    attr.jobsPerThread = JOBS_PER_THREAD;
-    attr.maxIdleTime = THREAD_IDLE_TIME;
-    attr.maxJobsTotal = MAX_JOBS_TOTAL;
-
-    for (const auto& [tp, _] : o_threadpools) {
-        if (tp->start(&attr) != UPNP_E_SUCCESS) {
+    // The pools are shut down by UpnpFinish(), so they are normally stopped here, and restarted
+    // with the possibly changed sizing. If they are still running, just apply the new sizing.
+    for (size_t i = 0; i < o_threadpools.size(); i++) {
+        ThreadPool *tp = o_threadpools[i].first;
+        int ret = o_threadpoolsstarted ?
+            tp->setAttr(&o_threadpoolattrs[i]) : tp->start(&o_threadpoolattrs[i]);
+        if (ret != UPNP_E_SUCCESS) {
             UpnpSdkInit = 0;
             UpnpFinish();
             return UPNP_E_INIT_FAILED;
         }
     }
-    init = 1;
+    o_threadpoolsstarted = true;
+    installJobTraceHooks();
+    return UPNP_E_SUCCESS;
+}
+
+/* Update the sizing values of a thread pool attributes structure. Values <= 0 are ignored */
+static bool setPoolSizes(ThreadPoolAttr& attr, int minThreads, int maxThreads,
+                         int maxJobsTotal, int jobsPerThread)
+{
+    ThreadPoolAttr nattr{attr};
+    if (minThreads > 0)
+        nattr.minThreads = minThreads;
+    if (maxThreads > 0)
+        nattr.maxThreads = maxThreads;
+    if (maxJobsTotal > 0)
+        nattr.maxJobsTotal = maxJobsTotal;
+    if (jobsPerThread > 0)
+        nattr.jobsPerThread = jobsPerThread;
+    if (nattr.minThreads > nattr.maxThreads) {
+        return false;
+    }
+    attr = nattr;
+    return true;
+}
+
+EXPORT_SPEC int UpnpSetThreadPoolSize(
+    int pool, int minThreads, int maxThreads, int maxJobsTotal, int jobsPerThread)
+{
+    if (pool < 0 || pool >= static_cast<int>(o_threadpools.size())) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    std::scoped_lock lck(gSDKInitMutex);
+    ThreadPoolAttr& attr = o_threadpoolattrs[pool];
+    if (!setPoolSizes(attr, minThreads, maxThreads, maxJobsTotal, jobsPerThread)) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    if (o_threadpoolsstarted) {
+        ThreadPool *tp = o_threadpools[pool].first;
+        ThreadPoolAttr current;
+        tp->getAttr(&current);
+        current.minThreads = attr.minThreads;
+        current.maxThreads = attr.maxThreads;
+        current.maxJobsTotal = attr.maxJobsTotal;
+        current.jobsPerThread = attr.jobsPerThread;
+        if (tp->setAttr(&current) != 0) {
+            UpnpPrintf(UPNP_ERROR, API, __FILE__, __LINE__,
+                       "UpnpSetThreadPoolSize: setAttr failed for %s\n", o_threadpools[pool].second);
+            return UPNP_E_INTERNAL_ERROR;
+        }
+    }
+    return UPNP_E_SUCCESS;
+}
+
+EXPORT_SPEC int UpnpGetThreadPoolQueueStats(int pool, struct UpnpThreadPoolQueueStats *out)
+{
+    if (pool < 0 || pool >= static_cast<int>(o_threadpools.size()) || nullptr == out) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    std::scoped_lock lck(gSDKInitMutex);
+    if (!o_threadpoolsstarted) {
+        return UPNP_E_FINISH;
+    }
+    ThreadPoolCounters stats;
+    o_threadpools[pool].first->getCounters(&stats);
+    out->queuedJobs = stats.currentJobsHQ + stats.currentJobsMQ + stats.currentJobsLQ +
+        stats.currentJobsDeadline;
+    out->maxQueuedJobs = stats.maxQueuedJobs;
+    out->droppedJobs = stats.droppedJobs;
+    out->busyThreads = stats.workerThreads;
+    out->totalThreads = stats.totalThreads;
+    return UPNP_E_SUCCESS;
+}
+
+EXPORT_SPEC int UpnpSetJobTraceCallback(Upnp_JobTraceCallback callback, void *cookie)
+{
+    std::scoped_lock lck(gSDKInitMutex);
+    o_jobTraceCallback = callback;
+    o_jobTraceCookie = cookie;
+    installJobTraceHooks();
+    return UPNP_E_SUCCESS;
+}
+
+EXPORT_SPEC int UpnpStartJobTraceFile(const char *path)
+{
+    if (nullptr == path || *path == 0) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    std::scoped_lock lck(gSDKInitMutex);
+    if (o_jobTraceFile) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    FILE *fp = fopen(path, "w");
+    if (nullptr == fp) {
+        UpnpPrintf(UPNP_ERROR, API, __FILE__, __LINE__,
+                   "UpnpStartJobTraceFile: can't open [%s]\n", path);
+        return UPNP_E_FILE_NOT_FOUND;
+    }
+    o_jobTraceFile = std::make_shared<JobTraceFile>(fp);
+    installJobTraceHooks();
+    return UPNP_E_SUCCESS;
+}
+
+EXPORT_SPEC int UpnpStopJobTraceFile()
+{
+    std::scoped_lock lck(gSDKInitMutex);
+    if (!o_jobTraceFile) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    auto file = std::move(o_jobTraceFile);
+    o_jobTraceFile.reset();
+    installJobTraceHooks();
+    // Jobs in progress may still hold a reference: close now, they will write nothing.
+    file->close();
     return UPNP_E_SUCCESS;
 }
 
@@ -494,6 +784,7 @@ static int UpnpInitPreamble()
 #ifdef INCLUDE_DEVICE_APIS
 #if EXCLUDE_SOAP == 0
     SetSoapCallback(soap_device_callback);
+    SetSoapBodyCallback(soap_device_body_start);
 #endif
 #endif /* INCLUDE_DEVICE_APIS */
 
@@ -504,7 +795,7 @@ static int UpnpInitPreamble()
 #endif /* INTERNAL_WEB_SERVER */
 
     /* Initialize the SDK timer thread. */
-    gTimerThread = new TimerThread(&gSendThreadPool);
+    gTimerThread = new TimerThread(&gSendThreadPool, &g_timerThreadSched);
     if (nullptr == gTimerThread) {
         std::cerr << "Timer Thread init failed\n";
         UpnpFinish();
@@ -685,6 +976,79 @@ EXPORT_SPEC int UpnpInitWithOptions(
             if (g_configidUpnpOrg <= 0)
                 g_configidUpnpOrg = 1;
             break;
+        case UPNP_OPTION_THREADPOOL_SIZE:
+        case UPNP_OPTION_THREADPOOL_JOBS:
+        {
+            int pool = va_arg(ap, int);
+            int v1 = va_arg(ap, int);
+            int v2 = va_arg(ap, int);
+            bool ok = pool >= 0 && pool < static_cast<int>(o_threadpoolattrs.size());
+            if (ok) {
+                std::scoped_lock lck(gSDKInitMutex);
+                ok = option == UPNP_OPTION_THREADPOOL_SIZE ?
+                    setPoolSizes(o_threadpoolattrs[pool], v1, v2, 0, 0) :
+                    setPoolSizes(o_threadpoolattrs[pool], 0, 0, v1, v2);
+            }
+            if (!ok) {
+                UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
+                           "UpnPInitWithOptions: bad thread pool option values\n");
+                ret = UPNP_E_INVALID_PARAM;
+                goto breakloop;
+            }
+        }
+        break;
+        case UPNP_OPTION_THREADPOOL_CPUS:
+        {
+            int id = va_arg(ap, int);
+            const char *spec = va_arg(ap, const char *);
+            std::scoped_lock lck(gSDKInitMutex);
+            ThreadSchedAttr *sched = threadSchedForId(id);
+            std::vector<int> cpus;
+            if (nullptr == sched || !parseCpuList(spec, cpus)) {
+                UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
+                           "UpnPInitWithOptions: bad thread id %d or CPU list [%s]\n", id,
+                           spec ? spec : "(null)");
+                ret = UPNP_E_INVALID_PARAM;
+                goto breakloop;
+            }
+            sched->cpus = cpus;
+        }
+        break;
+        case UPNP_OPTION_THREADPOOL_SCHED:
+        {
+            int id = va_arg(ap, int);
+            int policy = va_arg(ap, int);
+            int priority = va_arg(ap, int);
+            std::scoped_lock lck(gSDKInitMutex);
+            ThreadSchedAttr *sched = threadSchedForId(id);
+            if (nullptr == sched || policy < 0) {
+                UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
+                           "UpnPInitWithOptions: bad thread id %d or policy %d\n", id, policy);
+                ret = UPNP_E_INVALID_PARAM;
+                goto breakloop;
+            }
+            sched->policy = policy;
+            sched->priority = priority;
+        }
+        break;
+        case UPNP_OPTION_THREADPOOL_AUTOSCALE:
+        {
+            int pool = va_arg(ap, int);
+            int targetus = va_arg(ap, int);
+            int intervalms = va_arg(ap, int);
+            if (pool < 0 || pool >= static_cast<int>(o_threadpoolattrs.size())) {
+                UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
+                           "UpnPInitWithOptions: bad thread pool id %d\n", pool);
+                ret = UPNP_E_INVALID_PARAM;
+                goto breakloop;
+            }
+            std::scoped_lock lck(gSDKInitMutex);
+            if (targetus > 0)
+                o_threadpoolattrs[pool].autoscaleTargetP95Us = targetus;
+            if (intervalms > 0)
+                o_threadpoolattrs[pool].autoscaleIntervalMs = intervalms;
+        }
+        break;
         default:
             UpnpPrintf(UPNP_CRITICAL, API, __FILE__, __LINE__,
                        "UpnPInitWithOptions: bad option %d in list\n", option);
@@ -702,7 +1066,19 @@ breakloop:
 }
 
 
-#if 0
+/* Format the main percentiles of a latency histogram, in milliseconds */
+static std::string histSummary(const LatencyHistogram& h)
+{
+    char buf[200];
+    snprintf(buf, sizeof(buf), "n %llu avg %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f",
+             static_cast<unsigned long long>(h.total), h.meanUs() / 1000.0,
+             static_cast<double>(h.percentile(50)) / 1000.0,
+             static_cast<double>(h.percentile(90)) / 1000.0,
+             static_cast<double>(h.percentile(99)) / 1000.0,
+             static_cast<double>(h.maxUs) / 1000.0);
+    return buf;
+}
+
 /*!
  * \brief Prints thread pool statistics.
  */
@@ -749,8 +1125,33 @@ void PrintThreadPoolStats(
                stats.totalThreads,
                stats.totalWorkTime,
                stats.totalIdleTime);
+
+    std::ostringstream hists;
+    static const char *prionames[] = {"Low", "Med", "High"};
+    for (int i = ThreadPool::HIGH_PRIORITY; i >= ThreadPool::LOW_PRIORITY; i--) {
+        hists << prionames[i] << " priority wait (ms): " << histSummary(stats.waitHist[i]) << "\n";
+        hists << prionames[i] << " priority run  (ms): " << histSummary(stats.runHist[i]) << "\n";
+    }
+    for (const auto& jt : stats.jobTypes) {
+        hists << jt.name << " wait (ms): " << histSummary(jt.wait) << "\n";
+        hists << jt.name << " run  (ms): " << histSummary(jt.run) << "\n";
+    }
+    UpnpPrintf(UPNP_DEBUG, API, DbgFileName, DbgLineNo, "%s latencies:\n%s",
+               msg, hists.str().c_str());
+    UpnpPrintf(UPNP_DEBUG, API, DbgFileName, DbgLineNo,
+               "%s autoscaling: grow decisions %d (threads added %d), shrink decisions %d "
+               "(threads retired %d), last p95 wait %.3f ms with %d threads\n", msg,
+               stats.autoscaleGrowDecisions, stats.autoscaleThreadsAdded,
+               stats.autoscaleShrinkDecisions, stats.autoscaleThreadsRetired,
+               static_cast<double>(stats.autoscaleLastP95Us) / 1000.0, stats.autoscaleLastThreads);
+    UpnpPrintf(UPNP_DEBUG, API, DbgFileName, DbgLineNo,
+               "%s deadline jobs: pending %d started %d missed %d discarded %d, lateness (ms): %s\n",
+               msg, stats.currentJobsDeadline, stats.totalJobsDeadline, stats.deadlineMissed,
+               stats.deadlineDiscarded, histSummary(stats.deadlineLateness).c_str());
+    UpnpPrintf(UPNP_DEBUG, API, DbgFileName, DbgLineNo,
+               "%s queue depth: max %d, dropped jobs %d\n",
+               msg, stats.maxQueuedJobs, stats.droppedJobs);
 }
-#endif
 
 EXPORT_SPEC int UpnpFinish()
 {
@@ -781,6 +1182,14 @@ EXPORT_SPEC int UpnpFinish()
 #endif
     gTimerThread->shutdown();
     delete gTimerThread;
+    gTimerThread = nullptr;
+#if defined(INCLUDE_CLIENT_APIS) && EXCLUDE_SOAP == 0
+    // Before the pools shutdown, so that the completion callbacks can run.
+    SoapClientShutdown();
+#endif
+#if defined(INCLUDE_DEVICE_APIS) && EXCLUDE_GENA == 0
+    genaNotifyShutdown();
+#endif
 #if EXCLUDE_MINISERVER == 0
     StopMiniServer();
 #endif
@@ -788,18 +1197,31 @@ EXPORT_SPEC int UpnpFinish()
     web_server_destroy();
 #endif
 
-    
-#if 0
-    // Don't try to delete the thread pools, this does not work at the moment. See comments in
-    // initThreadPools and ThreadPool.cpp ~ThreadPool()
-    for (const auto& [t, d] : o_threadpools) {
-        t->shutdown();
-        PrintThreadPoolStats(t, __FILE__, __LINE__, d);
+
+    // The timer and miniserver threads are stopped, so all the jobs should return promptly: stop
+    // and join all the pool threads. They will be restarted by the next UpnpInit2().
+    if (o_threadpoolsstarted) {
+        for (const auto& [t, d] : o_threadpools) {
+            t->shutdown();
+            PrintThreadPoolStats(t, __FILE__, __LINE__, d);
+        }
+        o_threadpoolsstarted = false;
+    }
+#if defined(INCLUDE_DEVICE_APIS) && EXCLUDE_GENA == 0
+    {
+        UpnpEventDeliveryStats es;
+        genaGetDeliveryStats(&es);
+        auto ok = es.newConnections + es.reusedConnections;
+        UpnpPrintf(UPNP_DEBUG, API, __FILE__, __LINE__,
+                   "Event delivery: notifications %llu failed %llu, new connections %llu "
+                   "reused %llu (%.1f%%)\n", es.notifications, es.failures, es.newConnections,
+                   es.reusedConnections, ok ? 100.0 * es.reusedConnections / ok : 0.0);
     }
 #endif
-    
+
     /* remove all virtual dirs */
     UpnpRemoveAllVirtualDirs();
+    http_clear_curl_handles();
     UpnpSdkInit = 0;
     UpnpCloseLog();
     NetIF::Interfaces::cleanup();
@@ -931,8 +1353,15 @@ static int FreeHandle(int handleindex)
 {
     if (handleindex >= 1 && handleindex < NUM_HANDLE) {
         if (HandleTable[handleindex] != nullptr) {
+#ifdef INCLUDE_DEVICE_APIS
+            bool isdevice = HandleTable[handleindex]->HType == HND_DEVICE;
+#endif
             delete HandleTable[handleindex];
             HandleTable[handleindex] = nullptr;
+#ifdef INCLUDE_DEVICE_APIS
+            if (isdevice)
+                UpdateServiceRoutes();
+#endif
             return UPNP_E_SUCCESS;
         }
     }
@@ -1043,6 +1472,7 @@ static int registerRootDeviceAllForms(
         UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__, "\nUpnpRegisterRootDeviceAF: no services\n");
     }
 #endif /* EXCLUDE_GENA */
+    UpdateServiceRoutes();
 
     return UPNP_E_SUCCESS;
 }
@@ -1083,6 +1513,7 @@ EXPORT_SPEC int UpnpDeviceSetProduct(UpnpDevice_Handle Hnd, const char *product,
         return UPNP_E_INVALID_HANDLE;
     }
     HInfo->productversion = std::string(product) + "/" + std::string(version);
+    UpdateServiceRoutes();
     return UPNP_E_SUCCESS;
 }
 
@@ -1590,6 +2021,17 @@ int UpnpSetMaxSubscriptionTimeOut(UpnpDevice_Handle Hnd, int MaxSubscriptionTime
 }
 #endif /* INCLUDE_DEVICE_APIS */
 
+#ifdef INCLUDE_DEVICE_APIS
+int UpnpGetEventDeliveryStats(struct UpnpEventDeliveryStats *stats)
+{
+    if (nullptr == stats) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    genaGetDeliveryStats(stats);
+    return UPNP_E_SUCCESS;
+}
+#endif /* INCLUDE_DEVICE_APIS */
+
 #ifdef INCLUDE_CLIENT_APIS
 int UpnpSubsOpsTimeoutMs(UpnpClient_Handle Hnd, int TimeOutMS)
 {
@@ -1808,6 +2250,39 @@ int UpnpAcceptSubscriptionXML(UpnpDevice_Handle Hnd, const char *DevID, const ch
 
 
 #if EXCLUDE_SOAP == 0
+#ifdef INCLUDE_DEVICE_APIS
+int UpnpDeferAction(struct Upnp_Action_Request *request, UpnpDeferredAction *handle)
+{
+    if (nullptr == request || nullptr == handle) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    return soap_defer_action(request, handle);
+}
+
+int UpnpCompleteAction(
+    UpnpDeferredAction handle, int status, const struct Upnp_Action_Request *result)
+{
+    if (nullptr == handle) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    if (nullptr == result) {
+        // Still answer the request and release the handle
+        struct Upnp_Action_Request failed{};
+        soap_complete_action(handle, UPNP_E_INVALID_PARAM, &failed);
+        return UPNP_E_INVALID_PARAM;
+    }
+    return soap_complete_action(handle, status, result);
+}
+
+int UpnpGetActionXML(const struct Upnp_Action_Request *request, std::string& xml)
+{
+    if (nullptr == request) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    return soap_get_action_xml(request, xml);
+}
+#endif /* INCLUDE_DEVICE_APIS */
+
 #ifdef INCLUDE_CLIENT_APIS
 int UpnpSendAction(
     UpnpClient_Handle Hnd,
@@ -1837,6 +2312,63 @@ int UpnpSendAction(
                           actionParams, response, errcodep, errdesc);
 }
 
+int UpnpSendActionAsync(
+    UpnpClient_Handle Hnd,
+    const std::string& headerString,
+    const std::string& actionURL,
+    const std::string& serviceType,
+    const std::string& actionName,
+    const std::vector<std::pair<std::string, std::string>>& actionParams,
+    int timeoutMs,
+    UpnpActionCallback callback,
+    UpnpActionId *id)
+{
+    if (UpnpSdkInit != 1) {
+        return UPNP_E_FINISH;
+    }
+    if (actionURL.empty() || serviceType.empty() || actionName.empty() || !callback) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    {
+        HANDLELOCK();
+        if (checkHandle(HND_CLIENT, Hnd) == HND_INVALID) {
+            return UPNP_E_INVALID_HANDLE;
+        }
+    }
+
+    return SoapSendActionAsync(headerString, actionURL, serviceType, actionName,
+                               actionParams, timeoutMs, std::move(callback), id);
+}
+
+int UpnpCancelAction(UpnpActionId id)
+{
+    return SoapCancelAction(id);
+}
+
+int UpnpSendActionBatch(
+    UpnpClient_Handle Hnd,
+    const std::vector<UpnpBatchAction>& actions,
+    int timeoutMs,
+    std::vector<UpnpActionResult>& results)
+{
+    if (UpnpSdkInit != 1) {
+        return UPNP_E_FINISH;
+    }
+    for (const auto& action : actions) {
+        if (action.actionURL.empty() || action.serviceType.empty() || action.actionName.empty()) {
+            return UPNP_E_INVALID_PARAM;
+        }
+    }
+    {
+        HANDLELOCK();
+        if (checkHandle(HND_CLIENT, Hnd) == HND_INVALID) {
+            return UPNP_E_INVALID_HANDLE;
+        }
+    }
+
+    return SoapSendActionBatch(actions, timeoutMs, results);
+}
+
 #endif /* INCLUDE_CLIENT_APIS */
 #endif /* EXCLUDE_SOAP */
 
@@ -1923,6 +2455,55 @@ Upnp_Handle_Type GetDeviceHandleInfo(
 
 
 // This is used in SOAP and GENA to find the device associated with an incoming URL.
+#ifdef INCLUDE_DEVICE_APIS
+static std::shared_ptr<const ServiceRoutes> gServiceRoutes{std::make_shared<ServiceRoutes>()};
+
+std::shared_ptr<const ServiceRoutes> GetServiceRoutes()
+{
+    return std::atomic_load(&gServiceRoutes);
+}
+
+std::string ServiceRouteKey(const std::string& url)
+{
+    // Request paths from the HTTP server are used as is
+    if (!url.empty() && url[0] == '/' && url.find_first_of("?#") == std::string::npos &&
+        url.compare(0, 2, "//")) {
+        return url;
+    }
+    uri_type parsed;
+    if (parse_uri(url, &parsed) != UPNP_E_SUCCESS) {
+        return {};
+    }
+    return parsed.query.empty() ? parsed.path : parsed.path + "?" + parsed.query;
+}
+
+void UpdateServiceRoutes()
+{
+    auto routes = std::make_shared<ServiceRoutes>();
+    for (int idx = 1; idx < NUM_HANDLE; idx++) {
+        Handle_Info *hinf;
+        if (GetHandleInfo(idx, &hinf) != HND_DEVICE) {
+            continue;
+        }
+        for (auto& service : hinf->serviceTable) {
+            auto colon = service.serviceType.rfind(':');
+            auto route = std::make_shared<const ServiceRoute>(ServiceRoute{
+                    idx, &service, service.UDN, service.serviceType, service.serviceId,
+                    colon == std::string::npos ? 0 : colon, hinf->Callback, hinf->Cookie,
+                    hinf->productversion});
+            // Like the previous linear search, the first device and service win.
+            if (!service.controlURL.empty()) {
+                routes->control.emplace(ServiceRouteKey(service.controlURL), route);
+            }
+            if (!service.eventURL.empty()) {
+                routes->event.emplace(ServiceRouteKey(service.eventURL), route);
+            }
+        }
+    }
+    std::atomic_store(&gServiceRoutes, std::shared_ptr<const ServiceRoutes>(std::move(routes)));
+}
+#endif /* INCLUDE_DEVICE_APIS */
+
 Upnp_Handle_Type GetDeviceHandleInfoForPath(
     const std::string& path, UpnpDevice_Handle *devhdl,
     struct Handle_Info **HndInfo, service_info **serv_info)
@@ -1931,18 +2512,22 @@ Upnp_Handle_Type GetDeviceHandleInfoForPath(
     *serv_info = nullptr;
 
 #ifdef INCLUDE_DEVICE_APIS
-
-    for (int idx = 1; idx < NUM_HANDLE;    idx++) {
-        Handle_Info *hinf;
-        if (GetHandleInfo(idx, &hinf) == HND_DEVICE) {
-            if ((*serv_info = FindServiceControlURLPath(hinf->serviceTable, path)) ||
-                (*serv_info = FindServiceEventURLPath(hinf->serviceTable, path))) {
-                *HndInfo = hinf;
-                *devhdl = idx;
-                return HND_DEVICE;
-            }
+    // The index is updated with the handle lock held, which our caller holds,
+    // so the service pointers are valid.
+    auto routes = GetServiceRoutes();
+    auto key = ServiceRouteKey(path);
+    auto it = routes->control.find(key);
+    if (it == routes->control.end()) {
+        it = routes->event.find(key);
+        if (it == routes->event.end()) {
+            return HND_INVALID;
         }
     }
+    if (GetHandleInfo(it->second->hnd, HndInfo) == HND_DEVICE) {
+        *serv_info = it->second->service;
+        *devhdl = it->second->hnd;
+        return HND_DEVICE;
+    }
 #endif /* INCLUDE_DEVICE_APIS */
 
     return HND_INVALID;
@@ -2168,6 +2753,23 @@ int UpnpSetMaxContentLength(size_t contentLength)
     return UPNP_E_SUCCESS;
 }
 
+int UpnpSetResponseCompression(int enable, size_t minSize)
+{
+    if (!http_set_compression(enable != 0, minSize)) {
+        return UPNP_E_NOT_FOUND;
+    }
+    return UPNP_E_SUCCESS;
+}
+
+int UpnpSetActionConnectionCache(int maxIdlePerHost, int idleTimeout)
+{
+    if (idleTimeout <= 0) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    http_set_curl_cache(maxIdlePerHost, idleTimeout);
+    return UPNP_E_SUCCESS;
+}
+
 [[maybe_unused]] static int UpnpSetEventQueueLimits(int maxLen, int maxAge)
 {
     g_UpnpSdkEQMaxLen = maxLen;
@@ -51,6 +51,7 @@
 #include "ThreadPool.h"
 #include "genut.h"
 #include "ssdplib.h"
+#include "statcodes.h"
 #include "upnpapi.h"
 #include "uri.h"
 
@@ -59,11 +60,22 @@
 #include <condition_variable>
 #include <cstdio>
 #include <cstring>
+#include <set>
 
 #include <microhttpd.h>
 
 #if MHD_VERSION < 0x00095300
 #define MHD_USE_INTERNAL_POLLING_THREAD MHD_USE_SELECT_INTERNALLY
+// Older versions abort when suspending a connection with MHD_USE_THREAD_PER_CONNECTION. A
+// deferred response blocks the connection thread instead, see suspend_or_queue(), so we
+// need one thread per connection.
+#define MHD_ALLOW_SUSPEND_RESUME 0
+#define NO_MHD_SUSPEND_RESUME
+#define MHD_THREADING_FLAGS (MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD)
+#else
+// A pool of HTTP_SERVER_THREADS threads polls the connections, a suspended connection does
+// not use a thread.
+#define MHD_THREADING_FLAGS (MHD_USE_AUTO | MHD_USE_INTERNAL_POLLING_THREAD)
 #endif
 
 #if MHD_VERSION <= 0x00097000
@@ -85,11 +97,15 @@ static std::condition_variable gMServStateCV;
 static MiniServerSockArray *miniSocket;
 static MiniServerState gMServState = MSERV_IDLE;
 static struct MHD_Daemon *mhd;
+// Requests with a deferred response, for cleaning up at shutdown.
+static std::mutex gDeferredMutex;
+static std::set<std::shared_ptr<MHDDeferredResponse>> gDeferred;
 
 #ifdef INTERNAL_WEB_SERVER
 static MiniServerCallback gGetCallback = nullptr;
 static MiniServerCallback gSoapCallback = nullptr;
 static MiniServerCallback gGenaCallback = nullptr;
+static MiniServerBodyCallback gSoapBodyCallback = nullptr;
 
 void SetHTTPGetCallback(MiniServerCallback callback)
 {
@@ -102,6 +118,11 @@ void SetSoapCallback(MiniServerCallback callback)
 {
     gSoapCallback = callback;
 }
+
+void SetSoapBodyCallback(MiniServerBodyCallback callback)
+{
+    gSoapBodyCallback = callback;
+}
 #endif /* INCLUDE_DEVICE_APIS */
 
 void SetGenaCallback(MiniServerCallback callback)
@@ -169,8 +190,71 @@ static const std::map<std::string_view, int> strmethtometh {
 
 static void request_completed_cb(void*, MHD_Connection*, MHDTransaction** con_cls, MHD_RequestTerminationCode)
 {
-    if (con_cls)
-        delete *con_cls;
+    if (con_cls && *con_cls) {
+        auto mhdt = *con_cls;
+        if (mhdt->deferred) {
+            {
+                std::scoped_lock lck(mhdt->deferred->mutex);
+                mhdt->deferred->mhdt = nullptr;
+                mhdt->deferred->done = true;
+            }
+            std::scoped_lock lck(gDeferredMutex);
+            gDeferred.erase(mhdt->deferred);
+        }
+        delete mhdt;
+    }
+}
+
+std::shared_ptr<MHDDeferredResponse> miniServerDefer(MHDTransaction *mhdt)
+{
+    mhdt->deferred = std::make_shared<MHDDeferredResponse>();
+    mhdt->deferred->mhdt = mhdt;
+    std::scoped_lock lck(gDeferredMutex);
+    gDeferred.insert(mhdt->deferred);
+    return mhdt->deferred;
+}
+
+bool miniServerCompleteDeferred(
+    const std::shared_ptr<MHDDeferredResponse>& deferred,
+    const std::function<void (MHDTransaction*)>& fill)
+{
+    {
+        std::scoped_lock lck(deferred->mutex);
+        if (deferred->done || nullptr == deferred->mhdt) {
+            return false;
+        }
+        fill(deferred->mhdt);
+        deferred->done = true;
+#ifdef NO_MHD_SUSPEND_RESUME
+        deferred->cv.notify_all();
+#else
+        // If the connection is not suspended yet, answer_to_connection() will
+        // find the response when the callback returns.
+        if (deferred->suspended) {
+            deferred->suspended = false;
+            MHD_resume_connection(deferred->mhdt->conn);
+        }
+#endif
+    }
+    std::scoped_lock lck(gDeferredMutex);
+    gDeferred.erase(deferred);
+    return true;
+}
+
+// Answer all the suspended connections: MHD can't be stopped while some exist.
+static void abort_deferred()
+{
+    decltype(gDeferred) pending;
+    {
+        std::scoped_lock lck(gDeferredMutex);
+        pending.swap(gDeferred);
+    }
+    for (const auto& deferred : pending) {
+        miniServerCompleteDeferred(deferred, [](MHDTransaction *mhdt) {
+            mhdt->response = MHD_create_response_from_buffer(0, nullptr, MHD_RESPMEM_PERSISTENT);
+            mhdt->httpstatus = 503;
+        });
+    }
 }
 
 
@@ -291,6 +375,81 @@ static std::string rebuild_url_from_mhdt(
     return aurl;
 }
 
+static MHD_Result queue_response(struct MHD_Connection *conn, MHDTransaction *mhdt)
+{
+    if (nullptr == mhdt->response) {
+        UpnpPrintf(UPNP_ERROR, MSERV, __FILE__, __LINE__,
+                   "answer_to_connection: NULL response !!\n");
+        return MHD_NO;
+    }
+
+    //MHD_add_response_header(mhdt->response, "Connection", "close");
+
+    MHD_get_response_headers (mhdt->response, show_resp_headers_cb, nullptr);
+    MHD_Result ret = MHD_queue_response(conn, mhdt->httpstatus, mhdt->response);
+    MHD_destroy_response(mhdt->response);
+    mhdt->response = nullptr;
+    return ret;
+}
+
+// The callback deferred the response: suspend the connection until it is
+// ready, or send it if it was produced already. Without suspend/resume
+// support, wait for the response in the connection thread. The connection
+// can't go away while we wait, and abort_deferred() answers the pending
+// requests at shutdown.
+static MHD_Result suspend_or_queue(struct MHD_Connection *conn, MHDTransaction *mhdt)
+{
+    {
+        std::unique_lock lck(mhdt->deferred->mutex);
+#ifdef NO_MHD_SUSPEND_RESUME
+        mhdt->deferred->cv.wait(lck, [mhdt] { return mhdt->deferred->done; });
+#else
+        if (!mhdt->deferred->done) {
+            if (!mhdt->deferred->suspended) {
+                MHD_suspend_connection(conn);
+                mhdt->deferred->suspended = true;
+            }
+            return MHD_YES;
+        }
+#endif
+    }
+    return queue_response(conn, mhdt);
+}
+
+// The size of incoming SOAP requests is limited by g_maxContentLength (see
+// UpnpSetMaxContentLength(), 0 for no limit). The announced size is checked in
+// the first call, before MHD sends "100 Continue" and reads the body. The
+// received size is checked as the data arrives, which covers chunked bodies.
+// MHD does not accept a response while it is receiving the body, so the rest
+// of the data is dropped and the error is sent from the final call.
+static bool soap_size_limited(const MHDTransaction *mhdt)
+{
+    return g_maxContentLength != 0 &&
+        (mhdt->method == SOAPMETHOD_POST || mhdt->method == HTTPMETHOD_MPOST);
+}
+
+static bool soap_announced_too_large(const MHDTransaction *mhdt)
+{
+    if (!soap_size_limited(mhdt))
+        return false;
+    auto it = mhdt->headers.find("content-length");
+    return it != mhdt->headers.end() &&
+        strtoull(it->second.c_str(), nullptr, 10) > g_maxContentLength;
+}
+
+// End of the first call, with only the headers: refuse an oversized SOAP request now.
+static MHD_Result headers_done(struct MHD_Connection *conn, MHDTransaction *mhdt)
+{
+    if (soap_announced_too_large(mhdt)) {
+        UpnpPrintf(UPNP_INFO, MSERV, __FILE__, __LINE__,
+                   "answer_to_connection: SOAP request too big (max %d)\n",
+                   static_cast<int>(g_maxContentLength));
+        http_SendStatusResponse(mhdt, HTTP_REQ_ENTITY_TOO_LARGE);
+        return queue_response(conn, mhdt);
+    }
+    return MHD_YES;
+}
+
 static MHD_Result answer_to_connection(
     void *, struct MHD_Connection *conn, 
     const char *url, const char *method, const char *version, 
@@ -329,12 +488,12 @@ static MHD_Result answer_to_connection(
         // We normally verify the contents of the HOST header, but we used not
         // to. This option preserves the old behaviour.
         if (g_optionFlags & UPNP_FLAG_NO_HOST_VALIDATE) {
-            return MHD_YES;
+            return headers_done(conn, mhdt);
         }
         
         NetIF::IPAddr claddr(reinterpret_cast<sockaddr*>(&mhdt->client_address));
         switch (validate_host_header(mhdt, claddr)) {
-        case VHH_YES: return MHD_YES;
+        case VHH_YES: return headers_done(conn, mhdt);
         case VHH_NO: return MHD_NO;
         case VHH_REDIRECT: break;
         }
@@ -359,11 +518,43 @@ static MHD_Result answer_to_connection(
     }
 
     auto mhdt = static_cast<MHDTransaction *>(*con_cls);
+    if (mhdt->deferred) {
+        // Called again after MHD_resume_connection()
+        return suspend_or_queue(conn, mhdt);
+    }
     if (*upload_data_size) {
-        mhdt->postdata.append(upload_data, *upload_data_size);
+        if (!mhdt->bodytoolarge && soap_size_limited(mhdt) &&
+            mhdt->bodysize + *upload_data_size > g_maxContentLength) {
+            UpnpPrintf(UPNP_INFO, MSERV, __FILE__, __LINE__,
+                       "answer_to_connection: SOAP request too big (max %d)\n",
+                       static_cast<int>(g_maxContentLength));
+            mhdt->bodytoolarge = true;
+            mhdt->bodyconsumer.reset();
+            std::string().swap(mhdt->postdata);
+        }
+        if (mhdt->bodytoolarge) {
+            *upload_data_size = 0;
+            return MHD_YES;
+        }
+#ifdef INCLUDE_DEVICE_APIS
+        if (mhdt->bodysize == 0 && nullptr != gSoapBodyCallback &&
+            (mhdt->method == SOAPMETHOD_POST || mhdt->method == HTTPMETHOD_MPOST)) {
+            mhdt->bodyconsumer = gSoapBodyCallback(mhdt);
+        }
+#endif
+        mhdt->bodysize += *upload_data_size;
+        if (mhdt->bodyconsumer) {
+            mhdt->bodyconsumer->data(upload_data, *upload_data_size);
+        } else {
+            mhdt->postdata.append(upload_data, *upload_data_size);
+        }
         *upload_data_size = 0;
         return MHD_YES;
     }
+    if (mhdt->bodytoolarge) {
+        http_SendStatusResponse(mhdt, HTTP_REQ_ENTITY_TOO_LARGE);
+        return queue_response(conn, mhdt);
+    }
     UpnpPrintf(UPNP_DEBUG, MSERV, __FILE__, __LINE__,
                "answer_to_connection: end of upload, postdata:\n[%s]\n", mhdt->postdata.c_str());
     
@@ -400,18 +591,10 @@ static MHD_Result answer_to_connection(
 
     callback(mhdt);
 
-    if (nullptr == mhdt->response) {
-        UpnpPrintf(UPNP_ERROR, MSERV, __FILE__, __LINE__,
-                   "answer_to_connection: NULL response !!\n");
-        return MHD_NO;
+    if (mhdt->deferred) {
+        return suspend_or_queue(conn, mhdt);
     }
-
-    //MHD_add_response_header(mhdt->response, "Connection", "close");
-
-    MHD_get_response_headers (mhdt->response, show_resp_headers_cb, nullptr);
-    MHD_Result ret = MHD_queue_response(conn, mhdt->httpstatus, mhdt->response);
-    MHD_destroy_response(mhdt->response);
-    return ret;
+    return queue_response(conn, mhdt);
 }
 
 static void ssdp_read(SOCKET rsock, fd_set *set)
@@ -781,7 +964,8 @@ int StartMiniServer(uint16_t *listen_port4, uint16_t *listen_port6)
     {
         std::unique_lock<std::mutex> lck(gMServStateMutex);
         auto worker = std::make_unique<MiniServerJobWorker>();
-        ret_code = gMiniServerThreadPool.addPersistent(std::move(worker));
+        ret_code = gMiniServerThreadPool.addPersistent(
+            std::move(worker), ThreadPool::MED_PRIORITY, &g_miniServerThreadSched);
         if (ret_code != 0) {
             ret_code = UPNP_E_OUTOF_MEMORY;
             goto out;
@@ -798,7 +982,7 @@ int StartMiniServer(uint16_t *listen_port4, uint16_t *listen_port6)
     }
     
 #ifdef INTERNAL_WEB_SERVER
-    mhdflags = MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_DEBUG;
+    mhdflags = MHD_THREADING_FLAGS | MHD_USE_DEBUG | MHD_ALLOW_SUSPEND_RESUME;
 
 #ifdef UPNP_ENABLE_IPV6
     if (using_ipv6()) {
@@ -813,6 +997,9 @@ int StartMiniServer(uint16_t *listen_port4, uint16_t *listen_port6)
         MHD_OPTION_NOTIFY_COMPLETED, request_completed_cb, nullptr,
         MHD_OPTION_CONNECTION_TIMEOUT, static_cast<unsigned int>(HTTP_DEFAULT_TIMEOUT),
         MHD_OPTION_EXTERNAL_LOGGER, mhdlogger, nullptr, 
+#ifndef NO_MHD_SUSPEND_RESUME
+        MHD_OPTION_THREAD_POOL_SIZE, static_cast<unsigned int>(HTTP_SERVER_THREADS),
+#endif
         MHD_OPTION_END);
     if (nullptr == mhd) {
         UpnpPrintf(UPNP_CRITICAL, MSERV, __FILE__, __LINE__,
@@ -845,6 +1032,7 @@ int StopMiniServer()
     }
 
 #ifdef INTERNAL_WEB_SERVER
+    abort_deferred();
     MHD_stop_daemon(mhd);
 #endif
 
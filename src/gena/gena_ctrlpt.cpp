@@ -53,8 +53,8 @@
 #include "expatmm.h"
 #define XMLPARSERTP inputRefXMLParser
 #else
-#include "picoxml.h"
-#define XMLPARSERTP PicoXMLParser
+#include "picoxmlview.h"
+#define XMLPARSERTP PicoXMLViewParser
 #endif
 
 #define UPNP_NOPE static_cast<Upnp_LogLevel>(UPNP_ALL+1)
@@ -92,6 +92,31 @@ static void clientCancelRenew(ClientSubscription *sub)
     }
 }
 
+/** Calls back the control point application about a subscription. Runs in the callback pool,
+ *  so that the application does not delay the protocol jobs. */
+class SubscriptionCallbackJobWorker : public JobWorker {
+public:
+    SubscriptionCallbackJobWorker(int h, Upnp_EventType t, const Upnp_Event_Subscribe& s)
+        : handle(h), eventType(t), sub(s) {}
+    void work() override {
+        Upnp_FunPtr callback_fun;
+        struct Handle_Info *handle_info;
+        void *cookie;
+        {
+            HANDLELOCK();
+            if (GetHandleInfo(handle, &handle_info) != HND_CLIENT) {
+                return;
+            }
+            callback_fun = handle_info->Callback;
+            cookie = handle_info->Cookie;
+        }
+        callback_fun(eventType, &sub, cookie);
+    }
+    int handle;
+    Upnp_EventType eventType;
+    struct Upnp_Event_Subscribe sub;
+};
+
 class AutoRenewSubscriptionJobWorker : public JobWorker {
 public:
     explicit AutoRenewSubscriptionJobWorker(
@@ -136,18 +161,8 @@ void AutoRenewSubscriptionJobWorker::work()
 #endif
 
     if (send_callback) {
-        Upnp_FunPtr callback_fun;
-        struct Handle_Info *handle_info;
-        void *cookie;
-        {
-            HANDLELOCK();
-            if (GetHandleInfo(handle, &handle_info) != HND_CLIENT) {
-                return;
-            }
-            callback_fun = handle_info->Callback;
-            cookie = handle_info->Cookie;
-        }
-        callback_fun(eventType, &sub, cookie);
+        gCallbackThreadPool.addJob(
+            std::make_unique<SubscriptionCallbackJobWorker>(handle, eventType, sub));
     }
 }
 
@@ -606,8 +621,9 @@ public:
 
 protected:
     void EndElement(const XML_Char *name) override {
-        const std::string& parentname = (m_path.size() == 1) ?
-            "root" : m_path[m_path.size()-2].name;
+        std::string_view parentname{"root"};
+        if (m_path.size() > 1)
+            parentname = m_path[m_path.size()-2].name;
         trimstring(m_chardata, " \t\n\r");
 
         if (!dom_cmp_name(parentname, "property")) {
@@ -36,14 +36,19 @@
 #if EXCLUDE_GENA == 0
 #ifdef INCLUDE_DEVICE_APIS
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 
 #include <curl/curl.h>
 
+#include "CurlMultiLoop.h"
 #include "gena.h"
 #include "gena_sids.h"
 #include "genut.h"
+#include "PoolTask.h"
 #include "statcodes.h"
 #include "upnpapi.h"
 #include "uri.h"
@@ -67,6 +72,7 @@ int genaUnregisterDevice(UpnpDevice_Handle device_handle)
         return UPNP_E_INVALID_HANDLE;
     }
     clearServiceTable(handle_info->serviceTable);
+    UpdateServiceRoutes();
     return UPNP_E_SUCCESS;
 }
 
@@ -100,6 +106,120 @@ static int GeneratePropertySet(
 }
 
 
+/* The curl handle used to send the events of a subscription. It is kept between events so
+ * that its connection to the subscriber stays open. The events of a subscription are sent one
+ * at a time, so there is no concurrent access. */
+struct GenaConnection {
+    GenaConnection() = default;
+    ~GenaConnection() {
+        if (nullptr != easy)
+            curl_easy_cleanup(easy);
+    }
+    GenaConnection(const GenaConnection&) = delete;
+    GenaConnection& operator=(const GenaConnection&) = delete;
+    CURL *easy{nullptr};
+};
+
+/* Counters for UpnpGetEventDeliveryStats() */
+static struct {
+    std::atomic<uint64_t> notifications{0};
+    std::atomic<uint64_t> failures{0};
+    std::atomic<uint64_t> newConnections{0};
+    std::atomic<uint64_t> reusedConnections{0};
+} gDeliveryStats;
+
+/* Take the kept handle from the subscription connection, or create one. The caller owns the
+ * handle until it passes it to genaNotifyDone() */
+static CURL *genaGetHandle(GenaConnection *conn)
+{
+    CURL *easy{nullptr};
+    if (nullptr != conn) {
+        easy = conn->easy;
+        conn->easy = nullptr;
+    }
+    if (nullptr == easy) {
+        easy = curl_easy_init();
+    }
+    return easy;
+}
+
+/* Set up the NOTIFY request to one of the subscription delivery URLs. Returns the header list,
+ * to be freed after the transfer. */
+static struct curl_slist *genaSetupNotify(
+    CURL *easy, const std::string& propertySet, const subscription *sub, const std::string& url,
+    char *errorbuffer)
+{
+    curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, errorbuffer);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback_null_curl);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, nullptr);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT,
+                     long(GENA_NOTIFICATION_SENDING_TIMEOUT +
+                          GENA_NOTIFICATION_ANSWERING_TIMEOUT)/2);
+    curl_easy_setopt(easy, CURLOPT_POST, long(1));
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDS, propertySet.c_str());
+    curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, "NOTIFY");
+
+    struct curl_slist *list = nullptr;
+    list = curl_slist_append(list, "NT: upnp:event");
+    list = curl_slist_append(list, "NTS: upnp:propchange");
+    list = curl_slist_append(list,(std::string("SID: ") + sub->sid).c_str());
+    auto buff = std::to_string(sub->ToSendEventKey);
+    list = curl_slist_append(list, (std::string("SEQ: ") + buff).c_str());
+
+    list = curl_slist_append(list, "Accept:");
+    list = curl_slist_append(list, "Expect:");
+    list = curl_slist_append(list, R"(Content-Type: text/xml; charset="utf-8")");
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, list);
+    curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+    return list;
+}
+
+/* Account for a finished NOTIFY transfer, and get the HTTP status. The handle is kept in the
+ * subscription connection for the next event, unless the transfer failed: the subscriber may be
+ * gone, and we'd rather start afresh next time.
+ * Returns UPNP_E_SUCCESS if the transfer was network-successful. */
+static int genaNotifyDone(CURL *easy, CURLcode code, GenaConnection *conn, long *http_code,
+                          const char *errorbuffer)
+{
+    int return_code;
+    gDeliveryStats.notifications++;
+    if (code == CURLE_OK) {
+        return_code = UPNP_E_SUCCESS;
+        curl_easy_getinfo (easy, CURLINFO_RESPONSE_CODE, http_code);
+        long connects = 0;
+        curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+        if (connects > 0) {
+            gDeliveryStats.newConnections++;
+        } else {
+            gDeliveryStats.reusedConnections++;
+        }
+    } else {
+        // Note: this is common: e.g. client exited without unsubscribing
+        UpnpPrintf(UPNP_DEBUG, GENA, __FILE__, __LINE__,
+                   "CURL ERROR MESSAGE %s\n", errorbuffer);
+        gDeliveryStats.failures++;
+        return_code = UPNP_E_BAD_RESPONSE;
+    }
+    if (nullptr != conn && code == CURLE_OK) {
+        curl_easy_reset(easy);
+        conn->easy = easy;
+    } else {
+        curl_easy_cleanup(easy);
+    }
+    return return_code;
+}
+
+/* Compute the notification result from the HTTP status of a network-successful transfer. */
+static int genaNotifyStatus(long http_code)
+{
+    if (http_code == HTTP_OK)
+        return UPNP_E_SUCCESS;
+    if (http_code == HTTP_PRECONDITION_FAILED)
+        /*Invalid SID gets removed */
+        return GENA_E_NOTIFY_UNACCEPTED_REMOVE_SUB;
+    return UPNP_E_NOTIFY_UNACCEPTED;
+}
+
 /*!
  * \brief Function to Notify a particular subscription of a particular event.
  *
@@ -127,64 +247,30 @@ static int genaNotify(const std::string& propertySet, const subscription *sub)
 
     /* send a notify to each url until one goes thru */
     for (const auto& url : sub->DeliveryURLs) {
-        CURL *easy = curl_easy_init();
+        CURL *easy = genaGetHandle(sub->conn.get());
         char curlerrormessage[CURL_ERROR_SIZE];
-
-        curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, curlerrormessage);
-        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback_null_curl);
-        curl_easy_setopt(easy, CURLOPT_WRITEDATA, nullptr);
-        curl_easy_setopt(easy, CURLOPT_TIMEOUT,
-                         long(GENA_NOTIFICATION_SENDING_TIMEOUT +
-                              GENA_NOTIFICATION_ANSWERING_TIMEOUT)/2);
-        curl_easy_setopt(easy, CURLOPT_POST, long(1));
-        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, propertySet.c_str());
-        curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, "NOTIFY");
-
-        struct curl_slist *list = nullptr;
-        list = curl_slist_append(list, "NT: upnp:event");
-        list = curl_slist_append(list, "NTS: upnp:propchange");
-        list = curl_slist_append(list,(std::string("SID: ") + sub->sid).c_str());
-        auto buff = std::to_string(sub->ToSendEventKey);
-        list = curl_slist_append(list, (std::string("SEQ: ") + buff).c_str());
-
-        list = curl_slist_append(list, "Accept:");
-        list = curl_slist_append(list, "Expect:");
-        list = curl_slist_append(list, R"(Content-Type: text/xml; charset="utf-8")");
-        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, list);
-        curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
-
+        struct curl_slist *list = genaSetupNotify(easy, propertySet, sub, url, curlerrormessage);
         CURLcode code = curl_easy_perform(easy);
-        if (code == CURLE_OK) {
-            return_code = UPNP_E_SUCCESS;
-            curl_easy_getinfo (easy, CURLINFO_RESPONSE_CODE, &http_code);
-        } else {
-            // Note: this is common: e.g. client exited without unsubscribing
-            UpnpPrintf(UPNP_DEBUG, GENA, __FILE__, __LINE__,
-                       "CURL ERROR MESSAGE %s\n", curlerrormessage);
-            return_code = UPNP_E_BAD_RESPONSE;
-        }
-        /* Clean-up. */
         curl_slist_free_all(list);
-        curl_easy_cleanup(easy);
-
+        return_code = genaNotifyDone(easy, code, sub->conn.get(), &http_code, curlerrormessage);
         if (return_code == UPNP_E_SUCCESS)
             break;
     }
 
     if (return_code == UPNP_E_SUCCESS) {
-        if (http_code == HTTP_OK) {
-            return_code = UPNP_E_SUCCESS;
-        } else {
-            if (http_code == HTTP_PRECONDITION_FAILED)
-                /*Invalid SID gets removed */
-                return_code = GENA_E_NOTIFY_UNACCEPTED_REMOVE_SUB;
-            else
-                return_code = UPNP_E_NOTIFY_UNACCEPTED;
-        }
+        return_code = genaNotifyStatus(http_code);
     }
     return return_code;
 }
 
+void genaGetDeliveryStats(struct UpnpEventDeliveryStats *stats)
+{
+    stats->notifications = gDeliveryStats.notifications;
+    stats->failures = gDeliveryStats.failures;
+    stats->newConnections = gDeliveryStats.newConnections;
+    stats->reusedConnections = gDeliveryStats.reusedConnections;
+}
+
 
 /* Notification structures are queued on the output queue of every
    subscription.  They hold some common data because the same event is
@@ -206,8 +292,9 @@ struct Notification {
 
 class GenaNotifyJobWorker : public JobWorker {
 public:
-    explicit GenaNotifyJobWorker(std::shared_ptr<Notification> in)
-        : m_input(std::move(in)) {}
+    // If sync is set, the event is sent by the job even with UPNP_FLAG_ASYNC_EVENTS
+    explicit GenaNotifyJobWorker(std::shared_ptr<Notification> in, bool sync = false)
+        : m_input(std::move(in)), m_sync(sync) {}
     void work() override;
     // This is actually shared with the outgoing list head.  Note: 2024-02: as far as I understand,
     // the only reason to keep a shared pointer to the active notification at the head of the
@@ -216,49 +303,140 @@ public:
     // should be queued or directly sent to the Thread Pool. This could probably be replaced by a
     // flag, which would allow to replace the shared_ptr with unique_ptr.
     std::shared_ptr<Notification> m_input;
+    bool m_sync;
 };
 
-/*!
- * \brief Thread job to Notify a control point.
- *
- * It validates and copies the subscription so that the lock can be
- * released during the actual network transfer (done by genaNotify())
- */
-void GenaNotifyJobWorker::work()
+static std::shared_ptr<Notification> genaNotifyOne(
+    const std::shared_ptr<Notification>& input, time_t *expireTime);
+static void genaNotifyUnwind(const Notification& input);
+
+/* Deadline for starting to send a notification: the control point should get it within the
+ * time it would take us to give up on an unresponsive one (GENA_NOTIFICATION_SENDING_TIMEOUT),
+ * and sending after the subscription expiration time is useless. */
+static std::chrono::steady_clock::time_point notifyDeadline(time_t expireTime)
+{
+    auto remaining = std::chrono::seconds(GENA_NOTIFICATION_SENDING_TIMEOUT);
+    if (expireTime != 0) {
+        remaining = std::min(remaining, std::chrono::seconds(expireTime - time(nullptr)));
+    }
+    return std::chrono::steady_clock::now() + remaining;
+}
+
+#ifdef NPUPNP_HAVE_COROUTINES
+
+/* Send the events queued for a subscription, one per step, giving the thread back to the pool
+ * in between, as the chained GenaNotifyJobWorker jobs do, but without allocating a new job for
+ * each event. If the frame is dropped before the first step, the caller does the unwinding. */
+static PoolTask genaNotifyPipeline(std::shared_ptr<Notification> notif)
+{
+    // If the resume job can't be queued, the frame is destroyed without the loop getting to run
+    // again, with the notification still at the head of the subscription queue.
+    struct UnwindGuard {
+        std::shared_ptr<Notification>& notif;
+        ~UnwindGuard() {
+            if (notif)
+                genaNotifyUnwind(*notif);
+        }
+    } guard{notif};
+    for (;;) {
+        time_t expireTime;
+        notif = genaNotifyOne(notif, &expireTime);
+        if (!notif)
+            co_return;
+        co_await resumeBefore(gSendThreadPool, notifyDeadline(expireTime));
+    }
+}
+#endif /* NPUPNP_HAVE_COROUTINES */
+
+/* Add a notification job to a batch, with a deadline computed by notifyDeadline(). The job is
+ * not discarded if late, because the subscription may have been renewed in the meantime, and
+ * skipping an event would break the SEQ numbering. */
+static void addNotifyJob(ThreadPool::JobBatch& batch, time_t expireTime,
+                         std::shared_ptr<Notification> notif, bool sync = false)
+{
+    std::unique_ptr<JobWorker> worker;
+#ifdef NPUPNP_HAVE_COROUTINES
+    if (!(g_optionFlags & UPNP_FLAG_ASYNC_EVENTS))
+        worker = genaNotifyPipeline(std::move(notif)).asJob();
+    else
+#endif
+        worker = std::make_unique<GenaNotifyJobWorker>(std::move(notif), sync);
+    batch.add(std::move(worker), notifyDeadline(expireTime));
+}
+
+static int queueNotifyJob(time_t expireTime, std::shared_ptr<Notification> notif,
+                          bool sync = false)
+{
+    ThreadPool::JobBatch batch;
+    addNotifyJob(batch, expireTime, std::move(notif), sync);
+    return gSendThreadPool.addJobs(batch);
+}
+
+/* Called when the job for the notification at the head of a subscription outgoing queue could not
+ * be queued (the pool is full or shutting down). Nothing would ever send the queued events, and
+ * new events would just be appended: drop them all so that the next event restarts the
+ * delivery. The event key is not incremented, so that the subscriber sees no gap in SEQ. */
+static void genaNotifyUnwind(const Notification& input)
 {
     subscription *sub;
     service_info *service;
-    subscription sub_copy;
-    int return_code;
     struct Handle_Info *handle_info;
 
-    {
-        HANDLELOCK();
-        /* validate context */
-        if (GetHandleInfo(m_input->device_handle, &handle_info) != HND_DEVICE) {
-            return;
-        }
+    HANDLELOCK();
+    if (GetHandleInfo(input.device_handle, &handle_info) != HND_DEVICE ||
+        !(service = FindServiceId(handle_info->serviceTable, input.servId, input.UDN)) ||
+        !(sub = GetSubscriptionSID(input.sid, service))) {
+        return;
+    }
+    if (!sub->outgoing.empty() && sub->outgoing.front().get() == &input) {
+        UpnpPrintf(UPNP_ERROR, GENA, __FILE__, __LINE__,
+                   "genaNotifyUnwind: could not queue job, dropping %d events for %s\n",
+                   static_cast<int>(sub->outgoing.size()), input.sid.c_str());
+        sub->outgoing.clear();
+    }
+}
 
-        if (!(service = FindServiceId(handle_info->serviceTable, m_input->servId, m_input->UDN)) ||
-            !service->active ||
-            !(sub = GetSubscriptionSID(m_input->sid, service)) ||
-            copy_subscription(sub, &sub_copy) != UPNP_E_SUCCESS) {
-            return;
-        }
+/* Validate the context of a notification and copy its subscription, so that the lock can be
+ * released during the actual network transfer. Returns false if the subscription is gone. */
+static bool genaNotifyCheck(const Notification& input, subscription *sub_copy)
+{
+    subscription *sub;
+    service_info *service;
+    struct Handle_Info *handle_info;
+
+    HANDLELOCK();
+    if (GetHandleInfo(input.device_handle, &handle_info) != HND_DEVICE) {
+        return false;
     }
+    return (service = FindServiceId(handle_info->serviceTable, input.servId, input.UDN)) &&
+        service->active &&
+        (sub = GetSubscriptionSID(input.sid, service)) &&
+        copy_subscription(sub, sub_copy) == UPNP_E_SUCCESS;
+}
 
-    /* send the notify */
-    return_code = genaNotify(m_input->propertySet, &sub_copy);
+/* Update the subscription after a notification was sent (successfully or not): increment the
+ * event key and remove the notification from the head of the outgoing queue.
+ *
+ * \return the next notification to send for the subscription, if any. Its job can be queued
+ *   without holding the handle lock because it stays at the head of the outgoing queue until
+ *   sent. *expireTime is set to the subscription expiration time. */
+static std::shared_ptr<Notification> genaNotifyNext(
+    const Notification& input, int return_code, time_t *expireTime)
+{
+    subscription *sub;
+    service_info *service;
+    struct Handle_Info *handle_info;
+    std::shared_ptr<Notification> next;
 
     HANDLELOCK();
-    if (GetHandleInfo(m_input->device_handle, &handle_info) != HND_DEVICE) {
-        return;
+    if (GetHandleInfo(input.device_handle, &handle_info) != HND_DEVICE) {
+        return next;
     }
     /* validate context */
-    if (!(service = FindServiceId(handle_info->serviceTable, m_input->servId, m_input->UDN)) ||
+    if (!(service = FindServiceId(handle_info->serviceTable, input.servId, input.UDN)) ||
         !service->active ||
-        !(sub = GetSubscriptionSID(m_input->sid, service))) {
-        return;
+        !(sub = GetSubscriptionSID(input.sid, service))) {
+        return next;
     }
     sub->ToSendEventKey++;
     if (sub->ToSendEventKey < 0)
@@ -271,9 +449,8 @@ void GenaNotifyJobWorker::work()
     }
     /* Possibly activate next */
     if (!sub->outgoing.empty()) {
-        auto notif = sub->outgoing.begin();
-        auto worker = std::make_unique<GenaNotifyJobWorker>(*notif);
-        gSendThreadPool.addJob(std::move(worker));
+        next = sub->outgoing.front();
+        *expireTime = sub->expireTime;
     }
 
     // No idea why we do this after sending one more event. Was the
@@ -282,7 +459,170 @@ void GenaNotifyJobWorker::work()
     // the first Notif then, because it's the only case where it's not
     // managed by a ThreadPool Job (potentially creating a mem leak).
     if (return_code == GENA_E_NOTIFY_UNACCEPTED_REMOVE_SUB)
-        RemoveSubscriptionSID(m_input->sid, service);
+        RemoveSubscriptionSID(input.sid, service);
+    return next;
+}
+
+/*!
+ * \brief Notify a control point.
+ *
+ * The network transfer is done by genaNotify(), without holding the handle lock.
+ *
+ * \return the next notification to send for the subscription, if any (see genaNotifyNext()).
+ */
+static std::shared_ptr<Notification> genaNotifyOne(
+    const std::shared_ptr<Notification>& input, time_t *expireTime)
+{
+    subscription sub_copy;
+    if (!genaNotifyCheck(*input, &sub_copy)) {
+        return nullptr;
+    }
+
+    /* send the notify */
+    int return_code = genaNotify(input->propertySet, &sub_copy);
+
+    return genaNotifyNext(*input, return_code, expireTime);
+}
+
+/* Asynchronous delivery (UPNP_FLAG_ASYNC_EVENTS). The NOTIFY transfers for all the subscriptions
+ * run on a single curl multi loop, created on first use, instead of each holding a thread pool
+ * worker until the subscriber answers or the transfer times out. The ordering and the SEQ
+ * numbering are the same as for the synchronous path: there is at most one transfer in progress
+ * for a subscription, the next one is started when it completes. */
+static std::mutex gNotifyLoopMutex;
+static CurlMultiLoop *gNotifyLoop;
+
+/* State of a NOTIFY transfer, owned by the loop callback. */
+struct NotifyTransfer {
+    NotifyTransfer() = default;
+    ~NotifyTransfer() {
+        if (nullptr != headers)
+            curl_slist_free_all(headers);
+        if (nullptr != easy)
+            curl_easy_cleanup(easy);
+    }
+    NotifyTransfer(const NotifyTransfer&) = delete;
+    NotifyTransfer& operator=(const NotifyTransfer&) = delete;
+    std::shared_ptr<Notification> input;
+    subscription sub;
+    // Current index in sub.DeliveryURLs
+    size_t urlidx{0};
+    CURL *easy{nullptr};
+    struct curl_slist *headers{nullptr};
+    char errorbuffer[CURL_ERROR_SIZE];
+};
+
+static void genaNotifyAsync(std::shared_ptr<Notification> input);
+
+/* Done with a notification: update the subscription and start the next one. */
+static void genaNotifyAsyncEnd(const NotifyTransfer& tr, int return_code)
+{
+    time_t expireTime;
+    auto next = genaNotifyNext(*tr.input, return_code, &expireTime);
+    if (next) {
+        genaNotifyAsync(std::move(next));
+    }
+}
+
+/* Start the transfer to the current delivery URL. */
+static void genaNotifyAsyncSend(std::shared_ptr<NotifyTransfer> tr);
+
+/* Loop callback for a completed transfer. This runs in the loop thread, which may wait a little
+ * for the handle lock, but does not depend on the thread pool having room for a job. */
+static void genaNotifyAsyncComplete(std::shared_ptr<NotifyTransfer> tr, CURLcode code)
+{
+    long http_code = 0;
+    curl_slist_free_all(tr->headers);
+    tr->headers = nullptr;
+    int return_code = genaNotifyDone(tr->easy, code, tr->sub.conn.get(), &http_code,
+                                     tr->errorbuffer);
+    tr->easy = nullptr;
+    if (return_code == UPNP_E_SUCCESS) {
+        genaNotifyAsyncEnd(*tr, genaNotifyStatus(http_code));
+    } else if (code != CURLE_ABORTED_BY_CALLBACK) {
+        /* try the next url. Aborted means that the loop is shutting down. */
+        tr->urlidx++;
+        genaNotifyAsyncSend(std::move(tr));
+    }
+}
+
+static void genaNotifyAsyncSend(std::shared_ptr<NotifyTransfer> tr)
+{
+    if (tr->urlidx >= tr->sub.DeliveryURLs.size()) {
+        genaNotifyAsyncEnd(*tr, UPNP_E_BAD_RESPONSE);
+        return;
+    }
+    tr->easy = genaGetHandle(tr->sub.conn.get());
+    if (nullptr == tr->easy) {
+        genaNotifyAsyncEnd(*tr, UPNP_E_OUTOF_MEMORY);
+        return;
+    }
+    tr->headers = genaSetupNotify(tr->easy, tr->input->propertySet, &tr->sub,
+                                  tr->sub.DeliveryURLs[tr->urlidx], tr->errorbuffer);
+    {
+        std::scoped_lock lck(gNotifyLoopMutex);
+        if (nullptr == gNotifyLoop) {
+            gNotifyLoop = new CurlMultiLoop(&gSendThreadPool);
+        }
+        CURL *easy = tr->easy;
+        if (gNotifyLoop->add(easy, [tr](CURLcode code) { genaNotifyAsyncComplete(tr, code); })) {
+            return;
+        }
+    }
+    // The loop is not running: it could not get a thread from the pool (EMAXTHREADS), or the
+    // library is shutting down. Send the event from a regular job instead. The loop is not
+    // deleted here, we may be running in its thread.
+    UpnpPrintf(UPNP_ERROR, GENA, __FILE__, __LINE__,
+               "genaNotifyAsyncSend: transfer loop not running, sending synchronously\n");
+    if (tr->sub.conn) {
+        // Give the handle back for the job, keeping its connection
+        curl_slist_free_all(tr->headers);
+        tr->headers = nullptr;
+        curl_easy_reset(tr->easy);
+        tr->sub.conn->easy = tr->easy;
+        tr->easy = nullptr;
+    }
+    if (queueNotifyJob(tr->sub.expireTime, tr->input, true) != 0) {
+        genaNotifyUnwind(*tr->input);
+    }
+}
+
+static void genaNotifyAsync(std::shared_ptr<Notification> input)
+{
+    auto tr = std::make_shared<NotifyTransfer>();
+    tr->input = std::move(input);
+    if (!genaNotifyCheck(*tr->input, &tr->sub)) {
+        return;
+    }
+    genaNotifyAsyncSend(std::move(tr));
+}
+
+void genaNotifyShutdown()
+{
+    CurlMultiLoop *loop;
+    {
+        std::scoped_lock lck(gNotifyLoopMutex);
+        loop = gNotifyLoop;
+        gNotifyLoop = nullptr;
+    }
+    // Deleting the loop calls the completion callbacks: don't hold the lock.
+    delete loop;
+}
+
+/*!
+ * \brief Thread job to Notify a control point.
+ */
+void GenaNotifyJobWorker::work()
+{
+    if ((g_optionFlags & UPNP_FLAG_ASYNC_EVENTS) && !m_sync) {
+        genaNotifyAsync(std::move(m_input));
+        return;
+    }
+    time_t expireTime;
+    auto next = genaNotifyOne(m_input, &expireTime);
+    if (next && queueNotifyJob(expireTime, next) != 0) {
+        genaNotifyUnwind(*next);
+    }
 }
 
 
@@ -329,10 +669,7 @@ int genaInitNotifyXML(
     /* schedule thread for initial notification */
     thread_struct = std::make_shared<Notification>(
         servId, UDN, propertySet, sid, time(nullptr), device_handle);
-    {
-        auto worker = std::make_unique<GenaNotifyJobWorker>(thread_struct);
-        ret = gSendThreadPool.addJob(std::move(worker));
-    }
+    ret = queueNotifyJob(sub->expireTime, thread_struct);
     if (ret != 0) {
         line = __LINE__;
         ret = UPNP_E_OUTOF_MEMORY;
@@ -418,46 +755,68 @@ int genaNotifyAllXML(
     std::shared_ptr<Notification> thread_struct;
     service_info *service = nullptr;
     struct Handle_Info *handle_info;
+    // The jobs are queued after releasing the handle lock, so that we don't take the pool mutex
+    // once per subscriber while holding it. This is safe: the head of each outgoing queue stays
+    // in place until its job runs, so no other job can be started for the subscription in the
+    // meantime, and the job revalidates the subscription before doing anything.
+    ThreadPool::JobBatch batch;
+    // The notifications for the batch jobs, in the same order, to unwind the dropped ones.
+    std::vector<std::shared_ptr<Notification>> batched;
+    // With asynchronous delivery, we start the transfers directly instead.
+    bool async = (g_optionFlags & UPNP_FLAG_ASYNC_EVENTS) != 0;
+    std::vector<std::shared_ptr<Notification>> starts;
 
     UpnpPrintf(UPNP_DEBUG, GENA, __FILE__, __LINE__,
                "genaNotifyAllXML: props: %s\n", propertySet.c_str());
 
-    HANDLELOCK();
+    {
+        HANDLELOCK();
 
-    if (GetHandleInfo(device_handle, &handle_info) != HND_DEVICE) {
-        line = __LINE__;
-        ret = UPNP_E_INVALID_HANDLE;
-        goto ExitFunction;
-    }
+        if (GetHandleInfo(device_handle, &handle_info) != HND_DEVICE) {
+            line = __LINE__;
+            ret = UPNP_E_INVALID_HANDLE;
+            goto ExitFunction;
+        }
 
-    service = FindServiceId(handle_info->serviceTable, servId, UDN);
-    if (service == nullptr) {
-        line = __LINE__;
-        ret = UPNP_E_INVALID_SERVICE;
-        goto ExitFunction;
-    }
+        service = FindServiceId(handle_info->serviceTable, servId, UDN);
+        if (service == nullptr) {
+            line = __LINE__;
+            ret = UPNP_E_INVALID_SERVICE;
+            goto ExitFunction;
+        }
 
-    finger = GetFirstSubscription(service);
-    while (finger != service->subscriptionList.end()) {
-        thread_struct = std::make_shared<Notification>(
-            servId, UDN, propertySet, finger->sid, time(nullptr), device_handle);
-        maybeDiscardEvents(finger->outgoing);
-        finger->outgoing.push_back(thread_struct);
-
-        /* If there is only one element on the list (just added), kickstart the threadpool */
-        if (finger->outgoing.size() == 1) {
-            auto worker = std::make_unique<GenaNotifyJobWorker>(thread_struct);
-            ret = gSendThreadPool.addJob(std::move(worker));
-            if (ret != 0) {
-                line = __LINE__;
-                if (ret == EOUTOFMEM) {
-                    line = __LINE__;
-                    ret = UPNP_E_OUTOF_MEMORY;
+        finger = GetFirstSubscription(service);
+        while (finger != service->subscriptionList.end()) {
+            thread_struct = std::make_shared<Notification>(
+                servId, UDN, propertySet, finger->sid, time(nullptr), device_handle);
+            maybeDiscardEvents(finger->outgoing);
+            finger->outgoing.push_back(thread_struct);
+
+            /* If there is only one element on the list (just added), kickstart the threadpool */
+            if (finger->outgoing.size() == 1) {
+                if (async) {
+                    starts.push_back(thread_struct);
+                } else {
+                    addNotifyJob(batch, finger->expireTime, thread_struct);
+                    batched.push_back(thread_struct);
                 }
-                break;
             }
+            finger = GetNextSubscription(service, finger);
+        }
+    }
+    for (auto& notif : starts) {
+        genaNotifyAsync(std::move(notif));
+    }
+    line = __LINE__;
+    {
+        size_t accepted;
+        ret = gSendThreadPool.addJobs(batch, &accepted);
+        for (size_t i = accepted; i < batched.size(); i++) {
+            genaNotifyUnwind(*batched[i]);
         }
-        finger = GetNextSubscription(service, finger);
+    }
+    if (ret == EOUTOFMEM || ret == ETOOMANYJOBS) {
+        ret = UPNP_E_OUTOF_MEMORY;
     }
 
 ExitFunction:
@@ -728,6 +1087,7 @@ void gena_process_subscription_request(MHDTransaction *mhdt)
         }
 
         sub->DeliveryURLs = tmpUrls;
+        sub->conn = std::make_shared<GenaConnection>();
         /* set the timeout */
         if (!timeout_header_value(mhdt->headers, &time_out)) {
             time_out = GENA_DEFAULT_TIMEOUT;
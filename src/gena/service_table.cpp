@@ -44,7 +44,6 @@
 #include <iostream>
 
 #include "service_table.h"
-#include "uri.h"
 
 #ifdef INCLUDE_DEVICE_APIS
 
@@ -70,6 +69,7 @@ int copy_subscription(const subscription *in, subscription *out)
     out->expireTime = in->expireTime;
     out->active = in->active;
     out->DeliveryURLs = in->DeliveryURLs;
+    out->conn = in->conn;
     return UPNP_E_SUCCESS;
 }
 
@@ -185,92 +185,8 @@ service_info *FindServiceId(
     return nullptr;
 }
 
-/************************************************************************
- *    Function :    FindServiceEventURLPath
- *
- *    Parameters :
- *        service_table *table ;    service table
- *        char * eventURLPath ;    event URL path used to find a service 
- *                                from the table    
- *
- *    Description :    Traverses the service table and finds the node whose
- *        event URL Path matches a know value 
- *
- *    Return : service_info * - pointer to the service list node from the 
- *        service table whose event URL matches a known event URL;
- *
- *    Note :
- ************************************************************************/
-service_info *FindServiceEventURLPath(service_table& table, const std::string& eventURLPath)
-{
-    uri_type parsed_url_in;
-    if (parse_uri(eventURLPath, &parsed_url_in)
-        != UPNP_E_SUCCESS) {
-        return nullptr;
-    }
-
-    for (auto& entry : table) {
-        if (entry.eventURL.empty()) {
-            continue;
-        }
-        uri_type parsed_url;
-        if (parse_uri(entry.eventURL, &parsed_url) != UPNP_E_SUCCESS) {
-            continue;
-        }
-        if (parsed_url.path == parsed_url_in.path &&
-            parsed_url.query == parsed_url_in.query) {
-            return &entry;
-        }
-    }
-
-    return nullptr;
-}
 #endif /* EXCLUDE_GENA */
 
-/************************************************************************
- *    Function :    FindServiceControlURLPath
- *
- *    Parameters :
- *        service_table&  table ;    service table
- *        char * controlURLPath ;    control URL path used to find a service 
- *                                from the table    
- *
- *    Description :    Traverses the service table and finds the node whose
- *        control URL Path matches a know value 
- *
- *    Return : service_info * - pointer to the service list node from the 
- *        service table whose control URL Path matches a known value;
- *
- *    Note :
- ************************************************************************/
-#if EXCLUDE_SOAP == 0
-service_info *FindServiceControlURLPath(
-    service_table& table, const std::string& controlURLPath)
-{
-    uri_type parsed_url_in;
-    if (parse_uri(controlURLPath, &parsed_url_in)
-        != UPNP_E_SUCCESS) {
-        return nullptr;
-    }
-
-    for (auto& entry : table) {
-        if (entry.controlURL.empty()) {
-            continue;
-        }
-        uri_type parsed_url;
-        if ((parse_uri(entry.controlURL, &parsed_url) != UPNP_E_SUCCESS)) {
-            continue;
-        }
-        if (parsed_url.path == parsed_url_in.path &&
-            parsed_url.query == parsed_url_in.query) {
-            return &entry;
-        }
-    }
-
-    return nullptr;
-}
-#endif /* EXCLUDE_SOAP */
-
 /************************************************************************
  *    Function :    printService
  *
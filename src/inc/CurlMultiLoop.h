@@ -0,0 +1,98 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2026 J.F. Dockes
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef CURLMULTILOOP_H
+#define CURLMULTILOOP_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <curl/curl.h>
+
+#include "ThreadPool.h"
+
+/*!
+ * \brief HTTP transfers multiplexed on a single thread.
+ *
+ * The transfers are curl easy handles, configured by the caller, and run by a curl multi handle
+ * from a single thread (a persistent job in the thread pool passed to the constructor), so that
+ * many concurrent requests do not need as many blocked threads.
+ */
+class CurlMultiLoop {
+public:
+    explicit CurlMultiLoop(ThreadPool *tp, const ThreadSchedAttr *sched = nullptr);
+    ~CurlMultiLoop();
+
+    CurlMultiLoop(const CurlMultiLoop&) = delete;
+    CurlMultiLoop& operator=(const CurlMultiLoop&) = delete;
+
+    /*!
+     * \brief Start a transfer.
+     *
+     * The callback is called once, from the loop thread, with the transfer result. This is
+     * CURLE_ABORTED_BY_CALLBACK if the transfer was cancelled or the loop shut down. The easy
+     * handle then belongs to the caller again. The callback must not block: it will usually
+     * just queue a job. Timeouts are set on the easy handle as usual (CURLOPT_TIMEOUT_MS).
+     *
+     * \return A transfer identifier (never 0), or 0 if the loop is not running.
+     */
+    uint64_t add(CURL *easy, std::function<void(CURLcode)> callback);
+
+    /*!
+     * \brief Cancel a transfer. The callback will be called with CURLE_ABORTED_BY_CALLBACK,
+     * unless the transfer completed meanwhile.
+     *
+     * \return false if the transfer was not found (it is already complete).
+     */
+    bool cancel(uint64_t id);
+
+    /*!
+     * \brief Check that the loop thread is running. It is not if it could not get a thread from
+     * the pool, or after shutdown(), and add() then fails. A stopped loop is not restarted: the
+     * caller can create a new one.
+     */
+    bool running();
+
+    /*!
+     * \brief Stop the loop thread. The callbacks for the transfers in progress are called with
+     * CURLE_ABORTED_BY_CALLBACK.
+     * \return 0
+     */
+    int shutdown();
+
+    class Internal;
+private:
+    // Shared with the loop job, which may outlive this object (see CurlMultiLoop.cpp)
+    std::shared_ptr<Internal> m;
+};
+
+#endif /* CURLMULTILOOP_H */
@@ -0,0 +1,238 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2026 J.F. Dockes
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef POOLTASK_H
+#define POOLTASK_H
+
+/*!
+ * \file
+ *
+ * \brief Coroutine tasks running on a ThreadPool.
+ *
+ * A PoolTask is a C++20 coroutine whose steps run as jobs in a ThreadPool. Instead of chaining
+ * JobWorker objects which requeue each other, a multi-step operation can be written as straight
+ * code, giving up its thread while waiting:
+ *
+ *     PoolTask notifyAll(Data d) {
+ *         for (...) {
+ *             ... do one step ...
+ *             co_await resumeOn(pool);              // requeue, let other jobs run
+ *             co_await sleepFor(timer, 100ms);      // wait without holding a thread
+ *             int ev = co_await socketReady(watcher, pool, fd, SocketWatcher::READABLE, 5s);
+ *         }
+ *     }
+ *     notifyAll(data).start(pool);
+ *
+ * This is only available when the library is built as C++20 (the meson "coroutines" option),
+ * in which case NPUPNP_HAVE_COROUTINES is defined. All the rest of the library stays C++17.
+ *
+ * A task is owned by the job which is going to resume it. If this job is dropped (pool full or
+ * shut down, timer event removed), the coroutine frame is destroyed with it, so that no memory
+ * is leaked, but the coroutine code does not get to run anymore. Only the destructors of the
+ * frame local objects are called, so any cleanup which must happen in this case (e.g. undoing
+ * some queue state) should be done by a local RAII object.
+ */
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define NPUPNP_HAVE_COROUTINES 1
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#include "SocketWatcher.h"
+#include "ThreadPool.h"
+#include "TimerThread.h"
+
+/*! Job resuming a coroutine, or destroying it if it never gets to run. */
+class CoroutineJobWorker : public JobWorker {
+public:
+    explicit CoroutineJobWorker(std::coroutine_handle<> h)
+        : m_h(h) {}
+    ~CoroutineJobWorker() override {
+        if (m_h)
+            m_h.destroy();
+    }
+    CoroutineJobWorker(const CoroutineJobWorker&) = delete;
+    CoroutineJobWorker& operator=(const CoroutineJobWorker&) = delete;
+    void work() override {
+        std::exchange(m_h, {}).resume();
+    }
+private:
+    std::coroutine_handle<> m_h;
+};
+
+/*! Fire-and-forget coroutine task. The frame is freed when the coroutine returns. */
+class PoolTask {
+public:
+    struct promise_type {
+        PoolTask get_return_object() {
+            return PoolTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    PoolTask(PoolTask&& o) noexcept
+        : m_h(std::exchange(o.m_h, {})) {}
+    PoolTask& operator=(PoolTask&& o) noexcept {
+        if (this != &o) {
+            if (m_h)
+                m_h.destroy();
+            m_h = std::exchange(o.m_h, {});
+        }
+        return *this;
+    }
+    PoolTask(const PoolTask&) = delete;
+    PoolTask& operator=(const PoolTask&) = delete;
+    ~PoolTask() {
+        if (m_h)
+            m_h.destroy();
+    }
+
+    /*! Return a job running the task, e.g. for a ThreadPool::JobBatch. The task object is
+     *  empty after this. */
+    std::unique_ptr<JobWorker> asJob() {
+        return std::make_unique<CoroutineJobWorker>(std::exchange(m_h, {}));
+    }
+
+    /*! Queue the task first step in the pool. Same return values as ThreadPool::addJob() */
+    int start(ThreadPool& tp, ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY) {
+        return tp.addJob(asJob(), priority);
+    }
+
+private:
+    explicit PoolTask(std::coroutine_handle<promise_type> h)
+        : m_h(h) {}
+    std::coroutine_handle<promise_type> m_h;
+};
+
+// Note for the awaiters below: once the job is queued, the coroutine may be resumed (or
+// destroyed) by another thread before await_suspend() returns, so the awaiter object, which
+// lives in the coroutine frame, must not be accessed after queuing.
+
+/*! Awaitable: resume the coroutine as a new job in a pool. */
+struct PoolResumeAwaiter {
+    ThreadPool *tp;
+    ThreadPool::ThreadPriority priority;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        auto pool = tp;
+        pool->addJob(std::make_unique<CoroutineJobWorker>(h), priority);
+    }
+    void await_resume() const noexcept {}
+};
+
+/*! Awaitable: resume the coroutine as a new deadline job in a pool. */
+struct PoolDeadlineAwaiter {
+    ThreadPool *tp;
+    std::chrono::steady_clock::time_point deadline;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        auto pool = tp;
+        pool->addJob(std::make_unique<CoroutineJobWorker>(h), deadline);
+    }
+    void await_resume() const noexcept {}
+};
+
+/*! Awaitable: resume the coroutine after a delay. */
+struct TimerAwaiter {
+    TimerThread *timer;
+    std::chrono::milliseconds delay;
+    ThreadPool::ThreadPriority priority;
+    bool await_ready() const noexcept { return delay.count() <= 0; }
+    void await_suspend(std::coroutine_handle<> h) {
+        auto tt = timer;
+        tt->schedule(TimerThread::SHORT_TERM, delay, nullptr,
+                     std::make_unique<CoroutineJobWorker>(h), priority);
+    }
+    void await_resume() const noexcept {}
+};
+
+/*! Awaitable: resume the coroutine as a new job in a pool when a socket is ready. Yields the
+ *  SocketWatcher callback value: Events flags, 0 for a timeout, -1 for an error or if the
+ *  watcher is not running (the coroutine then goes on without suspending). */
+struct SocketAwaiter {
+    SocketWatcher *watcher;
+    ThreadPool *tp;
+    SOCKET fd;
+    int events;
+    std::chrono::milliseconds timeout;
+    ThreadPool::ThreadPriority priority;
+    int result{-1};
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) {
+        auto pool = tp;
+        auto prio = priority;
+        auto resultp = &result;
+        return watcher->watch(
+            fd, events, timeout, [h, pool, prio, resultp](int revents) {
+                *resultp = revents;
+                pool->addJob(std::make_unique<CoroutineJobWorker>(h), prio);
+            }) == 0;
+    }
+    int await_resume() const noexcept { return result; }
+};
+
+inline PoolResumeAwaiter resumeOn(
+    ThreadPool& tp, ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY)
+{
+    return {&tp, priority};
+}
+
+inline PoolDeadlineAwaiter resumeBefore(
+    ThreadPool& tp, std::chrono::steady_clock::time_point deadline)
+{
+    return {&tp, deadline};
+}
+
+inline TimerAwaiter sleepFor(
+    TimerThread& timer, std::chrono::milliseconds delay,
+    ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY)
+{
+    return {&timer, delay, priority};
+}
+
+inline SocketAwaiter socketReady(
+    SocketWatcher& watcher, ThreadPool& tp, SOCKET fd, int events,
+    std::chrono::milliseconds timeout,
+    ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY)
+{
+    return {&watcher, &tp, fd, events, timeout, priority};
+}
+
+#endif /* __cpp_impl_coroutine */
+
+#endif /* POOLTASK_H */
@@ -0,0 +1,83 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2026 J.F. Dockes
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef SOCKETWATCHER_H
+#define SOCKETWATCHER_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include "ThreadPool.h"
+#include "upnpinet.h"
+
+/*!
+ * \brief Socket readiness notifications.
+ *
+ * A single thread (a persistent job in the thread pool passed to the constructor) waits for
+ * events on all the registered sockets and calls the associated callbacks, so that code waiting
+ * for network input or output does not need to block a pool thread.
+ */
+class SocketWatcher {
+public:
+    /*! Event flags */
+    enum Events {READABLE = 1, WRITABLE = 2};
+
+    explicit SocketWatcher(ThreadPool *tp, const ThreadSchedAttr *sched = nullptr);
+    ~SocketWatcher();
+
+    SocketWatcher(const SocketWatcher&) = delete;
+    SocketWatcher& operator=(const SocketWatcher&) = delete;
+
+    /*!
+     * \brief Wait for a socket to become ready.
+     *
+     * The callback is called once, from the watcher thread, with the ready Events flags, or 0 if
+     * the timeout expired, or -1 on error or shutdown. It must not block: it will usually just
+     * queue a job. The socket must stay open until the callback is called.
+     *
+     * \return 0 on success, -1 if the watcher is not running.
+     */
+    int watch(SOCKET fd, int events, std::chrono::milliseconds timeout,
+              std::function<void(int)> callback);
+
+    /*!
+     * \brief Stop the watcher thread. Pending callbacks are called with a -1 value.
+     * \return 0
+     */
+    int shutdown();
+
+    class Internal;
+private:
+    std::shared_ptr<Internal> m;
+};
+
+#endif /* SOCKETWATCHER_H */
@@ -34,9 +34,13 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #ifdef __MINGW32__
 #include <sched.h>
@@ -47,11 +51,17 @@
 #define EOUTOFMEM -1
 #define EMAXTHREADS -2
 #define INVALID_POLICY -3
+#define ESHUTTINGDOWN -4
+#define ETOOMANYJOBS -5
 
 class JobWorker {
 public:
     virtual ~JobWorker() = default;
     virtual void work() = 0;
+    /*! Called by ThreadPool::shutdown(), from another thread, while work() is running. Jobs
+     *  which may run for a long time (e.g. persistent jobs) should make work() return as soon
+     *  as possible. Must not block or use the pool. */
+    virtual void cancel() {}
 
     JobWorker() = default;
     JobWorker(const JobWorker&) = delete;
@@ -62,6 +72,19 @@ public:
 #ifndef SCHED_OTHER
 #define SCHED_OTHER 0
 #endif
+
+/*! CPU placement and scheduling class for a set of threads. */
+struct ThreadSchedAttr {
+    /*! CPUs the threads may run on. Empty: use the affinity of the thread which started the
+     *  pool. Only supported on Linux, ignored elsewhere. */
+    std::vector<int> cpus;
+    /*! Scheduling policy (SCHED_OTHER, SCHED_FIFO, SCHED_RR...). -1: use the policy of the
+     *  thread which started the pool. Not supported on Windows. */
+    int policy{-1};
+    /*! Static priority, for the real-time policies. */
+    int priority{0};
+};
+
 struct ThreadPoolAttr {
     typedef int PolicyType;
     enum TPSpecialValues{INFINITE_THREADS = -1};
@@ -82,13 +105,83 @@ struct ThreadPoolAttr {
     /*! the time a low priority or med priority job waits before getting
      * bumped up a priority (in milliseconds). */
     int starvationTime{500};
-    /*! scheduling policy to use. */
+    /*! Unused, kept for compatibility. Use workerSched to set the scheduling policy. */
     PolicyType schedPolicy{SCHED_OTHER};
+    /*! Autoscaling target for the 95th percentile of the queue wait time, in microseconds. 0
+     * disables autoscaling. When set, the pool is grown when the measured value exceeds the
+     * target and shrunk (down to minThreads) when it is well below and threads are idle. */
+    int autoscaleTargetP95Us{0};
+    /*! Autoscaling evaluation interval (milliseconds). */
+    int autoscaleIntervalMs{1000};
+    /*! CPU affinity and scheduling class for the worker threads. Persistent jobs can have their
+     *  own, see addPersistent(). */
+    ThreadSchedAttr workerSched;
 };
 
 
-/*! Structure to hold statistics. */
-struct ThreadPoolStats {
+/*!
+ * \brief Log-scale latency histogram with microsecond resolution.
+ *
+ * Each power of two range is split into 2^SUBBITS linear sub-buckets (HDR-style), so that the
+ * relative error on a reported value is less than 1/2^SUBBITS. Values up to 2^MAXBITS
+ * microseconds are recorded, bigger ones are counted in the last bucket.
+ */
+struct LatencyHistogram {
+    static constexpr int SUBBITS = 3;
+    static constexpr int MAXBITS = 40;
+    static constexpr int NBUCKETS = (MAXBITS - SUBBITS + 1) << SUBBITS;
+
+    /*! Per-bucket sample counts. */
+    uint64_t counts[NBUCKETS]{};
+    /*! Total number of samples. */
+    uint64_t total{0};
+    /*! Sum of all samples (microseconds). */
+    uint64_t sumUs{0};
+    /*! Biggest sample seen (microseconds). */
+    uint64_t maxUs{0};
+
+    /*! Compute the bucket index for a value in microseconds. */
+    static int bucketIndex(uint64_t us);
+    /*! Compute the highest value stored in a given bucket. */
+    static uint64_t bucketUpperBound(int idx);
+    /*! Return the value (microseconds) below which pct percent of the samples fall. pct is in
+     * the [0,100] range. Returns 0 if the histogram is empty. */
+    uint64_t percentile(double pct) const;
+    /*! Average sample value, in microseconds. */
+    double meanUs() const {
+        return total ? static_cast<double>(sumUs) / static_cast<double>(total) : 0.0;
+    }
+};
+
+/*! Latency statistics for one kind of job (JobWorker subclass). */
+struct ThreadPoolJobTypeStats {
+    /*! Name of the JobWorker class (demangled if possible). */
+    std::string name;
+    /*! Time spent in the queue before being picked up by a worker thread. */
+    LatencyHistogram wait;
+    /*! Time spent executing the work() method. */
+    LatencyHistogram run;
+};
+
+/*! Job tracing event, see ThreadPool::setTraceHook() */
+struct ThreadPoolTraceEvent {
+    enum Type {ENQUEUE, START, END};
+    Type type;
+    /*! Name of the JobWorker class, or "persistent" for persistent jobs */
+    const std::string *jobType;
+    int jobId;
+    /*! Submission priority (ThreadPool::ThreadPriority). Deadline jobs are HIGH_PRIORITY */
+    int priority;
+    /*! Event time */
+    std::chrono::steady_clock::time_point time;
+    /*! Queue wait time (START and END), and execution time (END), microseconds */
+    uint64_t waitUs;
+    uint64_t runUs;
+};
+using ThreadPoolTraceHook = std::function<void(const ThreadPoolTraceEvent&)>;
+
+/*! Statistics counters, see ThreadPool::getCounters(). */
+struct ThreadPoolCounters {
     double totalTimeHQ{0};
     int totalJobsHQ{0};
     double avgWaitHQ{0};
@@ -108,6 +201,40 @@ struct ThreadPoolStats {
     int currentJobsHQ{0};
     int currentJobsLQ{0};
     int currentJobsMQ{0};
+    /*! Highest total number of queued jobs seen, and jobs refused because of maxJobsTotal. */
+    int maxQueuedJobs{0};
+    int droppedJobs{0};
+    /*! Autoscaling: number of evaluations which decided to grow or shrink the pool. */
+    int autoscaleGrowDecisions{0};
+    int autoscaleShrinkDecisions{0};
+    /*! Autoscaling: threads actually started and retired by the policy. */
+    int autoscaleThreadsAdded{0};
+    int autoscaleThreadsRetired{0};
+    /*! Autoscaling: p95 queue wait measured at the last evaluation (microseconds), and thread
+     *  count at this time. */
+    uint64_t autoscaleLastP95Us{0};
+    int autoscaleLastThreads{0};
+    /*! Deadline jobs: currently queued, total started, started after their deadline, and
+     *  discarded because they were late. */
+    int currentJobsDeadline{0};
+    int totalJobsDeadline{0};
+    int deadlineMissed{0};
+    int deadlineDiscarded{0};
+};
+
+/*! Statistics counters and latency histograms, see ThreadPool::getStats(). The histograms make
+ *  this big (about 17 KB), so it should be filled in place rather than copied. */
+struct ThreadPoolStats : ThreadPoolCounters {
+    /*! Queue wait time histograms, indexed by the job submission priority (LOW_PRIORITY,
+     *  MED_PRIORITY, HIGH_PRIORITY). The time spent in lower priority queues by bumped jobs is
+     *  included. */
+    LatencyHistogram waitHist[3];
+    /*! Execution time histograms, indexed by submission priority. */
+    LatencyHistogram runHist[3];
+    /*! Per job type breakdown. Persistent jobs are not included. */
+    std::vector<ThreadPoolJobTypeStats> jobTypes;
+    /*! Lateness of the deadline jobs which missed their deadline (microseconds). */
+    LatencyHistogram deadlineLateness;
 };
 
 /*!
@@ -130,29 +257,97 @@ public:
     enum ThreadPriority : uint16_t {LOW_PRIORITY, MED_PRIORITY, HIGH_PRIORITY};
 
     ThreadPool();
-    // See comments in undef'd out destructor in ThreadPool.cpp
+    // See comments in the destructor in ThreadPool.cpp
     ~ThreadPool();
 
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
-    /* Initialize things and start up returns 0 if ok */
+    /* Initialize things and start up returns 0 if ok. A pool which was shut down can be started
+     * again. */
     int start(const ThreadPoolAttr* attr = nullptr);
 
-    /* Add regular job. To be scheduled asap, we don't wait for it to start */
+    /* Add regular job. To be scheduled asap, we don't wait for it to start. Returns 0,
+     * ESHUTTINGDOWN if the pool was shut down, or ETOOMANYJOBS if the job was dropped because
+     * maxJobsTotal jobs are already queued. A job which is not queued is deleted. */
     int addJob(std::unique_ptr<JobWorker> worker, ThreadPriority priority = MED_PRIORITY);
 
+    /*!
+     * \brief Adds a job which should be started before a deadline.
+     *
+     * Deadline jobs are kept in a separate queue, and picked up in earliest deadline first
+     * order. They are served before the medium and low priority jobs, and also before the high
+     * priority ones when their deadline is less than starvationTime away.
+     *
+     * A job which is started after its deadline is counted in the deadlineMissed statistic. If
+     * discardLate is set, such a job is deleted without running.
+     *
+     * \return 0, ESHUTTINGDOWN or ETOOMANYJOBS, as for the regular addJob().
+     */
+    int addJob(std::unique_ptr<JobWorker> worker, std::chrono::steady_clock::time_point deadline,
+               bool discardLate = false);
+
+    /*! A set of jobs to be queued together by addJobs() */
+    class JobBatch {
+    public:
+        void add(std::unique_ptr<JobWorker> worker, ThreadPriority priority = MED_PRIORITY) {
+            entries.push_back({std::move(worker), priority, false, {}, false});
+        }
+        void add(std::unique_ptr<JobWorker> worker, std::chrono::steady_clock::time_point deadline,
+                 bool discardLate = false) {
+            entries.push_back({std::move(worker), HIGH_PRIORITY, true, deadline, discardLate});
+        }
+        size_t size() const {
+            return entries.size();
+        }
+        bool empty() const {
+            return entries.empty();
+        }
+    private:
+        friend class ThreadPool;
+        struct Entry {
+            std::unique_ptr<JobWorker> worker;
+            ThreadPriority priority;
+            bool hasDeadline;
+            std::chrono::steady_clock::time_point deadline;
+            bool discardLate;
+        };
+        std::vector<Entry> entries;
+    };
+
+    /*!
+     * \brief Adds a set of jobs with a single lock acquisition, and wakes up as many idle threads
+     * as needed. This is equivalent to calling addJob() for each entry, but cheaper for fan-out
+     * operations. The batch is emptied.
+     *
+     * The jobs are queued in the order they were added to the batch. Jobs which would go over
+     * the maxJobsTotal limit are dropped, as with addJob(): they are the last ones in the batch,
+     * and they are deleted after the pool lock is released.
+     *
+     * \param batch the jobs.
+     * \param[out] accepted if not null, set to the number of jobs which were queued (the first
+     *   *accepted entries of the batch).
+     * \return 0 if all the jobs were queued, ESHUTTINGDOWN if the pool was shut down (no job
+     *   queued), or ETOOMANYJOBS if some jobs were dropped.
+     */
+    int addJobs(JobBatch& batch, size_t *accepted = nullptr);
+
     /*!
      * \brief Adds a persistent job to the thread pool.
      * Job will be run as soon as possible. Call will block until job
      * is scheduled.
      *
+     * If sched is set, the thread running the job is moved to the specified CPUs and
+     * scheduling class for the duration of the job.
+     *
      * \return
      *    \li \c 0 on success.
      *    \li \c EOUTOFMEM not enough memory to add job.
      *    \li \c EMAXTHREADS not enough threads to add persistent job.
+     *    \li \c ESHUTTINGDOWN the pool was shut down.
      */
-    int addPersistent(std::unique_ptr<JobWorker> worker, ThreadPriority priority = MED_PRIORITY);
+    int addPersistent(std::unique_ptr<JobWorker> worker, ThreadPriority priority = MED_PRIORITY,
+                      const ThreadSchedAttr *sched = nullptr);
 
     /*!
      * \brief Gets the current set of attributes associated with the
@@ -175,18 +370,39 @@ public:
 
     /*!
      * \brief Shuts the thread pool down. Waits for all threads to finish.
-     * May block indefinitely if jobs do not exit.
+     *
+     * Queued jobs are deleted without running (outside of the pool lock, so that their
+     * destructors may use the pool), running jobs are asked to return through JobWorker::cancel(),
+     * then all the threads are joined. This may block if jobs do not exit. Jobs added after
+     * this are refused with ESHUTTINGDOWN. Must not be called from a job running in the pool.
      *
      * \return 0 on success, nonzero on failure
      */
     int shutdown();
 
     /*!
-     * \brief Returns various statistics about the thread pool.
+     * \brief Returns various statistics about the thread pool, with the latency histograms.
      *
-     * \return Always returns 0.
+     * \return 0, or EINVAL if stats is null.
      */
     int getStats(ThreadPoolStats *stats);
+
+    /*!
+     * \brief Returns the statistics counters only, without copying the histograms.
+     *
+     * \return 0, or EINVAL if counters is null.
+     */
+    int getCounters(ThreadPoolCounters *counters);
+
+    /*!
+     * \brief Sets a function to be called when a job is queued, started, and finished. An
+     * empty function disables tracing.
+     *
+     * The hook is called from the thread adding the job (ENQUEUE) or running it (START, END),
+     * without holding the pool lock. It should be quick. It may still be called by jobs in
+     * progress after being reset.
+     */
+    void setTraceHook(ThreadPoolTraceHook hook);
     void printStats(ThreadPoolStats *stats);
 
     class Internal;
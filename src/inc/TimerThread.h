@@ -51,7 +51,9 @@ struct TimerEvent;
  */
 class TimerThread {
 public:
-    explicit TimerThread(ThreadPool *tp);
+    /*! The timer runs as a persistent job in tp. If sched is set, it defines the CPU affinity and
+     * scheduling class of the timer thread. */
+    explicit TimerThread(ThreadPool *tp, const ThreadSchedAttr *sched = nullptr);
     ~TimerThread();
 
     TimerThread(const TimerThread&) = delete;
@@ -73,6 +75,8 @@ public:
     /*!
      * \brief Schedules an event to run at a specified time.
      *
+     * The job is queued in the timer thread pool, or in the target one if it is set.
+     *
      * \return 0 on success, nonzero on failure, EOUTOFMEM if not enough memory
      *    to schedule job.
      */
@@ -88,13 +92,15 @@ public:
         /* [out] Id of timer event. (can be null). */
         int *id,
         std::unique_ptr<JobWorker> worker,
-        ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY);
+        ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY,
+        ThreadPool *target = nullptr);
 
     int schedule(Duration persistence, std::chrono::system_clock::time_point when,
         /* [out] Id of timer event. (can be null). */
         int *id,
         std::unique_ptr<JobWorker> worker,
-        ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY);
+        ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY,
+        ThreadPool *target = nullptr);
 
     int schedule(Duration persistence, std::chrono::milliseconds delay,
         /* [out] Id of timer event. (can be null). */
@@ -102,6 +108,16 @@ public:
         std::unique_ptr<JobWorker> worker,
         ThreadPool::ThreadPriority priority = ThreadPool::MED_PRIORITY);
 
+    /*!
+     * \brief Schedules a short term event to be queued after a delay as a deadline job (see
+     * ThreadPool::addJob()).
+     */
+    int schedule(std::chrono::milliseconds delay,
+        std::chrono::steady_clock::time_point deadline,
+        /* [out] Id of timer event. (can be null). */
+        int *id,
+        std::unique_ptr<JobWorker> worker);
+
     /*!
      * \brief Removes an event from the timer Q.
      *
@@ -125,7 +141,8 @@ public:
 
     class Internal;
 private:
-    std::unique_ptr<Internal> m;
+    // Shared with the timer job, which may outlive this object (see TimerThread.cpp)
+    std::shared_ptr<Internal> m;
 };
 
 #endif /* TIMERTHREAD_H */
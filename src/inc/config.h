@@ -150,6 +150,25 @@ typedef intptr_t ssize_t;
 /* @} */
 
 
+/*!
+ * \name HTTP_SERVER_THREADS
+ *
+ * The {\tt HTTP_SERVER_THREADS} constant defines the number of threads
+ * serving the HTTP requests (description documents, SOAP actions, GENA
+ * subscriptions, web server files). Each thread handles many connections.
+ * A synchronous action callback, or a slow web server read callback,
+ * holds up the other connections of its thread while it runs: slow actions
+ * should use UpnpDeferAction(), which suspends the connection and frees
+ * the thread. This is not used with libmicrohttpd versions older than
+ * 0.9.53, which cannot suspend connections: each connection then has its
+ * own thread. The default value is 8.
+ *
+ * @{
+ */
+#define HTTP_SERVER_THREADS 8
+/* @} */
+
+
 /*! \name MAX_JOBS_TOTAL
  *
  *  The {\tt MAX_JOBS_TOTAL} constant determines the maximum number of jobs
@@ -195,14 +214,15 @@ typedef intptr_t ssize_t;
 /*!
  * \name DEFAULT_SOAP_CONTENT_LENGTH
  *
- * SOAP messages will read at most {\tt DEFAULT_SOAP_CONTENT_LENGTH} bytes.  
- * This prevents devices that have a misbehaving web server to send 
- * a large amount of data to the control point causing it to crash.  
+ * The device side will accept SOAP requests of at most
+ * {\tt DEFAULT_SOAP_CONTENT_LENGTH} bytes. This prevents a misbehaving
+ * control point from making the device use a large amount of memory, while
+ * leaving room for big arguments such as playlist metadata.
  * This can be adjusted dynamically with {\tt UpnpSetMaxContentLength}.
  *
  * @{
  */
-#define DEFAULT_SOAP_CONTENT_LENGTH 16000
+#define DEFAULT_SOAP_CONTENT_LENGTH (1024 * 1024)
 /* @} */
 
 
@@ -350,6 +370,32 @@ typedef intptr_t ssize_t;
 /* @} */
 
 
+/*!
+ * \name HTTP_CLIENT_MAX_IDLE_PER_HOST
+ *
+ * The {\tt HTTP_CLIENT_MAX_IDLE_PER_HOST} specifies how many idle HTTP client
+ * handles, each holding an open connection, are kept for a given host after
+ * a SOAP action, so that the next actions to the host can reuse them.
+ * 0 disables the cache.
+ *
+ * @{
+ */
+#define HTTP_CLIENT_MAX_IDLE_PER_HOST 4
+/* @} */
+
+
+/*!
+ * \name HTTP_CLIENT_IDLE_TIMEOUT
+ *
+ * The {\tt HTTP_CLIENT_IDLE_TIMEOUT} specifies the number of seconds after
+ * which an idle HTTP client handle and its connection are closed.
+ *
+ * @{
+ */
+#define HTTP_CLIENT_IDLE_TIMEOUT 30
+/* @} */
+
+
    
 /*!
  * \name Other debugging features
@@ -109,6 +109,24 @@ public:
         return false;
     }
 
+    /*
+      Push interface: feed the XML source piece by piece as it becomes
+      available, instead of having Parse() pull it through read_block().
+      Set isfinal for the last piece (which may be empty). Returns false
+      on error, after which the parser must not be fed any more.
+    */
+    virtual bool ParseChunk(const char *data, size_t len, bool isfinal) {
+        if(!Ready() || getStatus() != XML_STATUS_OK)
+            return false;
+        XML_Status local_status =
+            XML_Parse(expat_parser, data, int(len), isfinal ? XML_TRUE : XML_FALSE);
+        if(local_status != XML_STATUS_OK) {
+            set_status(local_status);
+            return false;
+        }
+        return true;
+    }
+
     /* Expose status, error, and control codes to users */
     virtual bool Ready(void) const {
         return valid_parser;
@@ -107,6 +107,17 @@ int genaInitNotifyVars(
     /*! [in] Subscription ID. */
     const Upnp_SID& sid);
 
+/*!
+ * \brief Copy the event delivery counters.
+ */
+void genaGetDeliveryStats(struct UpnpEventDeliveryStats *stats);
+
+/*!
+ * \brief Stop the asynchronous event delivery loop, if it was started
+ * (UPNP_FLAG_ASYNC_EVENTS). The transfers in progress are aborted.
+ */
+void genaNotifyShutdown();
+
 #endif /* INCLUDE_DEVICE_APIS */
 
 
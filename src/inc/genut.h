@@ -59,15 +59,33 @@ inline int posix_strerror_r(int err, char *buf, size_t len) {
 
 #ifdef __cplusplus
 
+#include <initializer_list>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 inline size_t upnp_strlcpy(char *dst, const std::string& src, size_t dsize) {
     return upnp_strlcpy(dst, src.c_str(), dsize);
 }
 
 std::string xmlQuote(const std::string& in);
+/* Append the quoted value to out */
+void xmlQuoteAppend(std::string& out, std::string_view in);
+/* Size of the quoted value, for reserving the output space */
+size_t xmlQuotedSize(std::string_view in);
+
+/* Build a SOAP message holding one action (or response) element with its
+   arguments in a single pass: the final size is computed first, the buffer
+   is allocated once, and the values are escaped directly into it. The
+   element is named u:<actname><namesuffix>. The prolog pieces (envelope
+   start, optional header, body start) and the epilog are copied as-is. */
+void soapBuildMessage(
+    std::string& out, std::initializer_list<std::string_view> prolog,
+    std::string_view actname, std::string_view namesuffix, std::string_view servicetype,
+    const std::vector<std::pair<std::string, std::string>>& args, std::string_view epilog);
 
 /* Compare element names, ignoring namespaces */
-int dom_cmp_name(const std::string& domname, const std::string& ref);
+int dom_cmp_name(std::string_view domname, std::string_view ref);
 
 #endif /* __cplusplus */
 
@@ -33,11 +33,17 @@
 #ifndef _HTTPUTILS_H_
 #define _HTTPUTILS_H_
 
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <ctime>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 
+#include <curl/curl.h>
 #include <microhttpd.h>
 
 struct uri_type;
@@ -69,6 +75,31 @@ int httpheader_str2int(const std::string& headername);
 
 std::string query_encode(const std::string& qs);
 
+struct MHDTransaction;
+
+/* State shared between a suspended connection and the code which will
+   produce its response later. See miniServerDefer() */
+struct MHDDeferredResponse {
+    std::mutex mutex;
+    /* Reset when the connection goes away */
+    MHDTransaction *mhdt{nullptr};
+    bool suspended{false};
+    bool done{false};
+    /* Signalled when done is set, for libmicrohttpd versions which can't
+       suspend connections */
+    std::condition_variable cv;
+};
+
+/* Consumer for a request body, set up by a module to process the body while
+   it arrives instead of having it accumulated in postdata. See
+   SetSoapBodyCallback() */
+class MHDBodyConsumer {
+public:
+    virtual ~MHDBodyConsumer() = default;
+    /* Called with each piece of the body, in order */
+    virtual void data(const char *buf, size_t len) = 0;
+};
+
 /* Context for a microhttpd request/response */
 struct MHDTransaction {
 public:
@@ -80,9 +111,17 @@ public:
     std::map<std::string, std::string> headers;
     std::map<std::string, std::string> queryvalues;
     std::string postdata;
+    /* If set, the body went there instead of postdata */
+    std::unique_ptr<MHDBodyConsumer> bodyconsumer;
+    /* Body size received so far */
+    size_t bodysize{0};
+    /* The body exceeded the maximum size: the rest is dropped and the request refused */
+    bool bodytoolarge{false};
     /* Set by callback */
     struct MHD_Response *response{nullptr};
     int httpstatus;
+    /* Set by the callback instead of response if the answer comes later */
+    std::shared_ptr<MHDDeferredResponse> deferred;
 
     void copyClientAddress(struct sockaddr_storage *dest) const;
     void copyToClientAddress(const struct sockaddr *src);
@@ -154,10 +193,59 @@ size_t write_callback_null_curl(char *buf, size_t size, size_t nitems, std::stri
 /* CURL: callback to accumulate data in an std::string */
 size_t write_callback_str_curl(char *buf, size_t sz, size_t nits, std::string *s);
 
+/* CURL: get an easy handle for a request to hostport (as in uri_type
+   hostport.text). This is an idle handle from a previous request to the same
+   host if one is available, so that its open connection can be reused. */
+CURL *http_get_curl_handle(const std::string& hostport);
+
+/* CURL: return a handle obtained from http_get_curl_handle(). If reusable
+   is false (e.g. after a transfer error), or the host already has enough
+   idle handles, the handle is destroyed, else it is kept for reuse. */
+void http_release_curl_handle(const std::string& hostport, CURL *easy, bool reusable);
+
+/* CURL: set the idle handles cache parameters. maxperhost 0 disables the cache. */
+void http_set_curl_cache(int maxperhost, int idletimeoutsecs);
+
+/* CURL: destroy all the idle handles */
+void http_clear_curl_handles();
+
 /* Generate and send a status response message (response with status +
    bit of explanatory HTML) */
 int http_SendStatusResponse(MHDTransaction *mhdt, int http_status_code);
 
+/* Content codings which we may apply to a response body */
+enum class HttpContentCoding {IDENTITY, GZIP, DEFLATE};
+
+/* Enable or disable response compression. Bodies smaller than minsize
+   are always sent as is. Returns false if zlib support is not compiled in. */
+bool http_set_compression(bool enable, size_t minsize);
+
+/* Check if a response body of the given size (MHD_SIZE_UNKNOWN for a
+   streamed one) may be compressed, depending on the request. Such a response
+   needs a "Vary: Accept-Encoding" header, even when sent as is. */
+bool http_compression_possible(uint64_t datasize);
+
+/* Choose the coding for a response body of the given size (MHD_SIZE_UNKNOWN
+   for a streamed one), from the request accept-encoding header. */
+HttpContentCoding http_choose_coding(const MHDTransaction *mhdt, uint64_t datasize);
+
+/* Content-Encoding header value for coding */
+const char *http_coding_name(HttpContentCoding coding);
+
+/* Compress data with the given coding. Returns false on error */
+bool http_compress(std::string_view data, HttpContentCoding coding, std::string& out);
+
+/* Create a response from memory data, compressing it if the client accepts
+   this. Sets the Content-Encoding and Vary headers as needed. */
+struct MHD_Response *http_create_data_response(MHDTransaction *mhdt, std::string_view data);
+
+/* Create a response from a content reader callback, compressing its output on
+   the fly if the client accepts this. Sets the Content-Encoding and Vary
+   headers as needed. */
+struct MHD_Response *http_create_callback_response(
+    MHDTransaction *mhdt, size_t blocksize, MHD_ContentReaderCallback crc,
+    void *crc_cls, MHD_ContentReaderFreeCallback crfc);
+
 /* Check presence and text/xml value of content-type header */
 bool has_xml_content_type(MHDTransaction *);
 
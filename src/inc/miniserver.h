@@ -35,6 +35,8 @@
 #include "config.h"
 
 #include <cstdint>
+#include <functional>
+#include <memory>
 
 #include "httputils.h"
 #include "upnpinet.h"
@@ -113,6 +115,22 @@ void SetSoapCallback(
 static inline void SetSoapCallback(MiniServerCallback callback) {}
 #endif /* INCLUDE_DEVICE_APIS */
 
+/*!
+ * \brief Set the SOAP body callback.
+ *
+ * Called with the request headers when the body of a SOAP request starts
+ * arriving. It can return a consumer which will get the body pieces as they
+ * arrive, instead of having them accumulated in postdata.
+ */
+typedef std::unique_ptr<MHDBodyConsumer> (*MiniServerBodyCallback) (MHDTransaction*);
+#ifdef INCLUDE_DEVICE_APIS
+void SetSoapBodyCallback(
+    /*! [in] SOAP body Callback to be invoked . */
+    MiniServerBodyCallback callback);
+#else /* INCLUDE_DEVICE_APIS */
+static inline void SetSoapBodyCallback(MiniServerBodyCallback callback) {}
+#endif /* INCLUDE_DEVICE_APIS */
+
 /*!
  * \brief Set GENA Callback.
  */
@@ -120,6 +138,28 @@ void SetGenaCallback(
     /*! [in] GENA Callback to be invoked. */
     MiniServerCallback callback);
 
+/*!
+ * \brief Defer the response for a request.
+ *
+ * Called by a miniserver callback instead of setting the response. The
+ * connection is suspended when the callback returns, until
+ * miniServerCompleteDeferred() is called, possibly from another thread.
+ */
+std::shared_ptr<MHDDeferredResponse> miniServerDefer(MHDTransaction *mhdt);
+
+/*!
+ * \brief Produce the response for a deferred request and resume the connection.
+ *
+ * \return false if the connection went away or was already answered, in
+ * which case \b fill is not called.
+ */
+bool miniServerCompleteDeferred(
+    /*! [in] Value returned by miniServerDefer() */
+    const std::shared_ptr<MHDDeferredResponse>& deferred,
+    /*! [in] Sets the response and httpstatus fields of the transaction. Called
+     * with the deferred state locked. */
+    const std::function<void (MHDTransaction*)>& fill);
+
 /*!
  * \brief Initialize the sockets functionality for the Miniserver.
  *
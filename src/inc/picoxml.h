@@ -58,6 +58,7 @@
  */
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <sstream>
@@ -268,7 +269,7 @@ private:
             return true;
         }
         if (m_pos != spos) {
-            std::string data{unQuote(m_in.substr(spos, m_pos - spos))};
+            std::string data{unQuote(std::string_view(m_in).substr(spos, m_pos - spos))};
             if (m_unquoteError) {
                 return false;
             }
@@ -395,7 +396,7 @@ private:
                 m_reason << "Missing closing quote at cpos " << m_pos+spos;
                 return false;
             }
-            attrs[attrnm] = unQuote(tag.substr(spos, epos - spos));
+            attrs[attrnm] = unQuote(std::string_view(tag).substr(spos, epos - spos));
             if (m_unquoteError) {
                 return false;
             }
@@ -414,50 +415,45 @@ private:
         return true;
     }
 
-    std::string unQuote(const std::string &s) {
-        static const std::string e_quot{"quot"};
-        static const std::string e_amp{"amp"};
-        static const std::string e_apos{"apos"};
-        static const std::string e_lt{"lt"};
-        static const std::string e_gt{"gt"};
-
+    std::string unQuote(std::string_view s) {
         m_unquoteError = false;
+        // Most text has no entities: look for the '&' with find(), which is
+        // memchr() underneath, and copy the plain runs in bulk.
+        std::string_view::size_type amp = s.find('&');
+        if (amp == std::string_view::npos) {
+            return std::string(s);
+        }
         std::string out;
         out.reserve(s.size());
-        std::string::const_iterator it = s.begin();
-        auto epos = 0;
-        while (it != s.end()) {
-            if (*it != '&') {
-                out += *it++;
-                continue;
-            }
-            // Position: m_pos minus the string size (including 2 quotes) plus position inside s
-            epos = m_pos - (s.size() + 2) + it - s.begin();
-            ++it;
-            std::string code;
-            while (it != s.end() && *it != ';') {
-                code += *it++;
-            }
-            if (it == s.end()) {
-                // Unexpected
+        std::string_view::size_type pos = 0;
+        while (amp != std::string_view::npos) {
+            out.append(s.data() + pos, amp - pos);
+            auto semi = s.find(';', amp + 1);
+            if (semi == std::string_view::npos) {
+                // Unexpected. Position: m_pos minus the string size (including 2 quotes) plus
+                // position inside s
+                auto epos = m_pos - (s.size() + 2) + amp;
                 m_reason << "End of quoted string, inside entity name at cpos " << epos;
                 m_unquoteError = true;
                 out.clear();
-                break;
+                return out;
             }
-            ++it;
-            if (code == e_quot) {
+            auto code = s.substr(amp + 1, semi - amp - 1);
+            if (code == "quot") {
                 out += '"';
-            } else if (code == e_amp) {
+            } else if (code == "amp") {
                 out += '&';
-            } else if (code == e_apos) {
+            } else if (code == "apos") {
                 out += '\'';
-            } else if (code == e_lt) {
+            } else if (code == "lt") {
                 out += '<';
-            } else if (code == e_gt) {
+            } else if (code == "gt") {
                 out += '>';
             }
+            pos = semi + 1;
+            amp = s.find('&', pos);
         }
+        out.append(s.data() + pos, s.size() - pos);
         return out;
     }
 
@@ -0,0 +1,415 @@
+/* Copyright (C) 2016 J.F.Dockes
+ *
+ * PicoXMLViewParser is derived from PicoXMLParser (picoxml.h) and distributed under the
+ * same terms.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *     (1) Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer. 
+ * 
+ *     (2) Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.  
+ *     
+ *     (3)The name of the author may not be used to
+ *     endorse or promote products derived from this software without
+ *     specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.  
+ **********************************************************/
+
+#ifndef _PICOXMLVIEW_H_INCLUDED_
+#define _PICOXMLVIEW_H_INCLUDED_
+
+/**
+ * PicoXMLViewParser: same language and same Expat-compatible callbacks as PicoXMLParser (see
+ * picoxml.h), but working on views into the input instead of substring copies.
+ *
+ *  - Element names are copied once into buffers which are reused for each depth level, so that
+ *    the names passed to the callbacks are null-terminated. The m_path entries have a
+ *    std::string_view name.
+ *  - Character data is passed as a pointer into the input, except if it contains entities, in
+ *    which case it is decoded into a buffer which is also reused.
+ *  - Attributes are passed to startElement() as a vector of name/value views (document order,
+ *    no duplicate elimination). StartElement() gets a null attributes pointer, like
+ *    PicoXMLParser without PICOXML_EXPAT_STARTELEMENT_COMPAT.
+ *  - The input must stay alive and unchanged while the parser is in use.
+ */
+
+#include <deque>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Expat compat
+typedef char XML_Char;
+
+class PicoXMLViewParser {
+public:
+    PicoXMLViewParser(std::string_view input)
+        : m_in(input) {}
+
+    virtual ~PicoXMLViewParser() = default;
+    PicoXMLViewParser(const PicoXMLViewParser&) = delete;
+    PicoXMLViewParser& operator=(const PicoXMLViewParser&) = delete;
+
+    virtual bool parse() {
+        return _parse();
+    }
+    virtual bool Parse() {
+        return _parse();
+    }
+
+    virtual std::string getLastErrorMessage() {
+        return m_reason.str();
+    }
+
+protected:
+    typedef std::vector<std::pair<std::string_view, std::string_view>> Attributes;
+
+    /* Methods to be overriden. The views are only valid during the call */
+
+    /** Tag open handler. */
+    virtual void startElement(std::string_view /* nm */, const Attributes& /* attrs */) {}
+    /** Expatmm compat. */
+    virtual void StartElement(const XML_Char *, const XML_Char **) {}
+
+    /** Tag close handler. */
+    virtual void endElement(std::string_view /* nm */) {}
+    /** Expatmm compat */
+    virtual void EndElement(const XML_Char * /* nm */) {}
+
+    /** Non-tag data handler. */
+    virtual void characterData(std::string_view /*data*/) {}
+    /** Expatmm compat */
+    virtual void CharacterData(const XML_Char *, int) {}
+
+    /**
+     * Current element stack, including the bottom one (the one open or close is called for),
+     * with the element names and starting character offsets.
+     */
+    class StackEl {
+    public:
+        std::string_view name;
+        std::string_view::size_type start_index;
+    };
+    std::vector<StackEl> m_path;
+
+private:
+    std::string_view m_in;
+    std::string_view::size_type m_pos{0};
+    std::stringstream m_reason;
+    // Null-terminated element names, one per depth level. A deque so that the m_path views
+    // stay valid when it grows.
+    std::deque<std::string> m_names;
+    // Current attributes, and storage for the values which needed decoding.
+    Attributes m_attrs;
+    std::deque<std::string> m_attrvalues;
+    size_t m_attrvaluescnt{0};
+    // Decoded character data
+    std::string m_decoded;
+
+    void _startelem(std::string_view tagname, bool empty) {
+        auto depth = m_path.size();
+        if (m_names.size() <= depth) {
+            m_names.emplace_back();
+        }
+        std::string& name = m_names[depth];
+        name.assign(tagname);
+        m_path.push_back({name, m_pos});
+
+        startElement(name, m_attrs);
+        StartElement(name.c_str(), nullptr);
+        if (empty) {
+            _endelem();
+        }
+    }
+
+    void _endelem() {
+        const std::string& name = m_names[m_path.size() - 1];
+        endElement(name);
+        EndElement(name.c_str());
+        m_path.pop_back();
+    }
+
+    bool _parse() {
+        // skip initial whitespace and XML decl. On success, returns with
+        // current pos on first tag '<'
+        if (!skipDecl()) {
+            return false;
+        }
+        if (nomore()) {
+            // empty file
+            return true;
+        }
+
+        for (;;) {
+            // Current char is '<' and the next char is not '?'
+            // skipComment also processes
+            bool wascomment;
+            if (!skipComment(wascomment)) {
+                return false;
+            }
+            if (nomore()) {
+                if (!m_path.empty()) {
+                    m_reason << "EOF hit inside open element at cpos " << m_pos;
+                    return false;
+                }
+                return true;
+            }
+            if (wascomment)
+                continue;
+            m_pos++;
+            if (nomore()) {
+                m_reason << "EOF within tag";
+                return false;
+            }
+            std::string_view::size_type spos = m_pos;
+            int isendtag = m_in[m_pos] == '/' ? 1 : 0;
+
+            skipStr(">");
+            if (m_pos == std::string_view::npos || m_pos <= spos + 1) {
+                m_reason << "Empty tag or EOF inside tag. pos " << spos;
+                return false;
+            }
+
+            int emptyel = m_in[m_pos-2] == '/' ? 1 : 0;
+            if (emptyel && isendtag) {
+                m_reason << "Bad tag </xx/> at cpos " << spos;
+                return false;
+            }
+
+            std::string_view tag =
+                m_in.substr(spos + isendtag, m_pos - (spos + 1 + isendtag + emptyel));
+            trimtag(tag);
+            if (!parseattrs(tag)) {
+                return false;
+            }
+            if (isendtag) {
+                if (m_path.empty() || tag != m_path.back().name) {
+                    m_reason << "Closing not open tag " << tag << " at cpos " << m_pos;
+                    return false;
+                }
+                _endelem();
+            } else {
+                _startelem(tag, emptyel);
+            }
+            if (!_chardata()) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool _chardata() {
+        std::string_view::size_type spos = m_pos;
+        m_pos = m_in.find('<', m_pos);
+        if (nomore()) {
+            return true;
+        }
+        if (m_pos != spos) {
+            std::string_view data = m_in.substr(spos, m_pos - spos);
+            if (data.find('&') != std::string_view::npos) {
+                if (!unQuote(data, m_decoded)) {
+                    return false;
+                }
+                data = m_decoded;
+            }
+            characterData(data);
+            CharacterData(data.data(), static_cast<int>(data.size()));
+        }
+        return true;
+    }
+
+    bool nomore(int sz = 0) const {
+        return m_pos == std::string_view::npos || m_pos >= m_in.size() - sz;
+    }
+    bool skipWS(std::string_view in, std::string_view::size_type& pos) {
+        if (pos == std::string_view::npos)
+            return false;
+        pos = in.find_first_not_of(" \t\n\r", pos);
+        return pos != std::string_view::npos;
+    }
+    bool skipStr(std::string_view str) {
+        if (m_pos == std::string_view::npos)
+            return false;
+        m_pos = m_in.find(str, m_pos);
+        if (m_pos != std::string_view::npos)
+            m_pos += str.size();
+        return m_pos != std::string_view::npos;
+    }
+    int peek(int sz = 0) const {
+        if (nomore(sz))
+            return -1;
+        return m_in[m_pos + 1 + sz];
+    }
+    void trimtag(std::string_view& tag) {
+        auto trimpos = tag.find_last_not_of(" \t\n\r");
+        if (trimpos != std::string_view::npos)
+            tag = tag.substr(0, trimpos + 1);
+    }
+
+    bool skipDecl() {
+        for (;;) {
+            if (!skipWS(m_in, m_pos)) {
+                m_reason << "EOF during initial ws skip";
+                return true;
+            }
+            if (m_in[m_pos] != '<') {
+                m_reason << "EOF file does not begin with decl/tag: m_pos " <<
+                    m_pos << " char [" << m_in[m_pos] << "]\n";
+                return false;
+            }
+            if (peek() == '?') {
+                if (!skipStr("?>")) {
+                    m_reason << "EOF while looking for end of xml decl";
+                    return false;
+                }
+            } else {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool skipComment(bool& wascomment) {
+        wascomment = false;
+        if (nomore()) {
+            return true;
+        }
+        if (m_in[m_pos] != '<') {
+            m_reason << "Internal error: skipComment called with wrong "
+                "start: m_pos " << m_pos << " char [" << m_in[m_pos] << "]\n";
+            return false;
+        }
+        if (peek() == '!' && peek(1) == '-' && peek(2) == '-') {
+            if (!skipStr("-->")) {
+                m_reason << "EOF while looking for end of XML comment";
+                return false;
+            }
+            // Process possible characters until next tag
+            wascomment = true;
+            return _chardata();
+        }
+        return true;
+    }
+
+    // Split the tag contents into the name (left in tag) and the attributes (in m_attrs)
+    bool parseattrs(std::string_view& tag) {
+        m_attrs.clear();
+        m_attrvaluescnt = 0;
+        std::string_view::size_type spos = tag.find_first_of(" \t\n\r");
+        if (spos == std::string_view::npos)
+            return true;
+        std::string_view tagname = tag.substr(0, spos);
+        skipWS(tag, spos);
+
+        for (;;) {
+            std::string_view::size_type epos = tag.find_first_of(" \t\n\r=", spos);
+            if (epos == std::string_view::npos) {
+                m_reason << "Bad attributes syntax at cpos " << m_pos + epos;
+                return false;
+            }
+            std::string_view attrnm = tag.substr(spos, epos - spos);
+            if (attrnm.empty()) {
+                m_reason << "Empty attribute name ?? at cpos " << m_pos + epos;
+                return false;
+            }
+            skipWS(tag, epos);
+            if (epos == std::string_view::npos || epos == tag.size() - 1 ||
+                tag[epos] != '=') {
+                m_reason <<"Missing equal sign or value at cpos " << m_pos+epos;
+                return false;
+            }
+            epos++;
+            skipWS(tag, epos);
+            if ((tag[epos] != '"' && tag[epos] != '\'') ||
+                epos == tag.size() - 1) {
+                m_reason << "Missing quote or value at cpos " << m_pos+epos;
+                return false;
+            }
+            char qc = tag[epos];
+            spos = epos + 1;
+            epos = tag.find_first_of(qc, spos);
+            if (epos == std::string_view::npos) {
+                m_reason << "Missing closing quote at cpos " << m_pos+spos;
+                return false;
+            }
+            std::string_view value = tag.substr(spos, epos - spos);
+            if (value.find('&') != std::string_view::npos) {
+                if (m_attrvalues.size() <= m_attrvaluescnt) {
+                    m_attrvalues.emplace_back();
+                }
+                std::string& decoded = m_attrvalues[m_attrvaluescnt++];
+                if (!unQuote(value, decoded)) {
+                    return false;
+                }
+                value = decoded;
+            }
+            m_attrs.emplace_back(attrnm, value);
+            if (epos == tag.size() - 1) {
+                break;
+            }
+            epos++;
+            skipWS(tag, epos);
+            if (epos == tag.size() - 1) {
+                break;
+            }
+            spos = epos;
+        }
+        tag = tagname;
+        return true;
+    }
+
+    // Decode the entities in s into out, which is reused.
+    bool unQuote(std::string_view s, std::string& out) {
+        out.clear();
+        std::string_view::size_type amp = s.find('&');
+        std::string_view::size_type pos = 0;
+        while (amp != std::string_view::npos) {
+            out.append(s.data() + pos, amp - pos);
+            auto semi = s.find(';', amp + 1);
+            if (semi == std::string_view::npos) {
+                // Position: m_pos minus the string size (including 2 quotes) plus position
+                // inside s
+                auto epos = m_pos - (s.size() + 2) + amp;
+                m_reason << "End of quoted string, inside entity name at cpos " << epos;
+                out.clear();
+                return false;
+            }
+            auto code = s.substr(amp + 1, semi - amp - 1);
+            if (code == "quot") {
+                out += '"';
+            } else if (code == "amp") {
+                out += '&';
+            } else if (code == "apos") {
+                out += '\'';
+            } else if (code == "lt") {
+                out += '<';
+            } else if (code == "gt") {
+                out += '>';
+            }
+            pos = semi + 1;
+            amp = s.find('&', pos);
+        }
+        out.append(s.data() + pos, s.size() - pos);
+        return true;
+    }
+};
+#endif /* _PICOXMLVIEW_H_INCLUDED_ */
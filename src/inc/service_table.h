@@ -49,6 +49,7 @@
 #ifdef INCLUDE_DEVICE_APIS
 
 struct Notification;
+struct GenaConnection;
 struct subscription {
     Upnp_SID sid; /* char[44] in upnp.h */
     int ToSendEventKey{0};
@@ -60,6 +61,10 @@ struct subscription {
        list is a copy of the active job. Others are activated on job
        completion. */
     std::list<std::shared_ptr<Notification>> outgoing;
+    /* HTTP connection to the delivery URLs, kept open between
+       events. Closed when the subscription goes away (unsubscribe or
+       expiry), or after the last in-flight event using it is done. */
+    std::shared_ptr<GenaConnection> conn;
 };
 
 struct service_info {
@@ -149,32 +154,6 @@ service_info *FindServiceId(
      * table. */
     const std::string& UDN);
 
-/*!
- * \brief Traverses the service table and finds the node whose event URL Path
- * matches a know value.
- *
- * \return Pointer to the service list node from the service table whose event
- * URL matches a known event URL.
- */
-service_info *FindServiceEventURLPath(
-    /*! [in] Service table. */
-    service_table& table,
-    /*! [in] Event URL path used to find a service from the table. */
-    const std::string& eventURLPath);
-
-/*!
- * \brief Traverses the service table and finds the node whose control URL Path
- * matches a know value.
- *
- * \return Pointer to the service list node from the service table whose control
- * URL Path matches a known value.
- */
-service_info * FindServiceControlURLPath(
-    /*! [in] Service table. */
-    service_table& table,
-    /*! [in] Control URL path used to find a service from the table. */
-    const std::string& controlURLPath);
-
 /*!
  * \brief For debugging purposes prints information from the service passed
  * into the function.
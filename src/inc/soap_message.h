@@ -0,0 +1,175 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2026 J.F. Dockes
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef SOAP_MESSAGE_H
+#define SOAP_MESSAGE_H
+
+#include "config.h"
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef USE_EXPAT
+#include "expatmm.h"
+#define XMLPARSERTP inputRefXMLParser
+#else
+#include "picoxmlview.h"
+#define XMLPARSERTP PicoXMLViewParser
+#endif
+
+#include "genut.h"
+#include "upnp.h"
+
+/* SOAP message processing which does not depend on the HTTP server. Used by soap_device.cpp,
+   and compiled directly into the test programs. */
+
+/* Full parser for the action requests and responses, see soap_scan_action_args() for the
+   fast path.
+
+   The original code performed a few consistency checks on the action xml
+   - Checked the soap namespace against SOAP_URN = "http:/""/schemas.xmlsoap.org/soap/envelope/";
+   - Checked the "Body" elt name
+   - Checked that the action node namespace uri matched the service type from the SOAPACTION header
+   - Checked that the action node local name matched the action name from the SOAPACTION header.
+   - Other checks for a var request. We don't support this any more.
+  As we're not in the business of checking conformity, we did not reproduce the tests for now.
+*/
+class UPnPActionRequestParser : public XMLPARSERTP {
+public:
+    UPnPActionRequestParser(
+        // XML to be parsed
+        const std::string& input,
+        // The action name is the XML element name for the argument
+        // elements parent element.
+        const std::string& actname,
+        // Output: action arguments
+        std::vector<std::pair<std::string, std::string>>& args,
+        bool isresponse)
+        : XMLPARSERTP(input), m_actname(actname), m_args(args),
+          m_isresp(isresponse) { }
+
+    // On output, and only if we are parsing the action (not a
+    // response): XML sub-document, stripping the top <Envelope> and
+    // <Body> tags, because this is what upnp used to send in the ixml
+    // tree. This is just to ease the transition.
+    std::string outxml;
+
+protected:
+    void StartElement(const XML_Char *name, const XML_Char**) override {
+        if (!m_isresp && m_path.size() >= 3) {
+            outxml += std::string("<") + name + ">";
+        }
+    }
+    void EndElement(const XML_Char *name) override {
+        std::string_view parentname{"root"};
+        if (m_path.size() > 1)
+            parentname = m_path[m_path.size()-2].name;
+        trimstring(m_chardata, " \t\n\r");
+        if (!dom_cmp_name(parentname, m_actname)) {
+            m_args.emplace_back(name, m_chardata);
+        }
+        if (!m_isresp && m_path.size() >= 3) {
+            xmlQuoteAppend(outxml, m_chardata);
+            outxml += std::string("</") + name + ">";
+        }
+        m_chardata.clear();
+    }
+
+    void CharacterData(const XML_Char *s, int len) override {
+        if (s == nullptr || *s == 0)
+            return;
+        m_chardata.append(s, len);
+    }
+
+private:
+    const std::string& m_actname;
+    std::string m_chardata;
+    std::vector<std::pair<std::string, std::string>>& m_args;
+    bool m_isresp;
+};
+
+/*!
+ * \brief Find the action arguments in a SOAP request without building anything, then decode
+ * them in place, and return views into the body.
+ *
+ * This only handles the usual simple form: UTF-8, no SOAP header content, one level of
+ * text-only argument elements, ASCII element and attribute names. The whole document is checked
+ * for well-formedness. Returns false, with the body untouched, for anything else (CDATA, nested
+ * elements, processing instructions, other encodings, data which expat would reject...), and
+ * the caller must then use the full parser.
+ *
+ * \param body the request body. The argument values are decoded in place.
+ * \param actname the action name, which must match the local name of the action element.
+ * \param[out] actqname the qualified name of the action element, a view into body.
+ * \param[out] args name/value pairs, views into body.
+ */
+bool soap_scan_action_args(
+    std::string& body, const std::string& actname, std::string_view& actqname,
+    std::vector<std::pair<std::string_view, std::string_view>>& args);
+
+/* Start of all the SOAP responses, up to the Body element content */
+inline constexpr auto soap_response_prolog =
+    R"(<?xml version="1.0"?>)" "\n"
+    R"(<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" )"
+    R"(s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">)" "\n"
+    "<s:Body>\n";
+
+/*!
+ * \brief Produce an action response from streamed arguments, escaping each value piece by
+ * piece into the caller's buffer, so that the memory used stays small whatever the size of the
+ * data.
+ */
+class ActionResponseStreamer {
+public:
+    ActionResponseStreamer(std::string_view actname, std::string_view servicetype,
+                           std::vector<UpnpStreamedArg> args);
+
+    /*! Copy the next part of the response to buf. Returns the byte count, 0 at the end. */
+    size_t read(char *buf, size_t max);
+
+private:
+    enum class State {ARGOPEN, ARGVALUE, END, DONE};
+    bool refill();
+
+    std::vector<UpnpStreamedArg> m_args;
+    std::string m_actname;
+    State m_state;
+    size_t m_argidx{0};
+    // Data from the current generator call, not yet escaped.
+    std::string_view m_piece;
+    // Data ready for output
+    std::string m_out;
+    size_t m_outpos{0};
+};
+
+#endif /* SOAP_MESSAGE_H */
@@ -32,11 +32,19 @@
 #ifndef SOAPLIB_H
 #define SOAPLIB_H 
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+class MHDBodyConsumer;
 struct MHDTransaction;
+struct UpnpActionResult;
+struct UpnpBatchAction;
+struct Upnp_Action_Request;
+struct UpnpDeferredAction_s;
 
 /*!
  * \brief This is a callback called by minisever after receiving the request
@@ -45,6 +53,20 @@ struct MHDTransaction;
  */
 void soap_device_callback(MHDTransaction*);
 
+/*!
+ * \brief Called by the miniserver when the body of a SOAP request starts
+ * arriving. Returns an incremental parser for the action if the library was
+ * initialized with UPNP_FLAG_STREAM_ACTION_REQUESTS, else null.
+ */
+std::unique_ptr<MHDBodyConsumer> soap_device_body_start(MHDTransaction*);
+
+/* Implementation of UpnpDeferAction() and UpnpCompleteAction() */
+int soap_defer_action(Upnp_Action_Request *request, UpnpDeferredAction_s **handle);
+int soap_complete_action(UpnpDeferredAction_s *handle, int status,
+                         const Upnp_Action_Request *result);
+/* Implementation of UpnpGetActionXML() */
+int soap_get_action_xml(const Upnp_Action_Request *request, std::string& xml);
+
 int SoapSendAction(
     const std::string& xml_header_str,
     const std::string& actionURL,
@@ -56,5 +78,24 @@ int SoapSendAction(
     std::string&  errdesc
     );
 
+/* Implementation of UpnpSendActionAsync() and UpnpCancelAction() */
+int SoapSendActionAsync(
+    const std::string& xml_header_str,
+    const std::string& actionURL,
+    const std::string& serviceType,
+    const std::string& actionName,
+    const std::vector<std::pair<std::string, std::string>>& actionArgs,
+    int timeoutms,
+    std::function<void (UpnpActionResult)> callback,
+    uint64_t *idp);
+int SoapCancelAction(uint64_t id);
+/* Implementation of UpnpSendActionBatch() */
+int SoapSendActionBatch(
+    const std::vector<UpnpBatchAction>& actions, int timeoutms,
+    std::vector<UpnpActionResult>& results);
+
+/* Cancel the asynchronous actions in progress and stop their thread. Called by UpnpFinish() */
+void SoapClientShutdown();
+
 #endif /* SOAPLIB_H */
 
@@ -39,6 +39,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "ThreadPool.h"
@@ -55,7 +56,7 @@
 
 #define DEFAULT_MX 5
 
-#define DEFAULT_SOAP_CONTENT_LENGTH 16000
+#define DEFAULT_SOAP_CONTENT_LENGTH (1024 * 1024)
 #define MAX_SOAP_CONTENT_LENGTH (size_t)32000
 
 extern size_t g_maxContentLength;
@@ -181,6 +182,47 @@ Upnp_Handle_Type GetDeviceHandleInfoForPath(
     service_info **serv_info
     );
 
+#ifdef INCLUDE_DEVICE_APIS
+/* Entry in the index from the control and event URL paths to the device
+   services. Except for service, the fields are copies which can be used
+   without holding the handle lock. */
+struct ServiceRoute {
+    UpnpDevice_Handle hnd;
+    /* Only valid while holding the handle lock */
+    service_info *service;
+    std::string UDN;
+    std::string serviceType;
+    std::string serviceId;
+    /* Length of the serviceType part before the version number */
+    size_t serviceTypeBaseLen;
+    Upnp_FunPtr callback;
+    void *cookie;
+    std::string productversion;
+};
+
+struct ServiceRoutes {
+    std::unordered_map<std::string, std::shared_ptr<const ServiceRoute>> control;
+    std::unordered_map<std::string, std::shared_ptr<const ServiceRoute>> event;
+};
+
+/*!
+ * \brief Return the current service index. This does not need the handle lock,
+ * the index is replaced, never modified.
+ */
+std::shared_ptr<const ServiceRoutes> GetServiceRoutes();
+
+/*!
+ * \brief Rebuild the service index after a change to the device handles or
+ * service tables. Must be called with the handle lock held.
+ */
+void UpdateServiceRoutes();
+
+/*!
+ * \brief Compute the service index key for a control/event URL or request path.
+ */
+std::string ServiceRouteKey(const std::string& url);
+#endif /* INCLUDE_DEVICE_APIS */
+
 extern unsigned short LOCAL_PORT_V4;
 extern unsigned short LOCAL_PORT_V6;
 /* The network interfaces we were told to use */
@@ -218,13 +260,22 @@ extern const std::string g_HostForTemplate;
 extern Upnp_SID gUpnpSdkNLSuuid;
 
 extern TimerThread *gTimerThread;
+/* CPU affinity and scheduling class for the persistent miniserver and timer threads */
+extern ThreadSchedAttr g_miniServerThreadSched;
+extern ThreadSchedAttr g_timerThreadSched;
 extern ThreadPool gRecvThreadPool;
 extern ThreadPool gSendThreadPool;
 extern ThreadPool gMiniServerThreadPool;
+/* Jobs executing application callbacks, kept apart from the protocol work in the other pools */
+extern ThreadPool gCallbackThreadPool;
 
 extern struct VirtualDirCallbacks virtualDirCallback;
 
 int PrintHandleInfo(UpnpClient_Handle Hnd);
 
+/*! Print the statistics for a thread pool, including the latency histograms, with UPNP_DEBUG
+ * level. */
+void PrintThreadPoolStats(ThreadPool *tp, const char *DbgFileName, int DbgLineNo, const char *msg);
+
 #endif /* UPNPAPI_H */
 
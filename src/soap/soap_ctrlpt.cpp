@@ -33,10 +33,14 @@
 #ifdef INCLUDE_CLIENT_APIS
 #if EXCLUDE_SOAP == 0
 
+#include <condition_variable>
 #include <cstdlib>
 #include <curl/curl.h>
 #include <iostream>
+#include <memory>
+#include <mutex>
 
+#include "CurlMultiLoop.h"
 #include "genut.h"
 #include "miniserver.h"
 #include "soaplib.h"
@@ -48,8 +52,8 @@
 #include "expatmm.h"
 #define XMLPARSERTP inputRefXMLParser
 #else
-#include "picoxml.h"
-#define XMLPARSERTP PicoXMLParser
+#include "picoxmlview.h"
+#define XMLPARSERTP PicoXMLViewParser
 #endif
 
 #include "utf8iter.h"
@@ -70,8 +74,9 @@ public:
 
 protected:
     void EndElement(const XML_Char *name) override {
-        const std::string& parentname = (m_path.size() == 1) ?
-            "root" : m_path[m_path.size()-2].name;
+        std::string_view parentname{"root"};
+        if (m_path.size() > 1)
+            parentname = m_path[m_path.size()-2].name;
         trimstring(m_chardata, " \t\n\r");
         if (parentname == "UPnPError") {
             if (!strcmp(name, "errorCode")) {
@@ -128,13 +133,29 @@ get_response_value(
     }
     *errcodep = 0;
 
-    UPnPResponseParser mparser(payload, rspname, rspdata, errcodep, errdesc);
+    // Some media servers (minidlna) sometimes send bad utf-8 chars
+    // because of careless truncation. XML parsers don't like
+    // this. Try to fix by replacing bad chars with the usual question
+    // mark. This is normally done after a parse failure, or before
+    // parsing, after a fast check, if the application asked for it.
+    std::string fixed;
+    const std::string *doc = &payload;
+    bool checkfirst = (g_optionFlags & UPNP_FLAG_CHECK_RESPONSE_UTF8) != 0;
+    if (checkfirst && utf8check(payload) < 0) {
+        if (utf8check(payload, true, &fixed) < 0) {
+            UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__,
+                       "soap: fix encoding failed for %s\n", payload.c_str());
+            return UPNP_E_BAD_RESPONSE;
+        }
+        doc = &fixed;
+    }
+    UPnPResponseParser mparser(*doc, rspname, rspdata, errcodep, errdesc);
     if (!mparser.Parse()) {
-        // Some media servers (minidlna) sometimes send bad utf-8 chars
-        // because of careless truncation. XML parsers don't like
-        // this. Try to fix by replacing bad chars with the usual question
-        // mark.
-        std::string fixed;
+        if (checkfirst) {
+            UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__,
+                       "soap:get_response_value: parse failed for [%s]\n", payload.c_str());
+            return UPNP_E_BAD_RESPONSE;
+        }
         if (utf8check(payload, true, &fixed) < 0) {
             UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__,
                        "soap: fix encoding failed for %s\n", payload.c_str());
@@ -163,34 +184,42 @@ public:
     long timeoutms{-1};
 };
 
-int SoapSendAction(
+/* State for one action exchange, shared by the synchronous and asynchronous paths */
+struct SoapActionTransfer {
+    SoapActionTransfer() = default;
+    ~SoapActionTransfer() {
+        curl_slist_free_all(headerlist);
+    }
+    SoapActionTransfer(const SoapActionTransfer&) = delete;
+    SoapActionTransfer& operator=(const SoapActionTransfer&) = delete;
+
+    std::string actionName;
+    std::string hostport;
+    std::string surl;
+    std::string payload;
+    long timeoutms{1000L * HTTP_DEFAULT_TIMEOUT};
+    struct curl_slist *headerlist{nullptr};
+    char curlerrormessage[CURL_ERROR_SIZE];
+    std::map<std::string, std::string> http_headers;
+    std::string responsestr;
+};
+
+/* Build the request data */
+static int soap_prepare_action(
     const std::string& xml_header_str, const std::string& actionURL,
     const std::string& serviceType,    const std::string& actionName,
     const std::vector<std::pair<std::string, std::string>>& actionArgs,
-    std::vector<std::pair<std::string, std::string>>& respdata,
-    int *errcodep, std::string& errdesc)
+    SoapActionTransfer& tr)
 {
-    const static std::string xml_start{
+    static const std::string_view xml_start{
         R"(<?xml version="1.0" encoding="utf-8"?>)" "\r\n"
         R"(<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" )"
         R"(s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">)" "\r\n"};
-    const static std::string xml_header_start{"<s:Header>\r\n"};
-    const static std::string xml_header_end{"</s:Header>\r\n"};
-    const static std::string xml_body_start{"<s:Body>"};
-    const static std::string xml_end{"</s:Body>\r\n</s:Envelope>\r\n"};
+    static const std::string_view xml_header_start{"<s:Header>\r\n"};
+    static const std::string_view xml_header_end{"</s:Header>\r\n"};
+    static const std::string_view xml_body_start{"<s:Body>"};
+    static const std::string_view xml_end{"</s:Body>\r\n</s:Envelope>\r\n"};
 
-    UPnPSoapOptParser opts(respdata);
-    respdata.clear();
-    long timeoutms = opts.timeoutms >= 0 ? opts.timeoutms : 1000L * HTTP_DEFAULT_TIMEOUT;
-    
-    /* Action: name and namespace (servicetype) */
-    std::ostringstream act;
-    act << "<u:" << actionName << R"( xmlns:u=")" << serviceType << R"(">)" "\n";
-    /* Action arguments */
-    for (const auto& [name, val] : actionArgs)
-        act << "<" << name << ">" << xmlQuote(val) << "</" << name << ">\n";
-    act << "</u:" << actionName << ">\n";
-    
     /* parse url */
     uri_type url;
     if (http_FixStrUrl(actionURL, &url) != 0) {
@@ -201,70 +230,79 @@ int SoapSendAction(
                "soapSendAction: hostport [%s] path [%s] action [%s]\n",
                url.hostport.text.c_str(), url.path.c_str(), actionName.c_str());
 
-    std::string payload{xml_start};
-    if (!xml_header_str.empty()) {
-        payload += xml_header_start + xml_header_str + xml_header_end;
+    /* Envelope, optional header, then the action element, namespaced by the
+       service type, with its arguments */
+    if (xml_header_str.empty()) {
+        soapBuildMessage(tr.payload, {xml_start, xml_body_start}, actionName, "", serviceType,
+                         actionArgs, xml_end);
+    } else {
+        soapBuildMessage(tr.payload, {xml_start, xml_header_start, xml_header_str,
+                                      xml_header_end, xml_body_start},
+                         actionName, "", serviceType, actionArgs, xml_end);
     }
-    payload += xml_body_start + act.str() + xml_end;
-    
-    std::string soapaction = std::string(R"(SOAPACTION: ")") + serviceType + "#" +
-        actionName + R"(")";
+
+    std::string soapaction;
+    soapaction.reserve(serviceType.size() + actionName.size() + 14);
+    soapaction += R"(SOAPACTION: ")";
+    soapaction += serviceType;
+    soapaction += '#';
+    soapaction += actionName;
+    soapaction += '"';
 
     //std::cerr << "SoapSendAction: SOAPACTION [" << soapaction << "]\n";
     //std::cerr << "SoapSendAction: PAYLOAD [" << payload << "]\n";
 
-    std::map<std::string, std::string> http_headers;
-    std::string responsestr;
-    long http_status = 0;
-    int ret_code;
-    {
-        CURL *easy = curl_easy_init();
-        char curlerrormessage[CURL_ERROR_SIZE];
-
-        curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, curlerrormessage);
-        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback_str_curl);
-        curl_easy_setopt(easy, CURLOPT_WRITEDATA, &responsestr);
-        curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, header_callback_curl);
-        curl_easy_setopt(easy, CURLOPT_HEADERDATA, &http_headers);
-        curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, timeoutms);
-        curl_easy_setopt(easy, CURLOPT_POST, long(1));
-        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, payload.c_str()); 
-        struct curl_slist *list = nullptr;
-        list = curl_slist_append(list, R"(Content-Type: text/xml; charset="utf-8")");
-        list = curl_slist_append(list, soapaction.c_str());
-        list = curl_slist_append(list, "Accept:");
-        list = curl_slist_append(list, "Expect:");
-        list = curl_slist_append(
-            list, (std::string("USER-AGENT: ") + get_sdk_client_info()).c_str());
-        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, list);
-        std::string surl = uri_asurlstr(url);
-        curl_easy_setopt(easy, CURLOPT_URL, surl.c_str());
-        CURLcode code = curl_easy_perform(easy);
-        if (code == CURLE_OK) {
-            curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_status);
-            ret_code = UPNP_E_SUCCESS;
-        } else {
-            UpnpPrintf(UPNP_ERROR, GENA, __FILE__, __LINE__,
-                       "CURL ERROR MESSAGE %s\n", curlerrormessage);
-            // Temp debug: try to log the response string anyway:
-            UpnpPrintf(UPNP_ERROR, GENA, __FILE__, __LINE__,
-                       "   data before CURL ERROR: [%s]\n", responsestr.c_str());
-            ret_code = UPNP_E_BAD_RESPONSE;
-        }
-        /* Clean-up. */
-        curl_slist_free_all(list);
-        curl_easy_cleanup(easy);
-    }
+    auto& list = tr.headerlist;
+    list = curl_slist_append(list, R"(Content-Type: text/xml; charset="utf-8")");
+    list = curl_slist_append(list, soapaction.c_str());
+    list = curl_slist_append(list, "Accept:");
+    list = curl_slist_append(list, "Expect:");
+    list = curl_slist_append(
+        list, (std::string("USER-AGENT: ") + get_sdk_client_info()).c_str());
 
-    if (ret_code != UPNP_E_SUCCESS) {
-        return ret_code;
+    tr.actionName = actionName;
+    tr.hostport = url.hostport.text;
+    tr.surl = uri_asurlstr(url);
+    return UPNP_E_SUCCESS;
+}
+
+static void soap_setup_curl(CURL *easy, SoapActionTransfer& tr)
+{
+    tr.curlerrormessage[0] = 0;
+    curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, tr.curlerrormessage);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback_str_curl);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &tr.responsestr);
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, header_callback_curl);
+    curl_easy_setopt(easy, CURLOPT_HEADERDATA, &tr.http_headers);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, tr.timeoutms);
+    curl_easy_setopt(easy, CURLOPT_POST, long(1));
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDS, tr.payload.c_str()); 
+    // Empty string: advertise and decode all the codings that curl supports.
+    curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, tr.headerlist);
+    curl_easy_setopt(easy, CURLOPT_URL, tr.surl.c_str());
+}
+
+/* Interpret the transfer result and the response */
+static int soap_action_result(
+    SoapActionTransfer& tr, CURLcode code, long http_status,
+    std::vector<std::pair<std::string, std::string>>& respdata,
+    int *errcodep, std::string& errdesc)
+{
+    if (code != CURLE_OK) {
+        UpnpPrintf(UPNP_ERROR, GENA, __FILE__, __LINE__,
+                   "CURL ERROR MESSAGE %s\n", tr.curlerrormessage);
+        // Temp debug: try to log the response string anyway:
+        UpnpPrintf(UPNP_ERROR, GENA, __FILE__, __LINE__,
+                   "   data before CURL ERROR: [%s]\n", tr.responsestr.c_str());
+        return UPNP_E_BAD_RESPONSE;
     }
 
-    std::string responsename(actionName);
+    std::string responsename(tr.actionName);
     responsename += "Response";
 
-    const auto it = http_headers.find("content-type");
-    if (it == http_headers.end()) {
+    const auto it = tr.http_headers.find("content-type");
+    if (it == tr.http_headers.end()) {
         UpnpPrintf(UPNP_ERROR, GENA, __FILE__, __LINE__,
                    "soapSendAction: no Content-Type header in SOAP response\n");
         return    UPNP_E_BAD_RESPONSE;
@@ -272,8 +310,8 @@ int SoapSendAction(
     std::string content_type = it->second;
 
     /* get action node from the response */
-    ret_code = get_response_value(
-        responsestr, http_status, content_type, responsename, respdata, errcodep, errdesc);
+    int ret_code = get_response_value(
+        tr.responsestr, http_status, content_type, responsename, respdata, errcodep, errdesc);
 
     UpnpPrintf(UPNP_DEBUG, SOAP, __FILE__, __LINE__,
                "soapSendAction: http_stt [%ld] errcode %d errdesc[%s]\n",
@@ -286,5 +324,247 @@ int SoapSendAction(
     return ret_code;
 }
 
+int SoapSendAction(
+    const std::string& xml_header_str, const std::string& actionURL,
+    const std::string& serviceType,    const std::string& actionName,
+    const std::vector<std::pair<std::string, std::string>>& actionArgs,
+    std::vector<std::pair<std::string, std::string>>& respdata,
+    int *errcodep, std::string& errdesc)
+{
+    UPnPSoapOptParser opts(respdata);
+    respdata.clear();
+
+    SoapActionTransfer tr;
+    int ret_code = soap_prepare_action(
+        xml_header_str, actionURL, serviceType, actionName, actionArgs, tr);
+    if (ret_code != UPNP_E_SUCCESS) {
+        return ret_code;
+    }
+    if (opts.timeoutms >= 0) {
+        tr.timeoutms = opts.timeoutms;
+    }
+
+    long http_status = 0;
+    CURL *easy = http_get_curl_handle(tr.hostport);
+    soap_setup_curl(easy, tr);
+    CURLcode code = curl_easy_perform(easy);
+    if (code == CURLE_OK) {
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_status);
+    }
+    /* Keep the connection for the next action unless something went wrong */
+    http_release_curl_handle(tr.hostport, easy, code == CURLE_OK);
+
+    return soap_action_result(tr, code, http_status, respdata, errcodep, errdesc);
+}
+
+/* The asynchronous actions all run on a single curl multi loop, created on first use, and
+   created again if it stopped: it may have found no free thread in the pool, or been stopped by
+   the pool shutdown. */
+static std::mutex gActionLoopMutex;
+static CurlMultiLoop *gActionLoop;
+
+/* Start an action on the multi loop. done is called from the loop thread, with the curl result
+   and the HTTP status. Returns the transfer id, or 0 if the transfer could not be started.
+
+   The connections used by the loop transfers belong to the connection pool of its multi
+   handle, which lives as long as the loop, so they are reused by the following asynchronous
+   or batch actions. They are not shared with the synchronous actions, and the
+   http_get_curl_handle() cache is not used here: a cached handle would not bring its
+   connection to the multi handle, and giving the handles back would fill the cache with
+   handles which have no connection. */
+static uint64_t soap_start_transfer(
+    std::shared_ptr<SoapActionTransfer> tr, std::function<void(CURLcode, long)> done)
+{
+    std::scoped_lock lck(gActionLoopMutex);
+    if (nullptr == gActionLoop || !gActionLoop->running()) {
+        // A stopped loop has no transfers left. If it is still stopping, deleting it waits for
+        // its thread, which does not need our lock.
+        delete gActionLoop;
+        gActionLoop = new CurlMultiLoop(&gSendThreadPool);
+    }
+    CURL *easy = curl_easy_init();
+    if (nullptr == easy) {
+        return 0;
+    }
+    soap_setup_curl(easy, *tr);
+    auto id = gActionLoop->add(
+        easy, [tr, easy, done = std::move(done)](CURLcode code) {
+            // Running on the loop thread: do as little as possible.
+            long http_status = 0;
+            if (code == CURLE_OK) {
+                curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_status);
+            }
+            curl_easy_cleanup(easy);
+            done(code, http_status);
+        });
+    if (0 == id) {
+        curl_easy_cleanup(easy);
+    }
+    return id;
+}
+
+/* Compute the result of an asynchronous transfer */
+static void soap_async_result(
+    SoapActionTransfer& tr, CURLcode code, long http_status, UpnpActionResult& result)
+{
+    switch (code) {
+    case CURLE_ABORTED_BY_CALLBACK:
+        result.status = UPNP_E_CANCELED;
+        break;
+    case CURLE_OPERATION_TIMEDOUT:
+        result.status = UPNP_E_TIMEDOUT;
+        break;
+    default:
+        result.status = soap_action_result(tr, code, http_status, result.responseData,
+                                           &result.errorCode, result.errorDescription);
+        break;
+    }
+}
+
+/* Interprets the response and calls the application. The callback is called even if the job
+   is dropped by the thread pool (full queue or shutdown), so that it always gets called once. */
+class ActionCompleteJobWorker : public JobWorker {
+public:
+    ActionCompleteJobWorker(std::shared_ptr<SoapActionTransfer> tr, CURLcode code,
+                            long http_status, UpnpActionCallback callback)
+        : m_tr(std::move(tr)), m_code(code), m_http_status(http_status),
+          m_callback(std::move(callback)) {}
+    ~ActionCompleteJobWorker() override {
+        if (m_callback) {
+            UpnpActionResult result;
+            result.status = UPNP_E_CANCELED;
+            m_callback(std::move(result));
+        }
+    }
+    void work() override {
+        UpnpActionResult result;
+        soap_async_result(*m_tr, m_code, m_http_status, result);
+        auto callback = std::move(m_callback);
+        m_callback = nullptr;
+        callback(std::move(result));
+    }
+private:
+    std::shared_ptr<SoapActionTransfer> m_tr;
+    CURLcode m_code;
+    long m_http_status;
+    UpnpActionCallback m_callback;
+};
+
+int SoapSendActionAsync(
+    const std::string& xml_header_str, const std::string& actionURL,
+    const std::string& serviceType,    const std::string& actionName,
+    const std::vector<std::pair<std::string, std::string>>& actionArgs,
+    int timeoutms, UpnpActionCallback callback, uint64_t *idp)
+{
+    auto tr = std::make_shared<SoapActionTransfer>();
+    int ret_code = soap_prepare_action(
+        xml_header_str, actionURL, serviceType, actionName, actionArgs, *tr);
+    if (ret_code != UPNP_E_SUCCESS) {
+        return ret_code;
+    }
+    if (timeoutms > 0) {
+        tr->timeoutms = timeoutms;
+    }
+
+    auto id = soap_start_transfer(
+        tr, [tr, callback = std::move(callback)](CURLcode code, long http_status) {
+            gCallbackThreadPool.addJob(
+                std::make_unique<ActionCompleteJobWorker>(tr, code, http_status, callback));
+        });
+    if (0 == id) {
+        return UPNP_E_INIT_FAILED;
+    }
+    if (idp) {
+        *idp = id;
+    }
+    return UPNP_E_SUCCESS;
+}
+
+int SoapSendActionBatch(
+    const std::vector<UpnpBatchAction>& actions, int timeoutms,
+    std::vector<UpnpActionResult>& results)
+{
+    // Completion state, shared with the loop thread
+    struct BatchState {
+        std::mutex mutex;
+        std::condition_variable condition;
+        size_t pending{0};
+        std::vector<std::pair<CURLcode, long>> outcomes;
+    };
+    auto state = std::make_shared<BatchState>();
+    state->outcomes.resize(actions.size());
+    std::vector<std::shared_ptr<SoapActionTransfer>> transfers(actions.size());
+    results.clear();
+    results.resize(actions.size());
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        const auto& action = actions[i];
+        auto tr = std::make_shared<SoapActionTransfer>();
+        int ret_code = soap_prepare_action(action.headerString, action.actionURL,
+                                           action.serviceType, action.actionName,
+                                           action.actionParams, *tr);
+        if (ret_code != UPNP_E_SUCCESS) {
+            results[i].status = ret_code;
+            continue;
+        }
+        if (timeoutms > 0) {
+            tr->timeoutms = timeoutms;
+        }
+        {
+            std::scoped_lock lck(state->mutex);
+            state->pending++;
+        }
+        auto id = soap_start_transfer(tr, [state, i](CURLcode code, long http_status) {
+            std::scoped_lock lck(state->mutex);
+            state->outcomes[i] = {code, http_status};
+            if (--state->pending == 0) {
+                state->condition.notify_all();
+            }
+        });
+        if (0 == id) {
+            std::scoped_lock lck(state->mutex);
+            state->pending--;
+            results[i].status = UPNP_E_INIT_FAILED;
+            continue;
+        }
+        transfers[i] = std::move(tr);
+    }
+
+    {
+        std::unique_lock<std::mutex> lck(state->mutex);
+        state->condition.wait(lck, [&state] {return state->pending == 0;});
+    }
+
+    // The responses are parsed by the calling thread.
+    for (size_t i = 0; i < actions.size(); i++) {
+        if (transfers[i]) {
+            const auto& [code, http_status] = state->outcomes[i];
+            soap_async_result(*transfers[i], code, http_status, results[i]);
+        }
+    }
+    return UPNP_E_SUCCESS;
+}
+
+int SoapCancelAction(uint64_t id)
+{
+    std::scoped_lock lck(gActionLoopMutex);
+    if (nullptr == gActionLoop || !gActionLoop->cancel(id)) {
+        return UPNP_E_NOT_FOUND;
+    }
+    return UPNP_E_SUCCESS;
+}
+
+void SoapClientShutdown()
+{
+    CurlMultiLoop *loop;
+    {
+        std::scoped_lock lck(gActionLoopMutex);
+        loop = gActionLoop;
+        gActionLoop = nullptr;
+    }
+    // Deleting the loop calls the completion callbacks: don't hold the lock.
+    delete loop;
+}
+
 #endif /* EXCLUDE_SOAP */
 #endif /* INCLUDE_CLIENT_APIS */
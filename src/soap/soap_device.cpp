@@ -35,22 +35,18 @@
 #ifdef INCLUDE_DEVICE_APIS
 #if EXCLUDE_SOAP == 0
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 
-#ifdef USE_EXPAT
-#include "expatmm.h"
-#define XMLPARSERTP inputRefXMLParser
-#else
-#include "picoxml.h"
-#define XMLPARSERTP PicoXMLParser
-#endif
-
 #include "genut.h"
+#include "miniserver.h"
+#include "soap_message.h"
 #include "soaplib.h"
 #include "statcodes.h"
 #include "upnpapi.h"
@@ -76,15 +72,34 @@ struct soap_devserv_t {
     char service_id[NAME_SIZE];
     std::string action_name;
     std::string productversion;
+    /* Length of service_type before the version number */
+    size_t service_type_base_len;
     Upnp_FunPtr callback;
     void *cookie;
 };
 
-static constexpr auto bodyprolog =
-    R"(<?xml version="1.0"?>)" "\n"
-    R"(<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" )"
-    R"(s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">)" "\n"
-    "<s:Body>\n";
+/* Handle given to the application for an action answered after the callback returns */
+struct UpnpDeferredAction_s {
+    soap_devserv_t soap_info;
+    std::shared_ptr<MHDDeferredResponse> response;
+    /* Copy of the argument views data: the request body goes away if the
+       client disconnects before the action is completed. */
+    std::string argdata;
+};
+
+/* The action request being processed by a callback in this thread, for
+   checking the UpnpDeferAction() and UpnpGetActionXML() parameters */
+struct soap_action_ctx_t {
+    Upnp_Action_Request *action;
+    MHDTransaction *mhdt;
+    soap_devserv_t *soap_info;
+    /* With argument views: the action element qualified name, or the whole
+       sub-document if it could not be rebuilt from the views. */
+    std::string_view actqname;
+    std::string_view actxml;
+    UpnpDeferredAction deferred{nullptr};
+};
+static thread_local soap_action_ctx_t *tl_action_ctx;
 
 /*!
  * \brief Sends SOAP error response.
@@ -93,7 +108,7 @@ static void send_error_response(
     MHDTransaction *mhdt, int error_code, const char *err_msg,
     const std::string& productversion)
 {
-    const static std::string start_body = std::string(bodyprolog) +
+    const static std::string start_body = std::string(soap_response_prolog) +
             "<s:Fault>\n"
             "<faultcode>s:Client</faultcode>\n"
             "<faultstring>UPnPError</faultstring>\n"
@@ -129,110 +144,92 @@ static void send_action_response(
     MHDTransaction *mhdt, soap_devserv_t *soap_info,
     const std::vector<std::pair<std::string, std::string> >& data)
 {
-    static const std::string start_body{bodyprolog};
-    static const std::string end_body = "</s:Body></s:Envelope>";
-
-    std::ostringstream response;
-    response << start_body;
-    response << "<u:" << soap_info->action_name << "Response" <<
-        R"( xmlns:u=")" << soap_info->service_type << R"(">)" "\n";
-    for (const auto& [name, val] : data)
-        response << "<" << name << ">" << xmlQuote(val) << "</" << name << ">\n";
-    response << "</u:" << soap_info->action_name << "Response" << ">\n";
-    response << end_body;
-    const std::string& txt(response.str());
+    std::string txt;
+    soapBuildMessage(txt, {soap_response_prolog}, soap_info->action_name, "Response",
+                     soap_info->service_type, data, "</s:Body></s:Envelope>");
     UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__, "Action Response data: [%s]\n", txt.c_str());
-    mhdt->response = MHD_create_response_from_buffer(
-        txt.size(), const_cast<char*>(txt.c_str()), MHD_RESPMEM_MUST_COPY);
+    mhdt->response = http_create_data_response(mhdt, txt);
+    MHD_add_response_header(mhdt->response, "Content-Type", R"(text/xml; charset="utf-8")");
     MHD_add_response_header(
         mhdt->response, "SERVER", get_sdk_device_info(soap_info->productversion).c_str());
     mhdt->httpstatus = 200;
 }
 
+static ssize_t streamed_response_reader(void *cls, uint64_t, char *buf, size_t max)
+{
+    auto cnt = static_cast<ActionResponseStreamer*>(cls)->read(buf, max);
+    return cnt == 0 ? MHD_CONTENT_READER_END_OF_STREAM : static_cast<ssize_t>(cnt);
+}
+
+static void streamed_response_free(void *cls)
+{
+    delete static_cast<ActionResponseStreamer*>(cls);
+}
+
+/* Sends the SOAP action response, with arguments produced while sending. */
+static void send_streamed_action_response(
+    MHDTransaction *mhdt, soap_devserv_t *soap_info, const std::vector<UpnpStreamedArg>& args)
+{
+    UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__,
+               "Action Response: streaming %d arguments\n", static_cast<int>(args.size()));
+    auto streamer = new ActionResponseStreamer(
+        soap_info->action_name, soap_info->service_type, args);
+    mhdt->response = http_create_callback_response(
+        mhdt, 32 * 1024, streamed_response_reader, streamer, streamed_response_free);
+    if (nullptr == mhdt->response) {
+        delete streamer;
+        return;
+    }
+    MHD_add_response_header(mhdt->response, "Content-Type", R"(text/xml; charset="utf-8")");
+    MHD_add_response_header(
+        mhdt->response, "SERVER", get_sdk_device_info(soap_info->productversion).c_str());
+    mhdt->httpstatus = 200;
+}
 
-/* The original code performed a few consistency checks on the action xml
-   - Checked the soap namespace against SOAP_URN = "http:/""/schemas.xmlsoap.org/soap/envelope/";
-   - Checked the "Body" elt name
-   - Checked that the action node namespace uri matched the service type from the SOAPACTION header
-   - Checked that the action node local name matched the action name from the SOAPACTION header.
-   - Other checks for a var request. We don't support this any more.
-  As we're not in the business of checking conformity, we did not reproduce the tests for now.
-*/
-class UPnPActionRequestParser : public XMLPARSERTP {
+#ifdef USE_EXPAT
+/* Parses an action request while its body arrives, for UPNP_FLAG_STREAM_ACTION_REQUESTS */
+class ActionBodyParser : public MHDBodyConsumer {
 public:
-    UPnPActionRequestParser(
-        // XML to be parsed
-        const std::string& input,
-        // The action name is the XML element name for the argument
-        // elements parent element.
-        const std::string& actname,
-        // Output: action arguments
-        std::vector<std::pair<std::string, std::string>>& args,
-        bool isresponse)
-        : XMLPARSERTP(input), m_actname(actname), m_args(args),
-          m_isresp(isresponse) { }
-
-    // On output, and only if we are parsing the action (not a
-    // response): XML sub-document, stripping the top <Envelope> and
-    // <Body> tags, because this is what upnp used to send in the ixml
-    // tree. This is just to ease the transition.
-    std::string outxml;
+    explicit ActionBodyParser(std::string actname)
+        : m_actname(std::move(actname)), m_parser(s_noinput, m_actname, args, false) {}
 
-protected:
-    void StartElement(const XML_Char *name, const XML_Char**) override {
-        if (!m_isresp && m_path.size() >= 3) {
-            outxml += std::string("<") + name + ">";
-        }
+    void data(const char *buf, size_t len) override {
+        if (m_ok)
+            m_ok = m_parser.ParseChunk(buf, len, false);
     }
-    void EndElement(const XML_Char *name) override {
-        const std::string& parentname = (m_path.size() == 1) ?
-            "root" : m_path[m_path.size()-2].name;
-        trimstring(m_chardata, " \t\n\r");
-        if (!dom_cmp_name(parentname, m_actname)) {
-            m_args.emplace_back(name, m_chardata);
-        }
-        if (!m_isresp && m_path.size() >= 3) {
-            outxml += xmlQuote(m_chardata);
-            outxml += std::string("</") + name + ">";
-        }
-        m_chardata.clear();
+    /* Call at the end of the body. On success, args and outxml hold the results */
+    bool finish() {
+        if (m_ok)
+            m_ok = m_parser.ParseChunk("", 0, true);
+        if (m_ok)
+            outxml.swap(m_parser.outxml);
+        return m_ok;
     }
-
-    void CharacterData(const XML_Char *s, int len) override {
-        if (s == nullptr || *s == 0)
-            return;
-        m_chardata.append(s, len);
+    std::string getLastErrorMessage() const {
+        return m_parser.getLastErrorMessage();
     }
 
+    std::vector<std::pair<std::string, std::string>> args;
+    std::string outxml;
 private:
-    const std::string& m_actname;
-    std::string m_chardata;
-    std::vector<std::pair<std::string, std::string>>& m_args;
-    bool m_isresp;
+    static inline const std::string s_noinput;
+    std::string m_actname;
+    bool m_ok{true};
+    UPnPActionRequestParser m_parser;
 };
+#endif /* USE_EXPAT */
 
 /*!
- * \brief Handles the SOAP action request.
+ * \brief Sends the response or the error, from the values returned by the
+ * application for the action, either by the callback or UpnpCompleteAction().
  */
-static void handle_invoke_action(
-    MHDTransaction *mhdt, soap_devserv_t *soap_info, const std::string& xml,
-    const std::vector<std::pair<std::string, std::string> >& actargs)
+static void send_action_result(
+    MHDTransaction *mhdt, soap_devserv_t *soap_info, int ret,
+    const Upnp_Action_Request& action)
 {
-    struct Upnp_Action_Request action;
     int err_code;
     const char *err_str = "";
 
-    action.ErrCode = UPNP_E_SUCCESS;
-    action.ErrStr[0] = 0;
-    upnp_strlcpy(action.ActionName, soap_info->action_name, NAME_SIZE);
-    upnp_strlcpy(action.DevUDN, soap_info->dev_udn, NAME_SIZE);
-    upnp_strlcpy(action.ServiceID, soap_info->service_id, NAME_SIZE);
-    action.xmlAction = xml;
-    action.args = actargs;
-    mhdt->copyClientAddress(&action.CtrlPtIPAddr);
-    mhdt->copyHeader("user-agent", action.Os);
-
-    int ret = soap_info->callback(UPNP_CONTROL_ACTION_REQUEST, &action, soap_info->cookie);
     if (ret != UPNP_E_SUCCESS) {
         UpnpPrintf(UPNP_DEBUG, SOAP, __FILE__, __LINE__,
                    "Action callback failed. ret %d errcode %d errstr [%s]\n",
@@ -266,6 +263,8 @@ static void handle_invoke_action(
             goto error_handler;
         }
         send_action_response(mhdt, soap_info, args);
+    } else if (!action.resstream.empty()) {
+        send_streamed_action_response(mhdt, soap_info, action.resstream);
     } else {
         // Got argument vector from client.
         send_action_response(mhdt, soap_info, action.resdata);
@@ -277,34 +276,170 @@ error_handler:
         send_error_response(mhdt, err_code, err_str, soap_info->productversion);
 }
 
+/* Argument views for the documents which soap_scan_action_args() does not
+   handle: the full parser output replaces the request body, which is not
+   needed any more. */
+static bool parse_action_args_views(
+    std::string& body, const std::string& actname, std::string_view& actxml,
+    std::vector<std::pair<std::string_view, std::string_view>>& argviews)
+{
+    std::vector<std::pair<std::string, std::string>> args;
+    std::string outxml;
+    {
+        UPnPActionRequestParser parser(body, actname, args, false);
+        if (!parser.Parse())
+            return false;
+        outxml.swap(parser.outxml);
+    }
+    body.swap(outxml);
+    size_t pos = body.size();
+    for (const auto& [name, value] : args) {
+        body += name;
+        body += value;
+    }
+    actxml = std::string_view(body.data(), pos);
+    argviews.reserve(args.size());
+    for (const auto& [name, value] : args) {
+        argviews.emplace_back(std::string_view(body.data() + pos, name.size()),
+                              std::string_view(body.data() + pos + name.size(), value.size()));
+        pos += name.size() + value.size();
+    }
+    return true;
+}
+
+/*!
+ * \brief Handles the SOAP action request.
+ */
+static void handle_invoke_action(
+    MHDTransaction *mhdt, soap_devserv_t *soap_info, Upnp_Action_Request& action,
+    std::string_view actqname, std::string_view actxml)
+{
+    action.ErrCode = UPNP_E_SUCCESS;
+    action.ErrStr[0] = 0;
+    upnp_strlcpy(action.ActionName, soap_info->action_name, NAME_SIZE);
+    upnp_strlcpy(action.DevUDN, soap_info->dev_udn, NAME_SIZE);
+    upnp_strlcpy(action.ServiceID, soap_info->service_id, NAME_SIZE);
+    mhdt->copyClientAddress(&action.CtrlPtIPAddr);
+    mhdt->copyHeader("user-agent", action.Os);
+
+    soap_action_ctx_t ctx{&action, mhdt, soap_info, actqname, actxml};
+    auto savedctx = tl_action_ctx;
+    tl_action_ctx = &ctx;
+    int ret = soap_info->callback(UPNP_CONTROL_ACTION_REQUEST, &action, soap_info->cookie);
+    tl_action_ctx = savedctx;
+    if (ctx.deferred) {
+        UpnpPrintf(UPNP_DEBUG, SOAP, __FILE__, __LINE__,
+                   "Action %s deferred by the application\n", action.ActionName);
+        return;
+    }
+    send_action_result(mhdt, soap_info, ret, action);
+}
+
+int soap_defer_action(Upnp_Action_Request *request, UpnpDeferredAction *handle)
+{
+    auto ctx = tl_action_ctx;
+    if (nullptr == ctx || ctx->action != request || ctx->deferred) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    ctx->deferred = new UpnpDeferredAction_s{*ctx->soap_info, miniServerDefer(ctx->mhdt), {}};
+    if (!request->argviews.empty()) {
+        // Repoint the views to our copy, which lives until UpnpCompleteAction(). Reserve first
+        // so that the buffer does not move.
+        auto& data = ctx->deferred->argdata;
+        size_t total = 0;
+        for (const auto& [name, value] : request->argviews) {
+            total += name.size() + value.size();
+        }
+        data.reserve(total);
+        for (auto& [name, value] : request->argviews) {
+            auto pos = data.size();
+            data += name;
+            data += value;
+            name = std::string_view(data.data() + pos, name.size());
+            value = std::string_view(data.data() + pos + name.size(), value.size());
+        }
+    }
+    *handle = ctx->deferred;
+    return UPNP_E_SUCCESS;
+}
+
+int soap_get_action_xml(const Upnp_Action_Request *request, std::string& xml)
+{
+    auto ctx = tl_action_ctx;
+    if (nullptr == ctx || ctx->action != request) {
+        return UPNP_E_INVALID_PARAM;
+    }
+    if (!(g_optionFlags & UPNP_FLAG_ACTION_ARG_VIEWS)) {
+        xml = request->xmlAction;
+    } else if (!ctx->actxml.empty()) {
+        xml = ctx->actxml;
+    } else {
+        // Same format as UPnPActionRequestParser::outxml
+        xml = "<";
+        xml += ctx->actqname;
+        xml += ">";
+        for (const auto& [name, value] : request->argviews) {
+            xml += "<";
+            xml += name;
+            xml += ">";
+            xmlQuoteAppend(xml, value);
+            xml += "</";
+            xml += name;
+            xml += ">";
+        }
+        xml += "</";
+        xml += ctx->actqname;
+        xml += ">";
+    }
+    return UPNP_E_SUCCESS;
+}
+
+int soap_complete_action(UpnpDeferredAction handle, int status, const Upnp_Action_Request *result)
+{
+    std::unique_ptr<UpnpDeferredAction_s> deferred(handle);
+    bool sent = miniServerCompleteDeferred(
+        deferred->response, [&](MHDTransaction *mhdt) {
+            send_action_result(mhdt, &deferred->soap_info, status, *result);
+        });
+    if (!sent) {
+        UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__,
+                   "Deferred action %s: connection closed\n",
+                   deferred->soap_info.action_name.c_str());
+        return UPNP_E_SOCKET_ERROR;
+    }
+    return UPNP_E_SUCCESS;
+}
+
 /*!
  * \brief Retrieve SOAP device/service information associated
  * with request-URI, which includes the callback function to hand-over
  * the request to the device application.
  *
+ * This uses the service index and does not need the handle lock.
+ *
  * \return 0 if OK, -1 on error.
  */
 static int get_dev_service(const MHDTransaction *mhdt, soap_devserv_t *soap_info)
 {
-    struct Handle_Info *hdlinfo;
-    int device_hnd;
-    service_info *serv_info;
-
-    HANDLELOCK();
-
-    auto hdltp = GetDeviceHandleInfoForPath(mhdt->url, &device_hnd, &hdlinfo, &serv_info);
-
-    if (hdltp != HND_DEVICE || nullptr == serv_info) {
-        UpnpPrintf(UPNP_ERROR, SOAP, __FILE__, __LINE__, "get_dev_service: client not found.\n");
-        return -1;
+    auto routes = GetServiceRoutes();
+    auto key = ServiceRouteKey(mhdt->url);
+    auto it = routes->control.find(key);
+    if (it == routes->control.end()) {
+        it = routes->event.find(key);
+        if (it == routes->event.end()) {
+            UpnpPrintf(UPNP_ERROR, SOAP, __FILE__, __LINE__,
+                       "get_dev_service: client not found.\n");
+            return -1;
+        }
     }
-
-    upnp_strlcpy(soap_info->dev_udn, serv_info->UDN, NAME_SIZE);
-    upnp_strlcpy(soap_info->service_type, serv_info->serviceType, NAME_SIZE);
-    upnp_strlcpy(soap_info->service_id, serv_info->serviceId, NAME_SIZE);
-    soap_info->callback = hdlinfo->Callback;
-    soap_info->cookie = hdlinfo->Cookie;
-    soap_info->productversion = hdlinfo->productversion;
+    const auto& route = *it->second;
+    upnp_strlcpy(soap_info->dev_udn, route.UDN, NAME_SIZE);
+    upnp_strlcpy(soap_info->service_type, route.serviceType, NAME_SIZE);
+    upnp_strlcpy(soap_info->service_id, route.serviceId, NAME_SIZE);
+    soap_info->service_type_base_len = route.serviceTypeBaseLen;
+    soap_info->callback = route.callback;
+    soap_info->cookie = route.cookie;
+    soap_info->productversion = route.productversion;
     return 0;
 }
 
@@ -345,7 +480,8 @@ static int get_mpost_acton_hdrval(MHDTransaction *mhdt, std::string& val)
 static int check_soapaction_hdr(MHDTransaction *mhdt, soap_devserv_t *soap_info)
 {
     int ret_code;
-    std::string header;
+    std::string mpostheader;
+    std::string_view header;
     /* find SOAPACTION header */
     if (SOAPMETHOD_POST == mhdt->method) {
         auto it = mhdt->headers.find("soapaction");
@@ -354,18 +490,19 @@ static int check_soapaction_hdr(MHDTransaction *mhdt, soap_devserv_t *soap_info)
         header = it->second;
     } else {
         /* Note that M-POST is deprecated */
-        ret_code = get_mpost_acton_hdrval(mhdt, header);
+        ret_code = get_mpost_acton_hdrval(mhdt, mpostheader);
         if (ret_code != UPNP_E_SUCCESS) {
             return ret_code;
         }
+        header = mpostheader;
     }
 
     /* error by default */
     ret_code = SREQ_BAD_HDR_FORMAT;
 
     /* The header value is something like: "urn:av-open...:Playlist:1#Id" */
-    std::string::size_type hash_pos = header.find('#');
-    if (hash_pos == std::string::npos) {
+    auto hash_pos = header.find('#');
+    if (hash_pos == std::string_view::npos) {
         return ret_code;
     }
 
@@ -374,11 +511,11 @@ static int check_soapaction_hdr(MHDTransaction *mhdt, soap_devserv_t *soap_info)
     // ending double quote.
     // We are now even more lenient (following the pupnp lead, they made the same change), and
     // accept an unquoted value,
-    std::string::size_type startadjust{1};
+    size_t startadjust{1};
     if (header[0] != '"') {
         startadjust = 0;
     }
-    std::string::size_type endadjust{1};
+    size_t endadjust{1};
     if (header.back() != '"') {
         endadjust = 0;
     }
@@ -389,20 +526,17 @@ static int check_soapaction_hdr(MHDTransaction *mhdt, soap_devserv_t *soap_info)
     /* Service type: between start or double quote, and hash */
     auto serv_type = header.substr(startadjust, hash_pos - startadjust);
 
-    /* Check service type */
+    /* Check service type. The base length for our service was computed when
+       the service index was built. */
     auto cp1_diff = serv_type.rfind(':');
-    if (std::string::npos == cp1_diff) {
+    if (std::string_view::npos == cp1_diff) {
         return ret_code;
     }
-    const char *col_pos2 = std::strrchr(soap_info->service_type, ':');
-    /* XXX: this should be checked when service list is generated */
-    assert(col_pos2 != nullptr);
-    size_t cp2_diff = col_pos2 - soap_info->service_type;
-    if (cp2_diff == cp1_diff &&
-        strncmp(soap_info->service_type, serv_type.c_str(), cp1_diff) == 0) {
+    if (soap_info->service_type_base_len == cp1_diff &&
+        serv_type.compare(0, cp1_diff, soap_info->service_type, cp1_diff) == 0) {
         /* for action invocation, update the version information */
-        upnp_strlcpy(soap_info->service_type, serv_type, NAME_SIZE);
-    } else if (strcmp(serv_type.c_str(), QUERY_STATE_VAR_URN) == 0 &&
+        upnp_strlcpy(soap_info->service_type, std::string(serv_type), NAME_SIZE);
+    } else if (serv_type == QUERY_STATE_VAR_URN &&
                soap_info->action_name == "QueryStateVariable") {
         /* query variable */
         soap_info->action_name.clear();
@@ -414,6 +548,30 @@ static int check_soapaction_hdr(MHDTransaction *mhdt, soap_devserv_t *soap_info)
 }
 
 
+#ifdef USE_EXPAT
+std::unique_ptr<MHDBodyConsumer> soap_device_body_start(MHDTransaction *mhdt)
+{
+    if (!(g_optionFlags & UPNP_FLAG_STREAM_ACTION_REQUESTS) ||
+        (g_optionFlags & UPNP_FLAG_ACTION_ARG_VIEWS)) {
+        return nullptr;
+    }
+    // Any error in the headers is reported by soap_device_callback() when the
+    // body is complete.
+    soap_devserv_t soap_info;
+    if (get_dev_service(mhdt, &soap_info) < 0 ||
+        check_soapaction_hdr(mhdt, &soap_info) != UPNP_E_SUCCESS ||
+        soap_info.action_name.empty()) {
+        return nullptr;
+    }
+    return std::make_unique<ActionBodyParser>(soap_info.action_name);
+}
+#else
+std::unique_ptr<MHDBodyConsumer> soap_device_body_start(MHDTransaction *)
+{
+    return nullptr;
+}
+#endif /* USE_EXPAT */
+
 /*!
  * \brief This is a callback called by miniserver after receiving the request
  * from the control point. After HTTP processing, it calls handle_soap_request
@@ -424,8 +582,9 @@ void soap_device_callback(MHDTransaction *mhdt)
     int err_code;
     const char *err_str = "";
     soap_devserv_t soap_info;
-    std::vector<std::pair<std::string, std::string>> args;
-    std::string strippedxml;
+    Upnp_Action_Request action;
+    std::string_view actqname;
+    std::string_view actxml;
     UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__, "Action POST data: [%s]\n",
                mhdt->postdata.c_str());
     
@@ -466,12 +625,43 @@ void soap_device_callback(MHDTransaction *mhdt)
         goto error_handler;
     }
 
-    {
+    if (mhdt->bodyconsumer) {
+#ifdef USE_EXPAT
+        // The request was parsed while it arrived
+        auto parser = static_cast<ActionBodyParser*>(mhdt->bodyconsumer.get());
+        if (!parser->finish()) {
+            UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__, "XML parse failed: %s\n",
+                       parser->getLastErrorMessage().c_str());
+            err_code = SOAP_INVALID_ACTION;
+            err_str = Soap_Invalid_Action;
+            goto error_handler;
+        }
+        action.args.swap(parser->args);
+        action.xmlAction.swap(parser->outxml);
+#endif /* USE_EXPAT */
+    } else if (g_optionFlags & UPNP_FLAG_ACTION_ARG_VIEWS) {
+        // Arguments as views into the (possibly modified) request body. The
+        // XML subdocument is only built if the application asks for it.
+        if (!soap_scan_action_args(
+                mhdt->postdata, soap_info.action_name, actqname, action.argviews)) {
+            UpnpPrintf(UPNP_DEBUG, SOAP, __FILE__, __LINE__,
+                       "Using the full XML parser for the arguments\n");
+            if (!parse_action_args_views(
+                    mhdt->postdata, soap_info.action_name, actxml, action.argviews)) {
+                UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__,
+                           "XML parse failed for [%s]\n", mhdt->postdata.c_str());
+                err_code = SOAP_INVALID_ACTION;
+                err_str = Soap_Invalid_Action;
+                goto error_handler;
+            }
+        }
+    } else {
         // soap_info.action_name was computed from the SOAPACTION
         // header The parser will produce both argument vectors and an
         // XML subdocument matching the subtree which libupnp would
         // have sent (transition help).
-        UPnPActionRequestParser parser(mhdt->postdata, soap_info.action_name, args, false);
+        UPnPActionRequestParser parser(
+            mhdt->postdata, soap_info.action_name, action.args, false);
         if (!parser.Parse()) {
             UpnpPrintf(UPNP_INFO, SOAP, __FILE__, __LINE__,
                        "XML parse failed for [%s]\n", mhdt->postdata.c_str());
@@ -479,14 +669,11 @@ void soap_device_callback(MHDTransaction *mhdt)
             err_str = Soap_Invalid_Action;
             goto error_handler;
         }
-        strippedxml = parser.outxml;
+        action.xmlAction.swap(parser.outxml);
     }
 
     /* invoke action */
-    handle_invoke_action(mhdt, &soap_info, strippedxml, args);
-
-    if (mhdt->response)
-        MHD_add_response_header(mhdt->response, "Content-Type", R"(text/xml; charset="utf-8")");
+    handle_invoke_action(mhdt, &soap_info, action, actqname, actxml);
 
 error_handler:
     // productversion could be empty here, in which case we will send the lib
@@ -0,0 +1,497 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2026 J.F. Dockes
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#include "soap_message.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "genut.h"
+#include "utf8iter.h"
+
+/* Value of the entity or character reference following a '&', or -1 if expat would reject
+   it. *reflen is set to the reference length, including the ';'. */
+static long xml_ref_value(std::string_view ref, size_t *reflen)
+{
+    static const struct {std::string_view name; char c;} entities[] {
+        {"lt", '<'}, {"gt", '>'}, {"amp", '&'}, {"quot", '"'}, {"apos", '\''}};
+    auto semi = ref.find(';');
+    if (semi == std::string_view::npos)
+        return -1;
+    *reflen = semi + 1;
+    auto name = ref.substr(0, semi);
+    if (name.empty() || name[0] != '#') {
+        for (const auto& ent : entities) {
+            if (name == ent.name)
+                return ent.c;
+        }
+        // Unknown entity: there is no DTD to define it
+        return -1;
+    }
+    bool hex = name.size() > 1 && name[1] == 'x';
+    auto digits = name.substr(hex ? 2 : 1);
+    if (digits.empty())
+        return -1;
+    unsigned long cp{0};
+    for (auto c : digits) {
+        int d;
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if (hex && c >= 'a' && c <= 'f')
+            d = c - 'a' + 10;
+        else if (hex && c >= 'A' && c <= 'F')
+            d = c - 'A' + 10;
+        else
+            return -1;
+        cp = cp * (hex ? 16 : 10) + d;
+        if (cp > 0x10FFFF)
+            return -1;
+    }
+    // The XML Char production: no surrogates, no 0xFFFE/0xFFFF, no control characters
+    if (!(cp == 0x9 || cp == 0xA || cp == 0xD || (cp >= 0x20 && cp <= 0xD7FF) ||
+          (cp >= 0xE000 && cp <= 0xFFFD) || cp >= 0x10000))
+        return -1;
+    return static_cast<long>(cp);
+}
+
+/* Decode the XML references in a character data span, and normalize the line ends, in place.
+   The output is never longer than the input. With a null output, only check the data.
+   Returns false for anything which expat would reject, in which case the output is
+   incomplete. */
+static bool xml_unquote_inplace(char *s, size_t len, size_t *outlen)
+{
+    const bool check = nullptr == outlen;
+    size_t in{0}, out{0};
+    while (in < len) {
+        auto c = static_cast<unsigned char>(s[in]);
+        if (c == '&') {
+            size_t reflen;
+            long cp = xml_ref_value(std::string_view(s + in + 1, len - in - 1), &reflen);
+            if (cp < 0)
+                return false;
+            in += 1 + reflen;
+            if (check)
+                continue;
+            // The reference is at least 4 characters long, and longer than the UTF-8 encoding
+            if (cp < 0x80) {
+                s[out++] = static_cast<char>(cp);
+            } else if (cp < 0x800) {
+                s[out++] = static_cast<char>(0xC0 | (cp >> 6));
+                s[out++] = static_cast<char>(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                s[out++] = static_cast<char>(0xE0 | (cp >> 12));
+                s[out++] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                s[out++] = static_cast<char>(0x80 | (cp & 0x3F));
+            } else {
+                s[out++] = static_cast<char>(0xF0 | (cp >> 18));
+                s[out++] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                s[out++] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                s[out++] = static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            continue;
+        }
+        if (c < 0x20 && c != '\t' && c != '\n' && c != '\r')
+            return false;
+        if (c == ']' && std::string_view(s + in, len - in).substr(0, 3) == "]]>")
+            return false;
+        in++;
+        if (check)
+            continue;
+        if (c == '\r') {
+            // CR LF and lone CR become LF
+            if (in < len && s[in] == '\n')
+                in++;
+            c = '\n';
+        }
+        s[out++] = static_cast<char>(c);
+    }
+    if (outlen)
+        *outlen = out;
+    return true;
+}
+
+static bool xml_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* Length of the XML name at the start of s, or 0. Only ASCII names are recognized: the
+   documents with other names go to the full parser. */
+static size_t xml_name_len(std::string_view s)
+{
+    size_t i{0};
+    for (; i < s.size(); i++) {
+        char c = s[i];
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':')
+            continue;
+        if (i > 0 && ((c >= '0' && c <= '9') || c == '-' || c == '.'))
+            continue;
+        break;
+    }
+    return i;
+}
+
+/* Comment contents: no control characters. */
+static bool xml_check_chars(std::string_view s)
+{
+    for (auto c : s) {
+        if (static_cast<unsigned char>(c) < 0x20 && !xml_is_space(c))
+            return false;
+    }
+    return true;
+}
+
+/* Get the next attribute in the part of a tag which follows the element name. Returns 1 and
+   sets name and value (still quoted), 0 at the end, -1 for a syntax error. */
+static int xml_next_attr(std::string_view s, size_t& pos, std::string_view& name,
+                         std::string_view& value)
+{
+    auto start = pos;
+    while (pos < s.size() && xml_is_space(s[pos]))
+        pos++;
+    if (pos == s.size())
+        return 0;
+    // The attributes are separated from the name and from each other by white space
+    if (pos == start)
+        return -1;
+    auto nmlen = xml_name_len(s.substr(pos));
+    if (nmlen == 0)
+        return -1;
+    name = s.substr(pos, nmlen);
+    pos += nmlen;
+    while (pos < s.size() && xml_is_space(s[pos]))
+        pos++;
+    if (pos == s.size() || s[pos] != '=')
+        return -1;
+    pos++;
+    while (pos < s.size() && xml_is_space(s[pos]))
+        pos++;
+    if (pos == s.size() || (s[pos] != '"' && s[pos] != '\''))
+        return -1;
+    auto end = s.find(s[pos], pos + 1);
+    if (end == std::string_view::npos)
+        return -1;
+    value = s.substr(pos + 1, end - pos - 1);
+    pos = end + 1;
+    return 1;
+}
+
+/* Check the attributes of a start tag, from after the name to before the '>' or '/>'. */
+static bool xml_check_attrs(char *s, size_t len)
+{
+    const std::string_view attrs(s, len);
+    // More attributes than this go to the full parser.
+    std::array<std::string_view, 8> names;
+    size_t cnt{0};
+    size_t pos{0};
+    std::string_view name, value;
+    int ret;
+    while ((ret = xml_next_attr(attrs, pos, name, value)) == 1) {
+        if (cnt == names.size())
+            return false;
+        for (size_t i = 0; i < cnt; i++) {
+            if (names[i] == name)
+                return false;
+        }
+        names[cnt++] = name;
+        if (value.find('<') != std::string_view::npos ||
+            !xml_unquote_inplace(s + (value.data() - attrs.data()), value.size(), nullptr))
+            return false;
+    }
+    return ret == 0;
+}
+
+/* Check the XML declaration, between "<?xml" and "?>". Only UTF-8 is accepted. */
+static bool xml_check_decl(std::string_view decl)
+{
+    static const std::string_view pseudoattrs[] {"version", "encoding", "standalone"};
+    // Index of the next allowed pseudo-attribute: they must appear in order, version first.
+    size_t next{0};
+    size_t pos{0};
+    std::string_view name, value;
+    int ret;
+    while ((ret = xml_next_attr(decl, pos, name, value)) == 1) {
+        size_t i = next;
+        while (i < 3 && name != pseudoattrs[i])
+            i++;
+        if (i == 3 || (next == 0 && i != 0))
+            return false;
+        next = i + 1;
+        switch (i) {
+        case 0:
+            if (value != "1.0")
+                return false;
+            break;
+        case 1:
+        {
+            // "utf-8" in any case
+            std::string enc(value);
+            for (auto& c : enc) {
+                if (c >= 'A' && c <= 'Z')
+                    c += 'a' - 'A';
+            }
+            if (enc != "utf-8")
+                return false;
+        }
+        break;
+        default:
+            if (value != "yes" && value != "no")
+                return false;
+        }
+    }
+    return ret == 0 && next > 0;
+}
+
+bool soap_scan_action_args(
+    std::string& body, const std::string& actname, std::string_view& actqname,
+    std::vector<std::pair<std::string_view, std::string_view>>& args)
+{
+    struct span {
+        std::string_view name;
+        size_t start;
+        size_t len;
+    };
+    std::vector<span> spans;
+    spans.reserve(16);
+    const std::string_view doc(body);
+    // Names of the open elements. Anything deeper than the arguments goes to the full parser.
+    std::array<std::string_view, 4> open;
+    size_t depth{0};
+    bool seenroot{false};
+    bool inbody{false};
+    bool inaction{false};
+    bool inarg{false};
+    bool complete{false};
+    size_t pos{0};
+    // The declaration must be at the very start. Other processing instructions are left to the
+    // full parser.
+    if (doc.substr(0, 5) == "<?xml" && doc.size() > 5 && xml_is_space(doc[5])) {
+        auto end = doc.find("?>");
+        if (end == std::string_view::npos || !xml_check_decl(doc.substr(5, end - 5)))
+            return false;
+        pos = end + 2;
+    }
+    for (;;) {
+        auto lt = doc.find('<', pos);
+        // Character data. The argument values are checked after trimming, below.
+        if (!inarg) {
+            auto len = (lt == std::string_view::npos ? doc.size() : lt) - pos;
+            if (depth == 0) {
+                if (doc.substr(pos, len).find_first_not_of(" \t\n\r") != std::string_view::npos)
+                    return false;
+            } else if (!xml_unquote_inplace(body.data() + pos, len, nullptr)) {
+                return false;
+            }
+        }
+        if (lt == std::string_view::npos)
+            break;
+        pos = lt;
+        if (pos + 1 >= doc.size())
+            return false;
+        char c = doc[pos+1];
+        if (c == '?') {
+            return false;
+        }
+        if (c == '!') {
+            // Comments only: no CDATA or DOCTYPE
+            if (inarg || doc.substr(pos, 4) != "<!--")
+                return false;
+            auto end = doc.find("--", pos + 4);
+            if (end == std::string_view::npos || doc.substr(end, 3) != "-->" ||
+                !xml_check_chars(doc.substr(pos + 4, end - pos - 4)))
+                return false;
+            pos = end + 3;
+            continue;
+        }
+        if (c == '/') {
+            auto nmlen = xml_name_len(doc.substr(pos + 2));
+            auto end = doc.find('>', pos + 2 + nmlen);
+            if (depth == 0 || end == std::string_view::npos ||
+                doc.substr(pos + 2, nmlen) != open[depth-1])
+                return false;
+            for (auto i = pos + 2 + nmlen; i < end; i++) {
+                if (!xml_is_space(doc[i]))
+                    return false;
+            }
+            depth--;
+            if (inarg && depth == 3) {
+                spans.back().len = pos - spans.back().start;
+                inarg = false;
+            } else if (inaction && depth == 2) {
+                complete = true;
+            } else if (depth == 1) {
+                inbody = false;
+            }
+            pos = end + 1;
+            continue;
+        }
+        auto nmlen = xml_name_len(doc.substr(pos + 1));
+        if (nmlen == 0)
+            return false;
+        auto name = doc.substr(pos + 1, nmlen);
+        // Tag end, skipping quoted attribute values
+        size_t end = pos + 1 + nmlen;
+        char quote = 0;
+        for (; end < doc.size(); end++) {
+            if (quote) {
+                if (doc[end] == quote)
+                    quote = 0;
+            } else if (doc[end] == '"' || doc[end] == '\'') {
+                quote = doc[end];
+            } else if (doc[end] == '>') {
+                break;
+            }
+        }
+        if (end == doc.size())
+            return false;
+        bool selfclose = doc[end-1] == '/';
+        auto attrstart = pos + 1 + nmlen;
+        if (!xml_check_attrs(body.data() + attrstart, (selfclose ? end - 1 : end) - attrstart))
+            return false;
+        if (depth == 0) {
+            if (seenroot)
+                return false;
+            seenroot = true;
+        } else if (depth == 1) {
+            inbody = !dom_cmp_name(name, "Body");
+        } else if (depth == 2) {
+            // Anything else than the action (e.g. SOAP header contents)
+            // would be part of xmlAction: let the full parser do it.
+            if (!inbody || inaction || dom_cmp_name(name, actname))
+                return false;
+            inaction = true;
+            actqname = name;
+            complete = selfclose;
+        } else if (depth == 3) {
+            // Keep the name, the content span is completed at the end tag
+            spans.push_back({name, end + 1, 0});
+            inarg = !selfclose;
+        } else {
+            return false;
+        }
+        if (!selfclose)
+            open[depth++] = name;
+        pos = end + 1;
+    }
+    if (depth != 0 || !complete)
+        return false;
+
+    // Trim as the full parser does. Check all the values before modifying anything, so that
+    // the full parser gets the original body if something is wrong. It will then fail the
+    // same way expat does.
+    for (auto& sp : spans) {
+        auto val = doc.substr(sp.start, sp.len);
+        auto first = val.find_first_not_of(" \t\n\r");
+        if (first == std::string_view::npos) {
+            sp.len = 0;
+            continue;
+        }
+        sp.start += first;
+        sp.len = val.find_last_not_of(" \t\n\r") - first + 1;
+        if (!xml_unquote_inplace(body.data() + sp.start, sp.len, nullptr))
+            return false;
+    }
+    if (utf8check(body) < 0)
+        return false;
+
+    args.reserve(spans.size());
+    for (const auto& sp : spans) {
+        auto data = body.data() + sp.start;
+        size_t len{0};
+        if (sp.len)
+            xml_unquote_inplace(data, sp.len, &len);
+        args.emplace_back(sp.name, std::string_view(data, len));
+    }
+    return true;
+}
+
+ActionResponseStreamer::ActionResponseStreamer(
+    std::string_view actname, std::string_view servicetype, std::vector<UpnpStreamedArg> args)
+    : m_args(std::move(args)), m_actname(actname)
+{
+    m_out = std::string(soap_response_prolog) + "<u:" + m_actname + "Response" +
+        R"( xmlns:u=")" + std::string(servicetype) + R"(">)" "\n";
+    m_state = m_args.empty() ? State::END : State::ARGOPEN;
+}
+
+size_t ActionResponseStreamer::read(char *buf, size_t max)
+{
+    size_t total{0};
+    while (total < max) {
+        if (m_outpos == m_out.size() && !refill())
+            break;
+        auto cnt = std::min(max - total, m_out.size() - m_outpos);
+        memcpy(buf + total, m_out.data() + m_outpos, cnt);
+        m_outpos += cnt;
+        total += cnt;
+    }
+    return total;
+}
+
+// Set m_out to the next piece of output, which may be empty. Returns false at the end.
+bool ActionResponseStreamer::refill()
+{
+    // Largest piece of raw data escaped at a time
+    static constexpr size_t slicesize{16 * 1024};
+    m_out.clear();
+    m_outpos = 0;
+    switch (m_state) {
+    case State::ARGOPEN:
+        m_out += "<" + m_args[m_argidx].name + ">";
+        m_state = State::ARGVALUE;
+        break;
+    case State::ARGVALUE:
+    {
+        auto& arg = m_args[m_argidx];
+        if (m_piece.empty()) {
+            if (!arg.value || !arg.value(m_piece)) {
+                m_out += "</" + arg.name + ">\n";
+                // Release the data as soon as possible
+                arg.value = nullptr;
+                m_state = ++m_argidx < m_args.size() ? State::ARGOPEN : State::END;
+                break;
+            }
+        }
+        auto slice = m_piece.substr(0, slicesize);
+        xmlQuoteAppend(m_out, slice);
+        m_piece.remove_prefix(slice.size());
+    }
+    break;
+    case State::END:
+        m_out += "</u:" + m_actname + "Response" + ">\n" + "</s:Body></s:Envelope>";
+        m_state = State::DONE;
+        break;
+    case State::DONE:
+        return false;
+    }
+    return true;
+}
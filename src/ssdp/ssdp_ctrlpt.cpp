@@ -52,20 +52,22 @@ nnn * Redistribution and use in source and binary forms, with or without
 
 /*! Structure to contain Discovery response. */
 struct ResultData {
-    explicit ResultData(Upnp_Discovery p, void* c, Upnp_FunPtr f) :
-        param(p), cookie(c), ctrlpt_callback(f) {}
+    explicit ResultData(Upnp_EventType t, Upnp_Discovery p, void* c, Upnp_FunPtr f) :
+        event_type(t), param(p), cookie(c), ctrlpt_callback(f) {}
+    Upnp_EventType event_type;
     struct Upnp_Discovery param;
     void *cookie;
     Upnp_FunPtr ctrlpt_callback;
 };
 
-/** Calls back the control point application with a search result. */
-class SearchResultJobWorker : public JobWorker {
+/** Calls back the control point application with a search result or advertisement. Runs in
+ *  the callback pool, so that the application does not delay the SSDP processing. */
+class DiscoveryCallbackJobWorker : public JobWorker {
 public:
-    explicit SearchResultJobWorker(std::unique_ptr<ResultData> res)
+    explicit DiscoveryCallbackJobWorker(std::unique_ptr<ResultData> res)
         : m_resultdata(std::move(res)) {}
     void work() override {
-        m_resultdata->ctrlpt_callback(UPNP_DISCOVERY_SEARCH_RESULT, &m_resultdata->param,
+        m_resultdata->ctrlpt_callback(m_resultdata->event_type, &m_resultdata->param,
                                       m_resultdata->cookie);
     }
     std::unique_ptr<ResultData> m_resultdata;
@@ -321,8 +323,11 @@ void ssdp_handle_ctrlpt_msg(SSDPPacketParser& parser, const struct sockaddr_stor
             }
             event_type = UPNP_DISCOVERY_ADVERTISEMENT_ALIVE;
         }
-        /* call callback */
-        ctrlpt_callback(event_type, &param, ctrlpt_cookie);
+        /* schedule call back */
+        auto threadData = std::make_unique<ResultData>(event_type, param, ctrlpt_cookie,
+                                                       ctrlpt_callback);
+        gCallbackThreadPool.addJob(std::make_unique<DiscoveryCallbackJobWorker>(
+                                       std::move(threadData)));
     } else {
         /* reply (to a SEARCH) */
         /* only checking to see if there is a valid ST header */
@@ -335,6 +340,8 @@ void ssdp_handle_ctrlpt_msg(SSDPPacketParser& parser, const struct sockaddr_stor
             strlen(param.Location) == 0 || !usn_found || !st_found) {
             return;    /* bad reply */
         }
+        /* The result callback jobs are queued together, after releasing the handle lock */
+        ThreadPool::JobBatch batch;
         {
             /* check each current search */
             HANDLELOCK();
@@ -372,13 +379,15 @@ void ssdp_handle_ctrlpt_msg(SSDPPacketParser& parser, const struct sockaddr_stor
                 }
                 if (matched) {
                     /* schedule call back */
-                    auto threadData = std::make_unique<ResultData>(param, searchArg.cookie,
-                                                                   ctrlpt_callback);
-                    auto worker = std::make_unique<SearchResultJobWorker>(std::move(threadData));
-                    gRecvThreadPool.addJob(std::move(worker));
+                    auto threadData = std::make_unique<ResultData>(
+                        UPNP_DISCOVERY_SEARCH_RESULT, param, searchArg.cookie, ctrlpt_callback);
+                    auto worker = std::make_unique<DiscoveryCallbackJobWorker>(
+                        std::move(threadData));
+                    batch.add(std::move(worker));
                 }
             }
         }
+        gCallbackThreadPool.addJobs(batch);
     }
 }
 
@@ -517,7 +526,8 @@ int SearchByTarget(int Mx, const char *St, const char *saddress, int port, void
         auto worker = std::make_unique<SearchExpiredJobWorker>(0);
         int *idp = &(worker->m_id);
         gTimerThread->schedule(TimerThread::SHORT_TERM, TimerThread::REL_SEC, Mx ? Mx + 1 : 2,
-                               idp, std::move(worker));
+                               idp, std::move(worker), ThreadPool::MED_PRIORITY,
+                               &gCallbackThreadPool);
         ctrlpt_info->SsdpSearchList.emplace_back(*idp, St, Cookie, requestType);
     }
 
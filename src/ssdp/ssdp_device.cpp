@@ -149,7 +149,9 @@ void ssdp_handle_device_request(const SSDPPacketParser& parser, struct sockaddr_
             int delayms = rand() % (mx * 1000 - 100);
             UpnpPrintf(UPNP_ALL, API, __FILE__, __LINE__,
                        "ssdp_handle_device_req: scheduling resp in %d ms\n", delayms);
-            gTimerThread->schedule(TimerThread::SHORT_TERM, std::chrono::milliseconds(delayms),
+            /* The reply must leave before MX expires */
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(mx);
+            gTimerThread->schedule(std::chrono::milliseconds(delayms), deadline,
                                    nullptr, std::move(worker));
         } else {
             gSendThreadPool.addJob(std::move(worker));
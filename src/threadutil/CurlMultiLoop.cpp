@@ -0,0 +1,254 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2026 J.F. Dockes
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#include "CurlMultiLoop.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Before curl 7.68 there is no curl_multi_poll()/curl_multi_wakeup(): use a short wait so that
+// new transfers get started.
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define HAVE_CURL_MULTI_POLL
+static const int maxPollWaitMs{60000};
+#else
+static const int maxPollWaitMs{50};
+#endif
+
+// The transfer identifiers are unique across loops, so that an identifier kept from a loop
+// which was replaced can't cancel a transfer in the new one.
+static std::atomic<uint64_t> nextTransferId{1};
+
+struct CurlTransfer {
+    CURL *easy;
+    std::function<void(CURLcode)> callback;
+    bool started{false};
+};
+
+// The loop job shares the loop data: the CurlMultiLoop may be deleted as soon as work() has
+// returned, while the pool may still call cancel().
+class CurlMultiLoopJobWorker : public JobWorker {
+public:
+    explicit CurlMultiLoopJobWorker(std::shared_ptr<CurlMultiLoop::Internal> parent)
+        : m_parent(std::move(parent)) {}
+    void work() override;
+    void cancel() override;
+    std::shared_ptr<CurlMultiLoop::Internal> m_parent;
+};
+
+class CurlMultiLoop::Internal {
+public:
+    Internal() = default;
+    ~Internal() {
+        if (multi) {
+            curl_multi_cleanup(multi);
+        }
+    }
+    void wakeup() {
+#ifdef HAVE_CURL_MULTI_POLL
+        curl_multi_wakeup(multi);
+#endif
+    }
+    std::mutex mutex;
+    std::condition_variable condition;
+    // Only used by the loop thread, except for curl_multi_wakeup() which is thread-safe.
+    CURLM *multi{nullptr};
+    // All the transfers which are not complete yet
+    std::unordered_map<uint64_t, CurlTransfer> transfers;
+    std::unordered_map<CURL*, uint64_t> handles;
+    // Requests for the loop thread
+    std::vector<uint64_t> toadd;
+    std::vector<uint64_t> tocancel;
+    bool running{false};
+    bool inshutdown{false};
+};
+
+using ReadyList = std::vector<std::pair<std::function<void(CURLcode)>, CURLcode>>;
+
+void CurlMultiLoopJobWorker::work()
+{
+    auto w = m_parent.get();
+    std::unique_lock<std::mutex> lck(w->mutex);
+    ReadyList ready;
+    std::vector<std::pair<CURL*, CURLcode>> done;
+
+    // Remove a transfer and queue its callback. Called with the lock held.
+    auto finish = [w, &ready](
+        std::unordered_map<uint64_t, CurlTransfer>::iterator it, CURLcode code) {
+        if (it->second.started) {
+            curl_multi_remove_handle(w->multi, it->second.easy);
+        }
+        w->handles.erase(it->second.easy);
+        ready.emplace_back(std::move(it->second.callback), code);
+        w->transfers.erase(it);
+    };
+
+    while (!w->inshutdown) {
+        for (auto id : w->toadd) {
+            auto it = w->transfers.find(id);
+            if (it == w->transfers.end())
+                continue;
+            if (curl_multi_add_handle(w->multi, it->second.easy) != CURLM_OK) {
+                finish(it, CURLE_FAILED_INIT);
+                continue;
+            }
+            it->second.started = true;
+        }
+        w->toadd.clear();
+        for (auto id : w->tocancel) {
+            auto it = w->transfers.find(id);
+            if (it != w->transfers.end())
+                finish(it, CURLE_ABORTED_BY_CALLBACK);
+        }
+        w->tocancel.clear();
+        lck.unlock();
+
+        for (auto& [cb, code] : ready)
+            cb(code);
+        ready.clear();
+
+        int stillrunning;
+        curl_multi_perform(w->multi, &stillrunning);
+        CURLMsg *msg;
+        int msgsleft;
+        while ((msg = curl_multi_info_read(w->multi, &msgsleft))) {
+            if (msg->msg == CURLMSG_DONE) {
+                done.emplace_back(msg->easy_handle, msg->data.result);
+            }
+        }
+        if (!done.empty()) {
+            lck.lock();
+            for (const auto& [easy, code] : done) {
+                auto hit = w->handles.find(easy);
+                if (hit != w->handles.end())
+                    finish(w->transfers.find(hit->second), code);
+            }
+            lck.unlock();
+            done.clear();
+            for (auto& [cb, code] : ready)
+                cb(code);
+            ready.clear();
+        }
+
+#ifdef HAVE_CURL_MULTI_POLL
+        curl_multi_poll(w->multi, nullptr, 0, maxPollWaitMs, nullptr);
+#else
+        curl_multi_wait(w->multi, nullptr, 0, maxPollWaitMs, nullptr);
+#endif
+        lck.lock();
+    }
+
+    // Shutting down: tell everybody
+    while (!w->transfers.empty()) {
+        finish(w->transfers.begin(), CURLE_ABORTED_BY_CALLBACK);
+    }
+    w->toadd.clear();
+    w->tocancel.clear();
+    w->running = false;
+    w->inshutdown = false;
+    w->condition.notify_all();
+    lck.unlock();
+    for (auto& [cb, code] : ready)
+        cb(code);
+}
+
+// Called by ThreadPool::shutdown() if the loop was not shut down first.
+void CurlMultiLoopJobWorker::cancel()
+{
+    std::scoped_lock lck(m_parent->mutex);
+    m_parent->inshutdown = true;
+    m_parent->wakeup();
+}
+
+CurlMultiLoop::CurlMultiLoop(ThreadPool *tp, const ThreadSchedAttr *sched)
+    : m(std::make_shared<Internal>())
+{
+    m->multi = curl_multi_init();
+    if (nullptr == m->multi) {
+        return;
+    }
+    m->running = true;
+    if (tp->addPersistent(std::make_unique<CurlMultiLoopJobWorker>(m),
+                          ThreadPool::HIGH_PRIORITY, sched) != 0) {
+        m->running = false;
+    }
+}
+
+CurlMultiLoop::~CurlMultiLoop()
+{
+    shutdown();
+}
+
+uint64_t CurlMultiLoop::add(CURL *easy, std::function<void(CURLcode)> callback)
+{
+    std::scoped_lock lck(m->mutex);
+    if (!m->running || m->inshutdown || m->handles.find(easy) != m->handles.end())
+        return 0;
+    auto id = nextTransferId++;
+    m->transfers[id] = CurlTransfer{easy, std::move(callback)};
+    m->handles[easy] = id;
+    m->toadd.push_back(id);
+    m->wakeup();
+    return id;
+}
+
+bool CurlMultiLoop::cancel(uint64_t id)
+{
+    std::scoped_lock lck(m->mutex);
+    if (m->transfers.find(id) == m->transfers.end())
+        return false;
+    m->tocancel.push_back(id);
+    m->wakeup();
+    return true;
+}
+
+bool CurlMultiLoop::running()
+{
+    std::scoped_lock lck(m->mutex);
+    return m->running && !m->inshutdown;
+}
+
+int CurlMultiLoop::shutdown()
+{
+    std::unique_lock<std::mutex> lck(m->mutex);
+    if (!m->running)
+        return 0;
+    m->inshutdown = true;
+    m->wakeup();
+    while (m->running) {
+        m->condition.wait(lck);
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2026 J.F. Dockes
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#include "SocketWatcher.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define poll WSAPoll
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace std::chrono;
+
+#ifdef _WIN32
+// No simple way to wake up WSAPoll(): use a short timeout so that new sockets get watched
+static const milliseconds maxPollWait{50};
+#else
+static const milliseconds maxPollWait{60000};
+#endif
+
+struct WatchedSocket {
+    SOCKET fd;
+    int events;
+    steady_clock::time_point deadline;
+    std::function<void(int)> callback;
+};
+
+class SocketWatcherJobWorker : public JobWorker {
+public:
+    explicit SocketWatcherJobWorker(std::shared_ptr<SocketWatcher::Internal> parent)
+        : m_parent(std::move(parent)) {}
+    void work() override;
+    void cancel() override;
+    std::shared_ptr<SocketWatcher::Internal> m_parent;
+};
+
+class SocketWatcher::Internal {
+public:
+    Internal() = default;
+    ~Internal() {
+        if (wakeupfds[0] >= 0) {
+            UpnpCloseSocket(wakeupfds[0]);
+            UpnpCloseSocket(wakeupfds[1]);
+        }
+    }
+    void wakeup() {
+#ifndef _WIN32
+        char c = 0;
+        if (write(wakeupfds[1], &c, 1) < 0) {
+            // Pipe full: the watcher will wake up anyway
+        }
+#endif
+    }
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::list<WatchedSocket> sockets;
+    bool running{false};
+    bool inshutdown{false};
+    int wakeupfds[2]{-1, -1};
+};
+
+void SocketWatcherJobWorker::work()
+{
+    auto w = m_parent.get();
+    std::unique_lock<std::mutex> lck(w->mutex);
+    std::vector<struct pollfd> pfds;
+    std::vector<std::list<WatchedSocket>::iterator> watched;
+    std::vector<std::pair<std::function<void(int)>, int>> ready;
+
+    while (!w->inshutdown) {
+        pfds.clear();
+        watched.clear();
+        auto now = steady_clock::now();
+        auto timeout = maxPollWait;
+#ifndef _WIN32
+        pfds.push_back({w->wakeupfds[0], POLLIN, 0});
+#endif
+        for (auto it = w->sockets.begin(); it != w->sockets.end(); it++) {
+            short events = 0;
+            if (it->events & SocketWatcher::READABLE)
+                events |= POLLIN;
+            if (it->events & SocketWatcher::WRITABLE)
+                events |= POLLOUT;
+            pfds.push_back({it->fd, events, 0});
+            watched.push_back(it);
+            // Round up, so that we don't wake up just before the deadline and spin.
+            timeout = std::min(timeout, ceil<milliseconds>(it->deadline - now));
+        }
+        timeout = std::max(timeout, milliseconds(0));
+
+        // The list is only modified by push_back() while we are unlocked, so the iterators stay
+        // valid.
+        lck.unlock();
+        int ret = poll(pfds.data(), static_cast<unsigned long>(pfds.size()),
+                       static_cast<int>(timeout.count()));
+        lck.lock();
+#ifndef _WIN32
+        if (ret > 0 && (pfds[0].revents & POLLIN)) {
+            char buf[64];
+            while (read(w->wakeupfds[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+        size_t first = 1;
+#else
+        size_t first = 0;
+#endif
+        now = steady_clock::now();
+        for (size_t i = first; i < pfds.size(); i++) {
+            auto it = watched[i - first];
+            int events = 0;
+            if (ret > 0) {
+                if (pfds[i].revents & (POLLERR|POLLNVAL))
+                    events = -1;
+                if (pfds[i].revents & (POLLIN|POLLHUP))
+                    events |= SocketWatcher::READABLE;
+                if (pfds[i].revents & POLLOUT)
+                    events |= SocketWatcher::WRITABLE;
+            }
+            if (events != 0 || now >= it->deadline) {
+                ready.emplace_back(std::move(it->callback), events);
+                w->sockets.erase(it);
+            }
+        }
+        if (!ready.empty()) {
+            lck.unlock();
+            for (auto& [cb, events] : ready)
+                cb(events);
+            ready.clear();
+            lck.lock();
+        }
+    }
+
+    // Shutting down: tell everybody
+    auto sockets = std::move(w->sockets);
+    w->sockets.clear();
+    w->running = false;
+    w->inshutdown = false;
+    w->condition.notify_all();
+    lck.unlock();
+    for (auto& entry : sockets)
+        entry.callback(-1);
+}
+
+// Called by ThreadPool::shutdown() if the watcher was not shut down first.
+void SocketWatcherJobWorker::cancel()
+{
+    std::scoped_lock lck(m_parent->mutex);
+    m_parent->inshutdown = true;
+    m_parent->wakeup();
+}
+
+SocketWatcher::SocketWatcher(ThreadPool *tp, const ThreadSchedAttr *sched)
+    : m(std::make_shared<Internal>())
+{
+#ifndef _WIN32
+    if (pipe(m->wakeupfds) < 0) {
+        m->wakeupfds[0] = m->wakeupfds[1] = -1;
+        return;
+    }
+    for (auto fd : m->wakeupfds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+#endif
+    m->running = true;
+    if (tp->addPersistent(std::make_unique<SocketWatcherJobWorker>(m),
+                          ThreadPool::HIGH_PRIORITY, sched) != 0) {
+        m->running = false;
+    }
+}
+
+SocketWatcher::~SocketWatcher()
+{
+    shutdown();
+}
+
+int SocketWatcher::watch(SOCKET fd, int events, std::chrono::milliseconds timeout,
+                         std::function<void(int)> callback)
+{
+    std::scoped_lock lck(m->mutex);
+    if (!m->running || m->inshutdown)
+        return -1;
+    m->sockets.push_back({fd, events, steady_clock::now() + timeout, std::move(callback)});
+    m->wakeup();
+    return 0;
+}
+
+int SocketWatcher::shutdown()
+{
+    std::unique_lock<std::mutex> lck(m->mutex);
+    if (!m->running)
+        return 0;
+    m->inshutdown = true;
+    m->wakeup();
+    while (m->running) {
+        m->condition.wait(lck);
+    }
+    return 0;
+}
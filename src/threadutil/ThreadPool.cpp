@@ -36,7 +36,13 @@
 #if defined(__OSX__) || defined(__APPLE__) || defined(__NetBSD__)
 #include <sys/resource.h>
 #endif
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
 #include <chrono>
@@ -45,10 +51,20 @@
 #include <ctime>
 #include <deque>
 #include <iostream>
+#include <iterator>
+#include <list>
 #include <mutex>
+#include <system_error>
 #include <thread>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
 #include <utility>
 
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
 using namespace std::chrono;
 
 // #define THREADPOOL_DEBUG
@@ -61,6 +77,103 @@ using namespace std::chrono;
 #define LOGDEB(X)
 #endif
 
+int LatencyHistogram::bucketIndex(uint64_t us)
+{
+    constexpr uint64_t maxval = (uint64_t(1) << MAXBITS) - 1;
+    if (us > maxval)
+        us = maxval;
+    if (us < (uint64_t(1) << SUBBITS))
+        return static_cast<int>(us);
+    int msb = 63;
+    while (!(us & (uint64_t(1) << msb)))
+        msb--;
+    int shift = msb - SUBBITS;
+    return ((shift + 1) << SUBBITS) +
+        static_cast<int>((us >> shift) & ((uint64_t(1) << SUBBITS) - 1));
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int idx)
+{
+    if (idx < (1 << SUBBITS))
+        return static_cast<uint64_t>(idx);
+    int shift = (idx >> SUBBITS) - 1;
+    uint64_t sub = static_cast<uint64_t>(idx & ((1 << SUBBITS) - 1));
+    uint64_t lower = ((uint64_t(1) << SUBBITS) + sub) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(double pct) const
+{
+    if (total == 0)
+        return 0;
+    pct = std::min(100.0, std::max(0.0, pct));
+    auto target = static_cast<uint64_t>(pct / 100.0 * static_cast<double>(total) + 0.5);
+    target = std::max(target, uint64_t(1));
+    uint64_t seen = 0;
+    for (int i = 0; i < NBUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= target)
+            return std::min(bucketUpperBound(i), maxUs);
+    }
+    return maxUs;
+}
+
+/* Histogram updated without locking by the worker threads. Only the snapshot copy in
+   ThreadPoolStats is visible from outside. */
+struct AtomicLatencyHistogram {
+    std::atomic<uint64_t> counts[LatencyHistogram::NBUCKETS]{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sumUs{0};
+    std::atomic<uint64_t> maxUs{0};
+
+    void record(uint64_t us) {
+        counts[LatencyHistogram::bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sumUs.fetch_add(us, std::memory_order_relaxed);
+        uint64_t prev = maxUs.load(std::memory_order_relaxed);
+        while (prev < us && !maxUs.compare_exchange_weak(prev, us, std::memory_order_relaxed))
+            ;
+    }
+    void snapshot(LatencyHistogram& out) const {
+        for (int i = 0; i < LatencyHistogram::NBUCKETS; i++) {
+            out.counts[i] = counts[i].load(std::memory_order_relaxed);
+        }
+        out.total = total.load(std::memory_order_relaxed);
+        out.sumUs = sumUs.load(std::memory_order_relaxed);
+        out.maxUs = maxUs.load(std::memory_order_relaxed);
+    }
+};
+
+/* Per JobWorker class statistics. Entries are created under the pool mutex when a job of a new
+   type is queued, and never deleted, so that the workers can keep a pointer. */
+struct JobTypeHistograms {
+    explicit JobTypeHistograms(std::string nm) : name(std::move(nm)) {}
+    std::string name;
+    AtomicLatencyHistogram wait;
+    AtomicLatencyHistogram run;
+};
+
+static std::string jobTypeName(const JobWorker& worker)
+{
+    const char *nm = typeid(worker).name();
+#ifdef __GNUC__
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(nm, nullptr, nullptr, &status);
+    if (demangled) {
+        std::string out(demangled);
+        free(demangled);
+        return out;
+    }
+#endif
+    return nm;
+}
+
+static inline uint64_t elapsedUs(steady_clock::time_point from, steady_clock::time_point to)
+{
+    auto us = duration_cast<microseconds>(to - from).count();
+    return us > 0 ? static_cast<uint64_t>(us) : 0;
+}
+
 /*! Internal ThreadPool Job. */
 struct ThreadPoolJob {
     ThreadPoolJob(std::unique_ptr<JobWorker> worker, ThreadPool::ThreadPriority _prio, int j, steady_clock::time_point rt)
@@ -69,20 +182,68 @@ struct ThreadPoolJob {
     ThreadPool::ThreadPriority priority;
     steady_clock::time_point requestTime;
     int jobId;
+    JobTypeHistograms *typestats{nullptr};
+    /*! For deadline jobs */
+    steady_clock::time_point deadline;
+    bool discardLate{false};
+    bool discarded{false};
+    /*! For persistent jobs with specific CPU placement or scheduling */
+    std::unique_ptr<ThreadSchedAttr> sched;
 };
 
+static const std::string persistentJobName{"persistent"};
+
+/* Build a trace event for a job */
+static ThreadPoolTraceEvent traceEvent(
+    ThreadPoolTraceEvent::Type type, const ThreadPoolJob& job, steady_clock::time_point time,
+    uint64_t waitUs = 0, uint64_t runUs = 0)
+{
+    return {type, job.typestats ? &job.typestats->name : &persistentJobName, job.jobId,
+            job.priority, time, waitUs, runUs};
+}
+
+/* Ordering for the deadline heap: the earliest deadline at the front */
+static bool laterDeadline(const std::unique_ptr<ThreadPoolJob>& a,
+                          const std::unique_ptr<ThreadPoolJob>& b)
+{
+    return a->deadline > b->deadline;
+}
+
+/*! A pool thread. The records are moved to the exited list by the threads when they exit, and
+ *  joined from there by createWorker() or shutdown(). */
+struct WorkerRecord {
+    std::thread thread;
+    /*! Job being run, for cancellation */
+    JobWorker *running{nullptr};
+};
+using WorkerIterator = std::list<WorkerRecord>::iterator;
+
 class ThreadPool::Internal {
 public:
     explicit Internal(const ThreadPoolAttr* attr);
     bool ok{false};
     int createWorker(std::unique_lock<std::mutex>& lck);
     void addWorker(std::unique_lock<std::mutex>& lck);
-    void StatsAccountLQ(int64_t diffTime);
-    void StatsAccountMQ(int64_t diffTime);
-    void StatsAccountHQ(int64_t diffTime);
+    void StatsAccountLQ(double diffTime);
+    void StatsAccountMQ(double diffTime);
+    void StatsAccountHQ(double diffTime);
     void CalcWaitTime(ThreadPriority p, const std::unique_ptr<ThreadPoolJob>& job);
+    JobTypeHistograms *jobTypeStats(const JobWorker& worker);
+    void countersSnapshot(ThreadPoolCounters *out);
+    void statsSnapshot(ThreadPoolStats *out);
+    void autoscale(std::unique_lock<std::mutex>& lck);
+    bool pickDeadlineJob(steady_clock::time_point now);
+    std::unique_ptr<ThreadPoolJob> popDeadlineJob(steady_clock::time_point now);
+    size_t queuedJobs() const {
+        return highJobQ.size() + medJobQ.size() + lowJobQ.size() + deadlineJobQ.size();
+    }
+    void noteQueueDepth() {
+        stats.maxQueuedJobs = std::max(stats.maxQueuedJobs, static_cast<int>(queuedJobs()));
+    }
     void bumpPriority();
-    void WorkerThread();
+    ThreadSchedAttr effectiveSched(const ThreadSchedAttr& in) const;
+    void WorkerThread(WorkerIterator me);
+    void reapWorkers();
     int shutdown();
 
     /*! Mutex to protect job qs. */
@@ -110,65 +271,91 @@ public:
     std::deque<std::unique_ptr<ThreadPoolJob>> medJobQ;
     /*! high priority job Q */
     std::deque<std::unique_ptr<ThreadPoolJob>> highJobQ;
+    /*! deadline jobs, a heap ordered by deadline */
+    std::vector<std::unique_ptr<ThreadPoolJob>> deadlineJobQ;
     /*! persistent job */
     std::unique_ptr<ThreadPoolJob> persistentJob;
     /*! thread pool attributes */
     ThreadPoolAttr attr;
     /*! statistics */
-    ThreadPoolStats stats;
+    ThreadPoolCounters stats;
+    /*! Latency histograms, indexed by priority, updated without holding the mutex. */
+    AtomicLatencyHistogram waitHist[3];
+    AtomicLatencyHistogram runHist[3];
+    AtomicLatencyHistogram deadlineLateness;
+    /*! Per JobWorker class histograms. Protected by the mutex */
+    std::unordered_map<std::type_index, std::unique_ptr<JobTypeHistograms>> jobTypes;
+    /*! Autoscaling: queue wait times since the last evaluation, and evaluation time. */
+    LatencyHistogram autoscaleWindow;
+    steady_clock::time_point autoscaleLast;
+    /*! Autoscaling: number of idle threads which should exit */
+    int autoscaleRetire{0};
+    /*! CPU affinity and scheduling of the thread which created the pool, used as defaults */
+    ThreadSchedAttr initialSched;
+    /*! Incremented when the worker scheduling attributes change */
+    int schedGeneration{0};
+    /*! Running and exited threads */
+    std::list<WorkerRecord> workers;
+    std::list<WorkerRecord> exited;
+    /*! Set while shutdown() calls the running jobs cancel() methods */
+    int cancelling{0};
+    /*! Tracing hook, copied under the lock and called without it */
+    std::shared_ptr<ThreadPoolTraceHook> traceHook;
 };
 
 ThreadPool::ThreadPool() = default;
 
 ThreadPool::~ThreadPool()
 {
-    // JFD: Doing real work in the destructor is impossible at the moment.  The main problem is that
-    // the ThreadPools are declared as static objects in upnpapi.c so that the destructors are
-    // called on program exit even if the application did not properly execute an orderly
-    // shutdown. In practise, at least the TimerThread is still running and we have no mechanism to
-    // tell all threads to exit and wait for them. This is no big deal, because I can't think of a
-    // process which would want to shutdown its UPnP service and do something else further on... So
-    // the process is going to exit and the system will take care of the cleanup.
-    // Tl:Dr : I don't know how to clean up without crashing, just exit.
-#if 0
-    shutdown();
-#endif
-    // Also actually deleting the pool under these conditions blocks or crashes
-    m.release();
+    // The ThreadPools are declared as static objects in upnpapi.cpp, so that the destructors are
+    // called on program exit even if the application did not call UpnpFinish(). In this case,
+    // jobs may still be running and using other global objects which are being destroyed, and
+    // trying to stop them would block or crash: just leave everything to the system. If the pool
+    // was shut down, all its threads have been joined and it can be deleted normally.
+    if (m) {
+        std::unique_lock<std::mutex> lck(m->mutex);
+        bool stopped = m->shuttingdown && m->workers.empty();
+        lck.unlock();
+        if (!stopped)
+            m.release();
+    }
 }
 
 int ThreadPool::start(const ThreadPoolAttr* attr)
 {
+    if (m) {
+        m->shutdown();
+    }
     m = std::make_unique<Internal>(attr);
     if (m->ok)
         return 0;
     return -1;
 }
 
-void ThreadPool::Internal::StatsAccountLQ(int64_t diffTime)
+void ThreadPool::Internal::StatsAccountLQ(double diffTime)
 {
     this->stats.totalJobsLQ++;
-    this->stats.totalTimeLQ += static_cast<double>(diffTime);
+    this->stats.totalTimeLQ += diffTime;
 }
 
-void ThreadPool::Internal::StatsAccountMQ(int64_t diffTime)
+void ThreadPool::Internal::StatsAccountMQ(double diffTime)
 {
     this->stats.totalJobsMQ++;
-    this->stats.totalTimeMQ += static_cast<double>(diffTime);
+    this->stats.totalTimeMQ += diffTime;
 }
 
-void ThreadPool::Internal::StatsAccountHQ(int64_t diffTime)
+void ThreadPool::Internal::StatsAccountHQ(double diffTime)
 {
     this->stats.totalJobsHQ++;
-    this->stats.totalTimeHQ += static_cast<double>(diffTime);
+    this->stats.totalTimeHQ += diffTime;
 }
 
 /*!
  * \brief Calculates the time the job has been waiting at the specified
  * priority.
  *
- * Adds to the totalTime and totalJobs kept in the thread pool statistics
- * structure.
+ * Adds to the totalTime (milliseconds) and totalJobs kept in the thread pool statistics
+ * structure, and records the total queue time in the latency histograms.
  *
  * \internal
  */
@@ -176,10 +363,16 @@ void ThreadPool::Internal::CalcWaitTime(ThreadPriority p, const std::unique_ptr<
 {
     assert(job != nullptr);
 
-    auto now = steady_clock::now();
-    auto ms =
-        duration_cast<milliseconds>(now - job->requestTime);
-    auto diff = ms.count();
+    auto us = elapsedUs(job->requestTime, steady_clock::now());
+    waitHist[job->priority].record(us);
+    if (attr.autoscaleTargetP95Us > 0) {
+        autoscaleWindow.counts[LatencyHistogram::bucketIndex(us)]++;
+        autoscaleWindow.total++;
+        autoscaleWindow.maxUs = std::max(autoscaleWindow.maxUs, us);
+    }
+    if (job->typestats)
+        job->typestats->wait.record(us);
+    auto diff = static_cast<double>(us) / 1000.0;
     switch (p) {
     case LOW_PRIORITY:
         StatsAccountLQ(diff);
@@ -195,6 +388,48 @@ void ThreadPool::Internal::CalcWaitTime(ThreadPriority p, const std::unique_ptr<
     }
 }
 
+/* Find or create the histograms for the worker class. The mutex must be locked */
+JobTypeHistograms *ThreadPool::Internal::jobTypeStats(const JobWorker& worker)
+{
+    std::type_index key(typeid(worker));
+    auto it = jobTypes.find(key);
+    if (it == jobTypes.end()) {
+        it = jobTypes.emplace(key, std::make_unique<JobTypeHistograms>(jobTypeName(worker))).first;
+    }
+    return it->second.get();
+}
+
+/* Decide if the next job should come from the deadline queue: the deadline jobs rank between the
+ * high and medium priority ones, except when the deadline is near, then they come first. The
+ * mutex must be locked. */
+bool ThreadPool::Internal::pickDeadlineJob(steady_clock::time_point now)
+{
+    if (deadlineJobQ.empty())
+        return false;
+    return highJobQ.empty() ||
+        deadlineJobQ.front()->deadline - now <= milliseconds(attr.starvationTime);
+}
+
+/* Pop the earliest deadline job and account for it. The mutex must be locked. */
+std::unique_ptr<ThreadPoolJob> ThreadPool::Internal::popDeadlineJob(steady_clock::time_point now)
+{
+    std::pop_heap(deadlineJobQ.begin(), deadlineJobQ.end(), laterDeadline);
+    auto job = std::move(deadlineJobQ.back());
+    deadlineJobQ.pop_back();
+    stats.totalJobsDeadline++;
+    if (now > job->deadline) {
+        stats.deadlineMissed++;
+        deadlineLateness.record(elapsedUs(job->deadline, now));
+        if (job->discardLate) {
+            stats.deadlineDiscarded++;
+            job->discarded = true;
+            return job;
+        }
+    }
+    CalcWaitTime(HIGH_PRIORITY, job);
+    return job;
+}
+
 /*!
  * \brief Sets the scheduling policy of the current process.
  *
@@ -219,15 +454,10 @@ static int SetPolicyType(ThreadPoolAttr::PolicyType in)
 #elif defined(_MSC_VER)
 //    retVal = sched_setscheduler(0, in);
     retVal = 0;
-#elif defined(_POSIX_PRIORITY_SCHEDULING) && _POSIX_PRIORITY_SCHEDULING > 0
-    struct sched_param current = {};
-    int sched_result;
-    sched_getparam(0, &current);
-    // At the moment, in is always SCHED_OTHER, and priority must be 0 (see sched(7))
-    current.sched_priority = 0;
-    sched_result = sched_setscheduler(0, in, &current);
-    retVal = (sched_result != -1 || errno == EPERM) ? 0 : errno;
 #else
+    // This used to call sched_setscheduler() on the calling thread when
+    // _POSIX_PRIORITY_SCHEDULING happened to be defined. The calling thread belongs to the
+    // application and the worker scheduling class is set with ThreadSchedAttr: leave it alone.
     retVal = 0;
 #endif
     return retVal;
@@ -236,53 +466,17 @@ static int SetPolicyType(ThreadPoolAttr::PolicyType in)
 /*
  * Sets the priority of the currently running thread.
  *
- * Note that this probably never does anything as the sched type is always SCHED_OTHER which
- * does not use priorities (must be 0). Also, I've never seen _POSIX_PRIORITY_SCHEDULING
- * defined except on a very weird system, so the method is generally empty.
+ * This does nothing: the code which set the min/mid/max priority of the current policy was only
+ * compiled when _POSIX_PRIORITY_SCHEDULING was visible, and it would override the
+ * ThreadSchedAttr priority of the pool or job, and give the maximum real-time priority to all
+ * HIGH_PRIORITY jobs on a real-time pool. The job priority only decides the queue order.
  *
- * @return 0 on success, else EINVAL invalid priority or errno.
+ * @return 0.
  */
 static int SetPriority(ThreadPool::ThreadPriority priority)
 {
-#if defined(_POSIX_PRIORITY_SCHEDULING) && _POSIX_PRIORITY_SCHEDULING > 0
-    int retVal = 0;
-    int currentPolicy;
-    int minPriority = 0;
-    int maxPriority = 0;
-    int actPriority = 0;
-    int midPriority = 0;
-    struct sched_param newPriority;
-    int sched_result;
-
-    pthread_getschedparam(pthread_self(), &currentPolicy, &newPriority);
-    minPriority = sched_get_priority_min(currentPolicy);
-    maxPriority = sched_get_priority_max(currentPolicy);
-    midPriority = (maxPriority - minPriority) / 2;
-    switch (priority) {
-    case ThreadPool::LOW_PRIORITY:
-        actPriority = minPriority;
-        break;
-    case ThreadPool::MED_PRIORITY:
-        actPriority = midPriority;
-        break;
-    case ThreadPool::HIGH_PRIORITY:
-        actPriority = maxPriority;
-        break;
-    default:
-        retVal = EINVAL;
-        goto exit_function;
-    };
-
-    newPriority.sched_priority = actPriority;
-
-    sched_result = pthread_setschedparam(pthread_self(), currentPolicy, &newPriority);
-    retVal = (sched_result == 0 || errno == EPERM) ? 0 : sched_result;
-exit_function:
-    return retVal;
-#else
     (void)priority;
     return 0;
-#endif
 }
 
 /*!
@@ -302,7 +496,7 @@ void ThreadPool::Internal::bumpPriority()
 
     while (!done) {
         if (!medJobQ.empty()) {
-            auto diffTime = duration_cast<milliseconds>(now - medJobQ.front()->requestTime).count();
+            auto diffTime = duration<double, std::milli>(now - medJobQ.front()->requestTime).count();
             if (diffTime >= attr.starvationTime) {
                 /* If job has waited longer than the starvation time
                  * bump priority (add to higher priority Q) */
@@ -313,7 +507,7 @@ void ThreadPool::Internal::bumpPriority()
             }
         }
         if (!lowJobQ.empty()) {
-            auto diffTime = duration_cast<milliseconds>(now - lowJobQ.front()->requestTime).count();
+            auto diffTime = duration<double, std::milli>(now - lowJobQ.front()->requestTime).count();
             if (diffTime >= attr.maxIdleTime) {
                 /* If job has waited longer than the starvation time
                  * bump priority (add to higher priority Q) */
@@ -327,6 +521,79 @@ void ThreadPool::Internal::bumpPriority()
     }
 }
 
+/* Retrieve the CPU affinity and scheduling class of the current thread */
+static ThreadSchedAttr GetThreadSched()
+{
+    ThreadSchedAttr out;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set))
+                out.cpus.push_back(cpu);
+        }
+    }
+#endif
+#ifndef _WIN32
+    struct sched_param param = {};
+    if (pthread_getschedparam(pthread_self(), &out.policy, &param) == 0) {
+        out.priority = param.sched_priority;
+    } else {
+        out.policy = SCHED_OTHER;
+    }
+#endif
+    return out;
+}
+
+/* Set the CPU affinity and scheduling class of the current thread. The values must be fully
+ * specified (see effectiveSched()). Errors are logged and otherwise ignored. */
+static void SetThreadSched(const ThreadSchedAttr& sched)
+{
+#ifdef __linux__
+    if (!sched.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : sched.cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0) {
+            LOGERR("ThreadPool: pthread_setaffinity_np failed, errno " << ret << "\n");
+        }
+    }
+#endif
+#ifndef _WIN32
+    if (sched.policy >= 0) {
+        struct sched_param param = {};
+        param.sched_priority = sched.priority;
+        int ret = pthread_setschedparam(pthread_self(), sched.policy, &param);
+        if (ret != 0) {
+            LOGERR("ThreadPool: pthread_setschedparam(" << sched.policy << ", " <<
+                   sched.priority << ") failed, errno " << ret << "\n");
+        }
+    }
+#else
+    (void)sched;
+#endif
+}
+
+/* Fill the unset fields from the initial values. Threads inherit the affinity and scheduling
+ * class of their creator, which may be any thread adding a job, so we always set them
+ * explicitly. */
+ThreadSchedAttr ThreadPool::Internal::effectiveSched(const ThreadSchedAttr& in) const
+{
+    ThreadSchedAttr out{in};
+    if (out.cpus.empty())
+        out.cpus = initialSched.cpus;
+    if (out.policy < 0) {
+        out.policy = initialSched.policy;
+        out.priority = initialSched.priority;
+    }
+    return out;
+}
+
 /*
  * \brief Sets seed for random number generator. Each thread sets the seed
  * random number generator. */
@@ -348,8 +615,8 @@ static void SetSeed()
  *
  * If worker remains idle for more than specified max, the worker is released.
  */
-void ThreadPool::Internal::WorkerThread() {
-    time_t start = 0;
+void ThreadPool::Internal::WorkerThread(WorkerIterator me) {
+    steady_clock::time_point start;
     std::unique_ptr<ThreadPoolJob> job;
     std::cv_status retCode;
     int persistent = -1;
@@ -362,19 +629,35 @@ void ThreadPool::Internal::WorkerThread() {
     totalThreads++;
     pendingWorkerThreadStart = 0;
     start_and_shutdown.notify_all();
+    auto mysched = effectiveSched(attr.workerSched);
+    int mygeneration = schedGeneration;
     lck.unlock();
 
+    SetThreadSched(mysched);
     SetSeed();
-    start = time(nullptr);
+    start = steady_clock::now();
     while (true) {
         lck.lock();
         if (job) {
+            /* From now on, shutdown() won't call cancel() on the worker. It may be doing it
+               already though: wait before deleting the job. */
+            me->running = nullptr;
+            while (cancelling) {
+                start_and_shutdown.wait(lck);
+            }
             busyThreads--;
+            if (job->discarded) {
+                /* Same as for the jobs dropped by shutdown(): no lock for the destructor */
+                lck.unlock();
+                job = nullptr;
+                lck.lock();
+            }
             job = nullptr;
         }
         stats.idleThreads++;
-        stats.totalWorkTime += static_cast<double>(time(nullptr)) - static_cast<double>(start);
-        start = time(nullptr);
+        auto now = steady_clock::now();
+        stats.totalWorkTime += duration<double>(now - start).count();
+        start = now;
         if (persistent == 0) {
             stats.workerThreads--;
         } else if (persistent == 1) {
@@ -387,6 +670,7 @@ void ThreadPool::Internal::WorkerThread() {
         while (lowJobQ.empty() &&
                medJobQ.empty() &&
                highJobQ.empty() &&
+               deadlineJobQ.empty() &&
                !persistentJob && !shuttingdown) {
             /* If wait timed out and we currently have more than the
              * min threads, or if we have more than the max threads
@@ -399,16 +683,44 @@ void ThreadPool::Internal::WorkerThread() {
                 stats.idleThreads--;
                 goto exit_function;
             }
+            /* Autoscaling decided that we have too many threads */
+            if (autoscaleRetire > 0) {
+                autoscaleRetire--;
+                if (totalThreads > attr.minThreads) {
+                    stats.autoscaleThreadsRetired++;
+                    stats.idleThreads--;
+                    goto exit_function;
+                }
+            }
 
-            /* wait for a job up to the specified max time */
-            retCode = condition.wait_for(lck, idlemillis);
+            /* wait for a job up to the specified max time. When autoscaling, also wake up
+               once per evaluation interval, so that an idle pool gets evaluated and shrunk. */
+            if (attr.autoscaleTargetP95Us > 0 && attr.autoscaleIntervalMs < attr.maxIdleTime) {
+                auto idleuntil = steady_clock::now() + idlemillis;
+                auto interval = milliseconds(attr.autoscaleIntervalMs);
+                retCode = std::cv_status::no_timeout;
+                while (condition.wait_for(lck, std::min(interval, duration_cast<milliseconds>(
+                                                            idleuntil - steady_clock::now()))) ==
+                       std::cv_status::timeout) {
+                    if (steady_clock::now() >= idleuntil) {
+                        retCode = std::cv_status::timeout;
+                        break;
+                    }
+                    autoscale(lck);
+                    if (autoscaleRetire > 0 || queuedJobs() > 0 || persistentJob || shuttingdown)
+                        break;
+                }
+            } else {
+                retCode = condition.wait_for(lck, idlemillis);
+            }
         }
 
         stats.idleThreads--;
         /* idle time */
-        stats.totalIdleTime += static_cast<double>(time(nullptr)) - static_cast<double>(start);
+        now = steady_clock::now();
+        stats.totalIdleTime += duration<double>(now - start).count();
         /* work time */
-        start = time(nullptr);
+        start = now;
         /* bump priority of starved jobs */
         bumpPriority();
         /* if shutdown then stop */
@@ -424,8 +736,10 @@ void ThreadPool::Internal::WorkerThread() {
             } else {
                 stats.workerThreads++;
                 persistent = 0;
-                /* Pick the highest priority job */
-                if (!highJobQ.empty()) {
+                /* Pick an urgent deadline job, else the highest priority job */
+                if (pickDeadlineJob(now)) {
+                    job = popDeadlineJob(now);
+                } else if (!highJobQ.empty()) {
                     job = std::move(highJobQ.front());
                     highJobQ.pop_front();
                     CalcWaitTime(ThreadPool::HIGH_PRIORITY, job);
@@ -446,21 +760,72 @@ void ThreadPool::Internal::WorkerThread() {
         }
 
         busyThreads++;
+        me->running = job->m_worker.get();
+        auto hook = traceHook;
+        bool schedchanged = mygeneration != schedGeneration;
+        if (schedchanged) {
+            mysched = effectiveSched(attr.workerSched);
+            mygeneration = schedGeneration;
+        }
+        auto jobsched = job->sched ? effectiveSched(*job->sched) : ThreadSchedAttr();
         lck.unlock();
 
+        if (schedchanged)
+            SetThreadSched(mysched);
+        if (job->sched)
+            SetThreadSched(jobsched);
         SetPriority(job->priority);
         /* run the job */
-        job->m_worker->work();
+        auto runstart = steady_clock::now();
+        uint64_t waitus{0};
+        if (hook && !job->discarded) {
+            waitus = elapsedUs(job->requestTime, runstart);
+            (*hook)(traceEvent(ThreadPoolTraceEvent::START, *job, runstart, waitus));
+        }
+        if (!job->discarded)
+            job->m_worker->work();
+        if ((persistent == 0 || hook) && !job->discarded) {
+            auto runend = steady_clock::now();
+            auto us = elapsedUs(runstart, runend);
+            if (persistent == 0) {
+                runHist[job->priority].record(us);
+                if (job->typestats)
+                    job->typestats->run.record(us);
+            }
+            if (hook)
+                (*hook)(traceEvent(ThreadPoolTraceEvent::END, *job, runend, waitus, us));
+        }
         /* return to Normal */
         SetPriority(ThreadPool::MED_PRIORITY);
+        if (job->sched)
+            SetThreadSched(mysched);
     }
 
 exit_function:
     LOGDEB("ThreadWorker: thread exiting\n");
     totalThreads--;
+    /* After this, we only return, releasing the lock: the thread can be joined by whoever gets
+       the lock next. */
+    exited.splice(exited.end(), workers, me);
     start_and_shutdown.notify_all();
 }
 
+/*!
+ * \brief Joins the threads which have exited.
+ *
+ * \remark The ThreadPool object mutex must be locked prior to calling this
+ * function.
+ *
+ * \internal
+ */
+void ThreadPool::Internal::reapWorkers()
+{
+    for (auto& worker : exited) {
+        worker.thread.join();
+    }
+    exited.clear();
+}
+
 /*!
  * \brief Creates a worker thread, if the thread pool does not already have
  * max threads.
@@ -487,9 +852,20 @@ int ThreadPool::Internal::createWorker(std::unique_lock<std::mutex>& lck)
         LOGDEB("ThreadPool::createWorker: not creating thread: too many\n");
         return EMAXTHREADS;
     }
+    if (this->shuttingdown) {
+        return ESHUTTINGDOWN;
+    }
+    reapWorkers();
     LOGDEB("ThreadPool::createWorker: creating thread\n");
-    auto nthread = std::thread([this] { WorkerThread(); });
-    nthread.detach();
+    workers.emplace_back();
+    auto me = std::prev(workers.end());
+    try {
+        me->thread = std::thread([this, me] { WorkerThread(me); });
+    } catch (const std::system_error&) {
+        LOGERR("ThreadPool::createWorker: thread creation failed\n");
+        workers.erase(me);
+        return EAGAIN;
+    }
 
     /* wait until the new worker thread starts. We can set the flag
        cause we have the lock */
@@ -505,6 +881,65 @@ int ThreadPool::Internal::createWorker(std::unique_lock<std::mutex>& lck)
     return 0;
 }
 
+/*!
+ * \brief Autoscaling policy: grow or shrink the pool to keep the queue wait time 95th percentile
+ * around the target value.
+ *
+ * The measure is taken from the wait times computed in CalcWaitTime() during the last interval,
+ * and the age of the oldest queued job, which is needed to detect a saturated pool (no job
+ * dequeued). The pool grows by a quarter of its size (at least one thread) when over the
+ * target. It shrinks by one thread per interval when the measure stays under a quarter of the
+ * target and some threads are idle.
+ *
+ * This is called when jobs are added, and by the idle threads once per interval, so that a pool
+ * which gets no jobs is shrunk too.
+ *
+ * \remark The ThreadPool object mutex must be locked prior to calling this
+ * function.
+ */
+void ThreadPool::Internal::autoscale(std::unique_lock<std::mutex>& lck)
+{
+    if (attr.autoscaleTargetP95Us <= 0)
+        return;
+    auto now = steady_clock::now();
+    if (now - autoscaleLast < milliseconds(attr.autoscaleIntervalMs))
+        return;
+    autoscaleLast = now;
+
+    uint64_t p95 = autoscaleWindow.percentile(95);
+    for (const auto *q : {&highJobQ, &medJobQ, &lowJobQ}) {
+        if (!q->empty()) {
+            p95 = std::max(p95, elapsedUs(q->front()->requestTime, now));
+        }
+    }
+    // The deadline queue is ordered by deadline, not by age
+    for (const auto& job : deadlineJobQ) {
+        p95 = std::max(p95, elapsedUs(job->requestTime, now));
+    }
+    autoscaleWindow = LatencyHistogram();
+    stats.autoscaleLastP95Us = p95;
+    stats.autoscaleLastThreads = totalThreads;
+
+    auto target = static_cast<uint64_t>(attr.autoscaleTargetP95Us);
+    // Growing only helps if jobs are waiting (we are also called from idle threads)
+    if (p95 > target && queuedJobs() > 0) {
+        if (attr.maxThreads != ThreadPoolAttr::INFINITE_THREADS && totalThreads >= attr.maxThreads)
+            return;
+        stats.autoscaleGrowDecisions++;
+        autoscaleRetire = 0;
+        int toadd = std::max(1, (totalThreads - persistentThreads) / 4);
+        LOGDEB("ThreadPool::autoscale: p95 " << p95 << " uS > target. Adding " << toadd << "\n");
+        while (toadd-- > 0 && createWorker(lck) == 0) {
+            stats.autoscaleThreadsAdded++;
+        }
+    } else if (p95 < target / 4 && stats.idleThreads > 0 && totalThreads > attr.minThreads) {
+        stats.autoscaleShrinkDecisions++;
+        LOGDEB("ThreadPool::autoscale: p95 " << p95 << " uS < target/4. Retiring one thread\n");
+        autoscaleRetire = 1;
+        condition.notify_one();
+    }
+}
+
 /*!
  * \brief Determines whether or not a thread should be added based on the
  * jobsPerThread ratio. Adds a thread if appropriate.
@@ -515,7 +950,7 @@ int ThreadPool::Internal::createWorker(std::unique_lock<std::mutex>& lck)
  */
 void ThreadPool::Internal::addWorker(std::unique_lock<std::mutex>& lck)
 {
-    long jobs = highJobQ.size() + lowJobQ.size() + medJobQ.size();
+    long jobs = static_cast<long>(queuedJobs());
     int threads = totalThreads - persistentThreads;
     LOGDEB("ThreadPool::addWorker: jobs: " << jobs << " threads: "<< threads <<
            " busyThr: " << busyThreads << " jobsPerThread: " <<
@@ -542,7 +977,8 @@ ThreadPool::Internal::Internal(const ThreadPoolAttr* attr)
     if (SetPolicyType(this->attr.schedPolicy) != 0) {
         return;
     }
-    this->stats = ThreadPoolStats();
+    this->initialSched = GetThreadSched();
+    this->stats = ThreadPoolCounters();
     this->persistentJob = nullptr;
     this->lastJobId = 0;
     this->shuttingdown = false;
@@ -550,6 +986,7 @@ ThreadPool::Internal::Internal(const ThreadPoolAttr* attr)
     this->busyThreads = 0;
     this->persistentThreads = 0;
     this->pendingWorkerThreadStart = 0;
+    this->autoscaleLast = steady_clock::now();
     for (i = 0; i < this->attr.minThreads; ++i) {
         retCode = createWorker(lck);
         if (retCode) {
@@ -567,9 +1004,13 @@ ThreadPool::Internal::Internal(const ThreadPoolAttr* attr)
     }
 }
 
-int ThreadPool::addPersistent(std::unique_ptr<JobWorker> worker, ThreadPriority priority)
+int ThreadPool::addPersistent(std::unique_ptr<JobWorker> worker, ThreadPriority priority,
+                              const ThreadSchedAttr *sched)
 {
     std::unique_lock<std::mutex> lck(m->mutex);
+    if (m->shuttingdown) {
+        return ESHUTTINGDOWN;
+    }
 
     /* Create A worker if less than max threads running */
     if (m->totalThreads < m->attr.maxThreads) {
@@ -582,6 +1023,9 @@ int ThreadPool::addPersistent(std::unique_ptr<JobWorker> worker, ThreadPriority
     }
 
     m->persistentJob = std::make_unique<ThreadPoolJob>(std::move(worker), priority, m->lastJobId, steady_clock::now());
+    if (sched) {
+        m->persistentJob->sched = std::make_unique<ThreadSchedAttr>(*sched);
+    }
 
     /* Notify a waiting thread */
     m->condition.notify_one();
@@ -594,17 +1038,133 @@ int ThreadPool::addPersistent(std::unique_ptr<JobWorker> worker, ThreadPriority
     return 0;
 }
 
+int ThreadPool::addJobs(JobBatch& batch, size_t *accepted)
+{
+    if (accepted)
+        *accepted = 0;
+    if (batch.empty())
+        return 0;
+    std::unique_lock<std::mutex> lck(m->mutex);
+    if (m->shuttingdown) {
+        lck.unlock();
+        batch.entries.clear();
+        return ESHUTTINGDOWN;
+    }
+
+    size_t added = 0;
+    auto now = steady_clock::now();
+    auto hook = m->traceHook;
+    std::vector<ThreadPoolTraceEvent> traces;
+    for (auto& entry : batch.entries) {
+        auto totalJobs = m->queuedJobs();
+        if (totalJobs >= static_cast<size_t>(m->attr.maxJobsTotal)) {
+            LOGERR("ThreadPool::addJobs: too many jobs: " << totalJobs << "\n");
+            m->stats.droppedJobs += static_cast<int>(batch.entries.size() - added);
+            break;
+        }
+        auto job = std::make_unique<ThreadPoolJob>(
+            std::move(entry.worker), entry.priority, m->lastJobId++, now);
+        job->typestats = m->jobTypeStats(*job->m_worker);
+        if (hook)
+            traces.push_back(traceEvent(ThreadPoolTraceEvent::ENQUEUE, *job, now));
+        if (entry.hasDeadline) {
+            job->deadline = entry.deadline;
+            job->discardLate = entry.discardLate;
+            m->deadlineJobQ.push_back(std::move(job));
+            std::push_heap(m->deadlineJobQ.begin(), m->deadlineJobQ.end(), laterDeadline);
+        } else if (entry.priority == HIGH_PRIORITY) {
+            m->highJobQ.push_back(std::move(job));
+        } else if (entry.priority == MED_PRIORITY) {
+            m->medJobQ.push_back(std::move(job));
+        } else {
+            m->lowJobQ.push_back(std::move(job));
+        }
+        added++;
+    }
+    // The dropped jobs are deleted after unlocking: their destructors may do anything.
+    std::vector<JobBatch::Entry> dropped(std::make_move_iterator(batch.entries.begin() + added),
+                                         std::make_move_iterator(batch.entries.end()));
+    batch.entries.clear();
+    m->noteQueueDepth();
+
+    m->autoscale(lck);
+    m->addWorker(lck);
+    /* Wake up one idle thread per job, or all of them */
+    if (added >= static_cast<size_t>(m->stats.idleThreads)) {
+        m->condition.notify_all();
+    } else {
+        for (size_t i = 0; i < added; i++)
+            m->condition.notify_one();
+    }
+    lck.unlock();
+    bool wasdropped = !dropped.empty();
+    dropped.clear();
+    for (const auto& trace : traces)
+        (*hook)(trace);
+    if (accepted)
+        *accepted = added;
+    return wasdropped ? ETOOMANYJOBS : 0;
+}
+
+int ThreadPool::addJob(std::unique_ptr<JobWorker> worker, steady_clock::time_point deadline,
+                       bool discardLate)
+{
+    std::unique_lock<std::mutex> lck(m->mutex);
+    if (m->shuttingdown) {
+        return ESHUTTINGDOWN;
+    }
+
+    auto totalJobs = m->queuedJobs();
+    if (totalJobs >= static_cast<size_t>(m->attr.maxJobsTotal)) {
+        LOGERR("ThreadPool::addJob: too many jobs: " << totalJobs << "\n");
+        m->stats.droppedJobs++;
+        lck.unlock();
+        worker.reset();
+        return ETOOMANYJOBS;
+    }
+
+    // Deadline jobs are accounted as high priority in the wait and run statistics
+    auto job = std::make_unique<ThreadPoolJob>(
+        std::move(worker), HIGH_PRIORITY, m->lastJobId, steady_clock::now());
+    job->typestats = m->jobTypeStats(*job->m_worker);
+    job->deadline = deadline;
+    job->discardLate = discardLate;
+    auto hook = m->traceHook;
+    auto trace = traceEvent(ThreadPoolTraceEvent::ENQUEUE, *job, job->requestTime);
+    m->deadlineJobQ.push_back(std::move(job));
+    std::push_heap(m->deadlineJobQ.begin(), m->deadlineJobQ.end(), laterDeadline);
+    m->noteQueueDepth();
+    m->autoscale(lck);
+    m->addWorker(lck);
+    m->condition.notify_one();
+    m->lastJobId++;
+    lck.unlock();
+    if (hook)
+        (*hook)(trace);
+
+    return 0;
+}
+
 int ThreadPool::addJob(std::unique_ptr<JobWorker> worker, ThreadPriority prio)
 {
     std::unique_lock<std::mutex> lck(m->mutex);
+    if (m->shuttingdown) {
+        return ESHUTTINGDOWN;
+    }
 
-    int totalJobs = m->highJobQ.size() + m->lowJobQ.size() + m->medJobQ.size();
+    int totalJobs = static_cast<int>(m->queuedJobs());
     if (totalJobs >= m->attr.maxJobsTotal) {
         LOGERR("ThreadPool::addJob: too many jobs: " << totalJobs << "\n");
-        return 0;
+        m->stats.droppedJobs++;
+        lck.unlock();
+        worker.reset();
+        return ETOOMANYJOBS;
     }
 
     auto job = std::make_unique<ThreadPoolJob>(std::move(worker), prio, m->lastJobId, steady_clock::now());
+    job->typestats = m->jobTypeStats(*job->m_worker);
+    auto hook = m->traceHook;
+    auto trace = traceEvent(ThreadPoolTraceEvent::ENQUEUE, *job, job->requestTime);
     switch (job->priority) {
     case HIGH_PRIORITY:
         m->highJobQ.push_back(std::move(job));
@@ -615,11 +1175,16 @@ int ThreadPool::addJob(std::unique_ptr<JobWorker> worker, ThreadPriority prio)
     default:
         m->lowJobQ.push_back(std::move(job));
     }
-    /* AddWorker if appropriate */
+    m->noteQueueDepth();
+    /* Apply the latency-based policy, then AddWorker if appropriate */
+    m->autoscale(lck);
     m->addWorker(lck);
     /* Notify a waiting thread */
     m->condition.notify_one();
     m->lastJobId++;
+    lck.unlock();
+    if (hook)
+        (*hook)(trace);
 
     return 0;
 }
@@ -650,6 +1215,7 @@ int ThreadPool::setAttr(const ThreadPoolAttr* attr)
         return INVALID_POLICY;
     }
     m->attr = temp;
+    m->schedGeneration++;
     /* add threads */
     if (m->totalThreads < m->attr.minThreads) {
         for (auto i = m->totalThreads; i < m->attr.minThreads; i++) {
@@ -670,6 +1236,16 @@ int ThreadPool::setAttr(const ThreadPoolAttr* attr)
     return retCode;
 }
 
+void ThreadPool::setTraceHook(ThreadPoolTraceHook hook)
+{
+    std::scoped_lock lck(m->mutex);
+    if (hook) {
+        m->traceHook = std::make_shared<ThreadPoolTraceHook>(std::move(hook));
+    } else {
+        m->traceHook.reset();
+    }
+}
+
 int ThreadPool::shutdown()
 {
     if (m)
@@ -681,21 +1257,44 @@ int ThreadPool::Internal::shutdown()
 {
     std::unique_lock<std::mutex> lck(mutex);
 
-    this->highJobQ.clear();
+    /* The queued jobs are deleted after releasing the lock: a job which did not get to run may
+       do work in its destructor, e.g. calling the application. */
+    std::deque<std::unique_ptr<ThreadPoolJob>> dropped;
+    dropped.swap(this->highJobQ);
+    std::move(this->medJobQ.begin(), this->medJobQ.end(), std::back_inserter(dropped));
+    std::move(this->lowJobQ.begin(), this->lowJobQ.end(), std::back_inserter(dropped));
+    std::move(this->deadlineJobQ.begin(), this->deadlineJobQ.end(), std::back_inserter(dropped));
     this->medJobQ.clear();
     this->lowJobQ.clear();
+    this->deadlineJobQ.clear();
 
     /* clean up long term job */
     if (this->persistentJob) {
-        this->persistentJob = nullptr;
+        dropped.push_back(std::move(this->persistentJob));
     }
     /* signal shutdown */
     this->shuttingdown = true;
     this->condition.notify_all();
+    /* ask the running jobs to return. The workers can't be deleted while we do this. */
+    std::vector<JobWorker*> running;
+    for (const auto& worker : this->workers) {
+        if (worker.running)
+            running.push_back(worker.running);
+    }
+    this->cancelling++;
+    lck.unlock();
+    for (auto worker : running) {
+        worker->cancel();
+    }
+    dropped.clear();
+    lck.lock();
+    this->cancelling--;
+    this->start_and_shutdown.notify_all();
     /* wait for all threads to finish */
-    while (this->totalThreads > 0) {
+    while (!this->workers.empty()) {
         this->start_and_shutdown.wait(lck);
     }
+    reapWorkers();
 
     return 0;
 }
@@ -709,24 +1308,70 @@ int ThreadPool::getStats(ThreadPoolStats *stats)
     if (!m->shuttingdown)
         lck.lock();
 
-    *stats = m->stats;
-    if (stats->totalJobsHQ > 0)
-        stats->avgWaitHQ = stats->totalTimeHQ / static_cast<double>(stats->totalJobsHQ);
+    m->countersSnapshot(stats);
+    m->statsSnapshot(stats);
+
+    return 0;
+}
+
+int ThreadPool::getCounters(ThreadPoolCounters *counters)
+{
+    if (nullptr == counters)
+        return EINVAL;
+    std::unique_lock<std::mutex> lck(m->mutex, std::defer_lock);
+    if (!m->shuttingdown)
+        lck.lock();
+
+    m->countersSnapshot(counters);
+
+    return 0;
+}
+
+/* Copy the counters and compute the averages. The mutex must be locked. */
+void ThreadPool::Internal::countersSnapshot(ThreadPoolCounters *out)
+{
+    *out = stats;
+    if (out->totalJobsHQ > 0)
+        out->avgWaitHQ = out->totalTimeHQ / static_cast<double>(out->totalJobsHQ);
     else
-        stats->avgWaitHQ = 0.0;
-    if (stats->totalJobsMQ > 0)
-        stats->avgWaitMQ = stats->totalTimeMQ / static_cast<double>(stats->totalJobsMQ);
+        out->avgWaitHQ = 0.0;
+    if (out->totalJobsMQ > 0)
+        out->avgWaitMQ = out->totalTimeMQ / static_cast<double>(out->totalJobsMQ);
     else
-        stats->avgWaitMQ = 0.0;
-    if (stats->totalJobsLQ > 0)
-        stats->avgWaitLQ = stats->totalTimeLQ / static_cast<double>(stats->totalJobsLQ);
+        out->avgWaitMQ = 0.0;
+    if (out->totalJobsLQ > 0)
+        out->avgWaitLQ = out->totalTimeLQ / static_cast<double>(out->totalJobsLQ);
     else
-        stats->avgWaitLQ = 0.0;
-    stats->totalThreads = m->totalThreads;
-    stats->persistentThreads = m->persistentThreads;
-    stats->currentJobsHQ = static_cast<int>(m->highJobQ.size());
-    stats->currentJobsLQ = static_cast<int>(m->lowJobQ.size());
-    stats->currentJobsMQ = static_cast<int>(m->medJobQ.size());
+        out->avgWaitLQ = 0.0;
+    out->totalThreads = totalThreads;
+    out->persistentThreads = persistentThreads;
+    out->currentJobsHQ = static_cast<int>(highJobQ.size());
+    out->currentJobsLQ = static_cast<int>(lowJobQ.size());
+    out->currentJobsMQ = static_cast<int>(medJobQ.size());
+    out->currentJobsDeadline = static_cast<int>(deadlineJobQ.size());
+}
 
-    return 0;
+/* Copy the histograms directly into the caller's structure. The mutex must be locked (for
+   the jobTypes map). */
+void ThreadPool::Internal::statsSnapshot(ThreadPoolStats *out)
+{
+    for (int i = LOW_PRIORITY; i <= HIGH_PRIORITY; i++) {
+        waitHist[i].snapshot(out->waitHist[i]);
+        runHist[i].snapshot(out->runHist[i]);
+    }
+    deadlineLateness.snapshot(out->deadlineLateness);
+    // Sort the sources by name, and fill the output entries (about 5 KB each) in place.
+    std::vector<const JobTypeHistograms*> sorted;
+    sorted.reserve(jobTypes.size());
+    for (const auto& [_, entry] : jobTypes)
+        sorted.push_back(entry.get());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto a, const auto b) { return a->name < b->name; });
+    out->jobTypes.resize(sorted.size());
+    for (size_t i = 0; i < sorted.size(); i++) {
+        auto& ts = out->jobTypes[i];
+        ts.name = sorted[i]->name;
+        sorted[i]->wait.snapshot(ts.wait);
+        sorted[i]->run.snapshot(ts.run);
+    }
 }
@@ -59,28 +59,42 @@ struct TimerEvent {
     ThreadPool::ThreadPriority priority;
     /*! [in] Long term or short term job. */
     TimerThread::Duration persistent;
+    /*! [in] If set, the job is queued as a deadline job */
+    bool hasDeadline{false};
+    steady_clock::time_point deadline;
+    /*! [in] Pool where the job is queued. If null, the timer pool */
+    ThreadPool *target{nullptr};
 };
 
 
 // This is the worker for the permanent timer thread, in charge of dispatching jobs at appropriate
-// times
+// times. It shares the timer data: the TimerThread may be deleted as soon as work() has returned,
+// while the pool may still call cancel().
 class TimerJobWorker : public JobWorker {
 public:
-    explicit TimerJobWorker(TimerThread::Internal* parent)
-        : m_parent(parent) {}
+    explicit TimerJobWorker(std::shared_ptr<TimerThread::Internal> parent)
+        : m_parent(std::move(parent)) {}
     void work() override;
-    TimerThread::Internal *m_parent;
+    void cancel() override;
+    std::shared_ptr<TimerThread::Internal> m_parent;
 };
 
 class TimerThread::Internal {
 public:
-    explicit Internal(ThreadPool *tp);
+    explicit Internal(ThreadPool *_tp)
+        : tp(_tp) {}
     virtual ~Internal() = default;
+    int insert(Duration persistence, system_clock::time_point when, int *id,
+               std::unique_ptr<JobWorker> worker, ThreadPool::ThreadPriority priority,
+               bool hasDeadline, steady_clock::time_point deadline,
+               ThreadPool *target = nullptr);
     std::mutex mutex;
     std::condition_variable condition;
     int lastEventId{0};
     std::list<TimerEvent> eventQ;
     int inshutdown{0};
+    /*! Set while the timer job is running */
+    bool running{false};
     ThreadPool *tp{nullptr};
 };
 
@@ -91,7 +105,7 @@ public:
  */
 void TimerJobWorker::work()
 {
-    auto timer = m_parent;
+    auto timer = m_parent.get();
     assert(timer != nullptr);
     std::unique_lock<std::mutex> lck(timer->mutex);
 
@@ -100,6 +114,7 @@ void TimerJobWorker::work()
         /* Check for shutdown. */
         if (timer->inshutdown) {
             timer->inshutdown = 0;
+            timer->running = false;
             timer->condition.notify_all();
             return;
         }
@@ -109,10 +124,13 @@ void TimerJobWorker::work()
             TimerEvent& nextEvent(timer->eventQ.front());
             if (currentTime >= nextEvent.eventTime) {
                 /* If time has elapsed, schedule job. */
+                ThreadPool *tp = nextEvent.target ? nextEvent.target : timer->tp;
                 if (timer->eventQ.front().persistent) {
-                    timer->tp->addPersistent(std::move(nextEvent.worker), nextEvent.priority);
+                    tp->addPersistent(std::move(nextEvent.worker), nextEvent.priority);
+                } else if (nextEvent.hasDeadline) {
+                    tp->addJob(std::move(nextEvent.worker), nextEvent.deadline);
                 } else {
-                    timer->tp->addJob(std::move(nextEvent.worker), nextEvent.priority);
+                    tp->addJob(std::move(nextEvent.worker), nextEvent.priority);
                 }
                 timer->eventQ.pop_front();
             } else {
@@ -125,47 +143,61 @@ void TimerJobWorker::work()
     }
 }
 
-TimerThread::Internal::Internal(ThreadPool *tp)
+// Called by ThreadPool::shutdown() if the timer was not shut down first.
+void TimerJobWorker::cancel()
 {
-    std::scoped_lock lck(mutex);
-    this->tp = tp;
-    auto worker = std::make_unique<TimerJobWorker>(this);
-    tp->addPersistent(std::move(worker), ThreadPool::HIGH_PRIORITY);
+    std::scoped_lock lck(m_parent->mutex);
+    m_parent->inshutdown = 1;
+    m_parent->condition.notify_all();
 }
 
-TimerThread::TimerThread(ThreadPool *tp)
+TimerThread::TimerThread(ThreadPool *tp, const ThreadSchedAttr *sched)
 {
     assert(tp != nullptr);
     if (nullptr == tp) {
         return;
     }
-    m = std::make_unique<Internal>(tp);
+    m = std::make_shared<Internal>(tp);
+    std::scoped_lock lck(m->mutex);
+    auto worker = std::make_unique<TimerJobWorker>(m);
+    m->running = true;
+    if (tp->addPersistent(std::move(worker), ThreadPool::HIGH_PRIORITY, sched) != 0) {
+        m->running = false;
+    }
 }
 
 TimerThread::~TimerThread() = default;
 
 int TimerThread::schedule(
     Duration persistence, std::chrono::system_clock::time_point when, int *id,
-    std::unique_ptr<JobWorker> worker, ThreadPool::ThreadPriority priority
-    )
+    std::unique_ptr<JobWorker> worker, ThreadPool::ThreadPriority priority,
+    ThreadPool *target)
 {
-    std::scoped_lock lck(m->mutex);
+    return m->insert(persistence, when, id, std::move(worker), priority, false, {}, target);
+}
+
+int TimerThread::Internal::insert(
+    Duration persistence, system_clock::time_point when, int *id,
+    std::unique_ptr<JobWorker> worker, ThreadPool::ThreadPriority priority,
+    bool hasDeadline, steady_clock::time_point deadline, ThreadPool *target)
+{
+    std::scoped_lock lck(mutex);
 
     if (id) {
-        *id = m->lastEventId;
+        *id = lastEventId;
     }
     /* add job to Q. Q is ordered by eventTime with the head of the Q being
      * the next event. */
-    auto it = std::find_if(m->eventQ.begin(), m->eventQ.end(),
+    auto it = std::find_if(eventQ.begin(), eventQ.end(),
                            [=](const auto& e) { return e.eventTime >= when; });
-    if (it != m->eventQ.end())
-        m->eventQ.emplace(it, std::move(worker), priority, persistence, when, m->lastEventId);
-    else
-        m->eventQ.emplace_back(std::move(worker), priority, persistence, when, m->lastEventId);
+    it = eventQ.emplace(it, std::move(worker), priority, persistence, when, lastEventId);
+    it->hasDeadline = hasDeadline;
+    it->deadline = deadline;
+    it->target = target;
 
     /* signal change in Q. */
-    m->condition.notify_all();
-    m->lastEventId++;
+    condition.notify_all();
+    lastEventId++;
     return 0;
 }
 
@@ -179,10 +211,19 @@ int TimerThread::schedule(
     return TimerThread::schedule(persistence, when, id, std::move(worker), priority);
 }
 
+int TimerThread::schedule(
+    std::chrono::milliseconds delay, std::chrono::steady_clock::time_point deadline, int *id,
+    std::unique_ptr<JobWorker> worker)
+{
+    auto when = system_clock::now() + delay;
+    return m->insert(SHORT_TERM, when, id, std::move(worker), ThreadPool::HIGH_PRIORITY,
+                     true, deadline);
+}
+
 int TimerThread::schedule(
     Duration persistence, TimeoutType type, time_t time, int *id,
-    std::unique_ptr<JobWorker> worker, ThreadPool::ThreadPriority priority
-    )
+    std::unique_ptr<JobWorker> worker, ThreadPool::ThreadPriority priority,
+    ThreadPool *target)
 {
     system_clock::time_point when;
     if (type == TimerThread::ABS_SEC) {
@@ -190,7 +231,7 @@ int TimerThread::schedule(
     } else {
         when = system_clock::now() + std::chrono::seconds(time);
     }
-    return TimerThread::schedule(persistence, when, id, std::move(worker), priority);
+    return TimerThread::schedule(persistence, when, id, std::move(worker), priority, target);
 }
 
 int TimerThread::remove(int id)
@@ -211,11 +252,14 @@ int TimerThread::shutdown()
 {
     std::unique_lock<std::mutex> lck(m->mutex);
 
-    m->inshutdown = 1;
     m->eventQ.clear();
+    if (!m->running) {
+        return 0;
+    }
+    m->inshutdown = 1;
     m->condition.notify_all();
 
-    while (m->inshutdown) {
+    while (m->running) {
         /* wait for timer thread to shutdown. */
         m->condition.wait(lck);
     }
@@ -9,8 +9,8 @@
 #include "expatmm.h"
 #define XMLPARSERTP inputRefXMLParser
 #else
-#include "picoxml.h"
-#define XMLPARSERTP PicoXMLParser
+#include "picoxmlview.h"
+#define XMLPARSERTP PicoXMLViewParser
 #endif
 
 #include "genut.h"
@@ -32,7 +32,7 @@ protected:
         // would use both for different purposes
         bool ismain = true;
         for (const auto& e : m_path) {
-            if (!stringlowercmp("devicelist", e.name)) {
+            if (e.name.size() == 10 && !strncasecmp(e.name.data(), "devicelist", 10)) {
                 ismain = false;
                 break;
             }
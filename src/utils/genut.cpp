@@ -31,9 +31,14 @@
 
 #include "genut.h"
 
+#include <cstdint>
 #include <cstring>
 #include <string>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 size_t upnp_strlcpy(char *dst, const char *src, size_t dsize)
 {
     if (nullptr == dst || 0 == dsize)
@@ -61,37 +66,149 @@ size_t upnp_strlcpy(char *dst, const char *src, size_t dsize)
     return dsize - cnt + 1;
 }
 
+// Quoting is needed for 5 characters only, and most values contain none of
+// them. Look for them 16 bytes at a time with SSE2 where available,
+// then 8 bytes at a time using the classic "has a zero byte" bit trick on the
+// value xored with each of the characters. The wide loops stop on the first
+// block which contains a special character, and the narrower ones locate it.
+static const uint64_t swar_ones = 0x0101010101010101ULL;
+static const uint64_t swar_highs = 0x8080808080808080ULL;
+
+static inline uint64_t swar_haszero(uint64_t v)
+{
+    return (v - swar_ones) & ~v & swar_highs;
+}
+
+static inline std::string_view xmlQuoteEntity(char c)
+{
+    switch (c) {
+    case '"': return "&quot;";
+    case '&': return "&amp;";
+    case '<': return "&lt;";
+    case '>': return "&gt;";
+    case '\'': return "&apos;";
+    default: return {};
+    }
+}
+
+// Return the length of the initial part of the input which needs no quoting
+static size_t xmlCleanSpan(const char *s, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i apos = _mm_set1_epi8('\'');
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quot), _mm_cmpeq_epi8(v, amp)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)),
+                         _mm_cmpeq_epi8(v, apos)));
+        int mask = _mm_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, s + i, 8);
+        if (swar_haszero(v ^ (swar_ones * '"')) | swar_haszero(v ^ (swar_ones * '&')) |
+            swar_haszero(v ^ (swar_ones * '<')) | swar_haszero(v ^ (swar_ones * '>')) |
+            swar_haszero(v ^ (swar_ones * '\''))) {
+            break;
+        }
+    }
+    while (i < len && xmlQuoteEntity(s[i]).empty())
+        i++;
+    return i;
+}
+
 std::string xmlQuote(const std::string& in)
 {
     std::string out;
     out.reserve(in.size());
-    for (char i : in) {
-        switch (i) {
-        case '"':
-            out += "&quot;";
-            break;
-        case '&':
-            out += "&amp;";
-            break;
-        case '<':
-            out += "&lt;";
-            break;
-        case '>':
-            out += "&gt;";
+    xmlQuoteAppend(out, in);
+    return out;
+}
+
+void xmlQuoteAppend(std::string& out, std::string_view in)
+{
+    while (!in.empty()) {
+        auto clean = xmlCleanSpan(in.data(), in.size());
+        out.append(in.data(), clean);
+        if (clean == in.size())
             break;
-        case '\'':
-            out += "&apos;";
+        out += xmlQuoteEntity(in[clean]);
+        in.remove_prefix(clean + 1);
+    }
+}
+
+size_t xmlQuotedSize(std::string_view in)
+{
+    size_t size = in.size();
+    while (!in.empty()) {
+        auto clean = xmlCleanSpan(in.data(), in.size());
+        if (clean == in.size())
             break;
-        default:
-            out += i;
-        }
+        size += xmlQuoteEntity(in[clean]).size() - 1;
+        in.remove_prefix(clean + 1);
     }
-    return out;
+    return size;
+}
+
+void soapBuildMessage(
+    std::string& out, std::initializer_list<std::string_view> prolog,
+    std::string_view actname, std::string_view namesuffix, std::string_view servicetype,
+    const std::vector<std::pair<std::string, std::string>>& args, std::string_view epilog)
+{
+    static const std::string_view elstart{"<u:"};
+    static const std::string_view nsstart{R"( xmlns:u=")"};
+    static const std::string_view nsend{"\">\n"};
+    static const std::string_view elclose{"</u:"};
+
+    size_t size = epilog.size();
+    for (const auto& piece : prolog)
+        size += piece.size();
+    // <u:NameSuffix xmlns:u="st">\n ... </u:NameSuffix>\n
+    size += elstart.size() + nsstart.size() + nsend.size() + elclose.size() + 2 +
+        2 * (actname.size() + namesuffix.size()) + servicetype.size();
+    // <name>value</name>\n
+    for (const auto& [name, val] : args)
+        size += 2 * name.size() + 6 + xmlQuotedSize(val);
+
+    out.clear();
+    out.reserve(size);
+    for (const auto& piece : prolog)
+        out += piece;
+    out += elstart;
+    out += actname;
+    out += namesuffix;
+    out += nsstart;
+    out += servicetype;
+    out += nsend;
+    for (const auto& [name, val] : args) {
+        out += '<';
+        out += name;
+        out += '>';
+        xmlQuoteAppend(out, val);
+        out += "</";
+        out += name;
+        out += ">\n";
+    }
+    out += elclose;
+    out += actname;
+    out += namesuffix;
+    out += ">\n";
+    out += epilog;
 }
 
-int dom_cmp_name(const std::string& domname, const std::string& ref)
+int dom_cmp_name(std::string_view domname, std::string_view ref)
 {
-    std::string::size_type colon = domname.find(':');
-    return colon == std::string::npos ?
-        domname.compare(ref) : domname.compare(colon+1, std::string::npos, ref);
+    auto colon = domname.find(':');
+    return colon == std::string_view::npos ?
+        domname.compare(ref) : domname.compare(colon+1, std::string_view::npos, ref);
 }
@@ -35,18 +35,25 @@
 #include "config.h"
 #include "httputils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <iostream>
+#include <mutex>
 #include <unordered_map>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <curl/curl.h>
 #include <microhttpd.h>
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "genut.h"
 #include "statcodes.h"
@@ -328,6 +335,269 @@ bool has_xml_content_type(MHDTransaction *mhdt)
     return true;
 }
 
+/* Response compression. Off by default, see UpnpSetResponseCompression(). Read by the
+   connection threads while the application may change them. */
+static std::atomic<bool> gCompressionEnabled{false};
+static std::atomic<size_t> gCompressionMinSize{1024};
+
+bool http_set_compression(bool enable, size_t minsize)
+{
+#ifdef USE_ZLIB
+    gCompressionEnabled = enable;
+    gCompressionMinSize = minsize;
+    return true;
+#else
+    (void)minsize;
+    return !enable;
+#endif
+}
+
+bool http_compression_possible(uint64_t datasize)
+{
+    return gCompressionEnabled &&
+        (datasize == MHD_SIZE_UNKNOWN || datasize >= gCompressionMinSize);
+}
+
+HttpContentCoding http_choose_coding(const MHDTransaction *mhdt, uint64_t datasize)
+{
+    if (!http_compression_possible(datasize))
+        return HttpContentCoding::IDENTITY;
+    auto it = mhdt->headers.find("accept-encoding");
+    if (it == mhdt->headers.end())
+        return HttpContentCoding::IDENTITY;
+
+    // Quality values from the header, -1 if the coding is not listed.
+    double gzipq{-1}, deflateq{-1}, starq{-1};
+    std::vector<std::string> elements;
+    stringToTokens(it->second, elements, ",");
+    for (auto& element : elements) {
+        double q{1};
+        auto semicol = element.find(';');
+        if (semicol != std::string::npos) {
+            std::string param = element.substr(semicol + 1);
+            trimstring(param);
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+                q = atof(param.c_str() + 2);
+            element.erase(semicol);
+        }
+        trimstring(element);
+        stringtolower(element);
+        const auto& coding = element;
+        if (coding == "gzip" || coding == "x-gzip") {
+            gzipq = q;
+        } else if (coding == "deflate") {
+            deflateq = q;
+        } else if (coding == "*") {
+            starq = q;
+        }
+    }
+    if (gzipq < 0)
+        gzipq = starq;
+    if (deflateq < 0)
+        deflateq = starq;
+    if (gzipq <= 0 && deflateq <= 0)
+        return HttpContentCoding::IDENTITY;
+    return gzipq >= deflateq ? HttpContentCoding::GZIP : HttpContentCoding::DEFLATE;
+}
+
+const char *http_coding_name(HttpContentCoding coding)
+{
+    switch (coding) {
+    case HttpContentCoding::GZIP: return "gzip";
+    case HttpContentCoding::DEFLATE: return "deflate";
+    default: return "identity";
+    }
+}
+
+#ifdef USE_ZLIB
+/* HTTP "deflate" is the zlib format, gzip is the same with a different wrapper */
+static bool compressor_init(z_stream *zs, HttpContentCoding coding)
+{
+    *zs = z_stream{};
+    int windowbits = coding == HttpContentCoding::GZIP ? 15 + 16 : 15;
+    return deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowbits, 8,
+                        Z_DEFAULT_STRATEGY) == Z_OK;
+}
+#endif
+
+bool http_compress(std::string_view data, HttpContentCoding coding, std::string& out)
+{
+#ifdef USE_ZLIB
+    z_stream zs;
+    if (coding == HttpContentCoding::IDENTITY || !compressor_init(&zs, coding))
+        return false;
+    out.resize(deflateBound(&zs, static_cast<uLong>(data.size())));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        UpnpPrintf(UPNP_ERROR, HTTP, __FILE__, __LINE__, "http_compress: deflate error %d\n", ret);
+        return false;
+    }
+    return true;
+#else
+    (void)data;
+    (void)coding;
+    (void)out;
+    return false;
+#endif
+}
+
+static void add_coding_headers(struct MHD_Response *response, HttpContentCoding coding)
+{
+    MHD_add_response_header(response, "Content-Encoding", http_coding_name(coding));
+    MHD_add_response_header(response, "Vary", "Accept-Encoding");
+}
+
+struct MHD_Response *http_create_data_response(MHDTransaction *mhdt, std::string_view data)
+{
+    auto coding = http_choose_coding(mhdt, data.size());
+    if (coding != HttpContentCoding::IDENTITY) {
+        std::string compressed;
+        if (http_compress(data, coding, compressed)) {
+            auto response = MHD_create_response_from_buffer(
+                compressed.size(), compressed.data(), MHD_RESPMEM_MUST_COPY);
+            if (response)
+                add_coding_headers(response, coding);
+            return response;
+        }
+    }
+    auto response = MHD_create_response_from_buffer(
+        data.size(), const_cast<char*>(data.data()), MHD_RESPMEM_MUST_COPY);
+    // Another request could get a compressed version: caches must know.
+    if (response && http_compression_possible(data.size()))
+        MHD_add_response_header(response, "Vary", "Accept-Encoding");
+    return response;
+}
+
+#ifdef USE_ZLIB
+/* Wraps a content reader, and compresses its output */
+class CompressingReader {
+public:
+    CompressingReader(size_t blocksize, MHD_ContentReaderCallback crc, void *crc_cls,
+                      MHD_ContentReaderFreeCallback crfc)
+        : m_in(blocksize, 0), m_crc(crc), m_crc_cls(crc_cls), m_crfc(crfc) {}
+    ~CompressingReader() {
+        if (m_initok)
+            deflateEnd(&m_zs);
+        if (m_crfc)
+            m_crfc(m_crc_cls);
+    }
+    CompressingReader(const CompressingReader&) = delete;
+    CompressingReader& operator=(const CompressingReader&) = delete;
+
+    // Give up ownership of the wrapped reader data
+    void release() {
+        m_crfc = nullptr;
+    }
+
+    bool init(HttpContentCoding coding) {
+        m_initok = compressor_init(&m_zs, coding);
+        return m_initok;
+    }
+
+    ssize_t read(char *buf, size_t max) {
+        if (m_done)
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        m_zs.next_out = reinterpret_cast<Bytef*>(buf);
+        m_zs.avail_out = static_cast<uInt>(std::min(max, size_t(UINT32_MAX)));
+        auto initialavail = m_zs.avail_out;
+        for (;;) {
+            if (m_zs.avail_in == 0 && !m_eof) {
+                ssize_t cnt = m_crc(m_crc_cls, m_inpos, m_in.data(), m_in.size());
+                if (cnt == MHD_CONTENT_READER_END_OF_STREAM) {
+                    m_eof = true;
+                } else if (cnt < 0) {
+                    return MHD_CONTENT_READER_END_WITH_ERROR;
+                } else if (cnt == 0) {
+                    // Source not ready. Return what we have, MHD will call again.
+                    break;
+                } else {
+                    m_inpos += cnt;
+                    m_zs.next_in = reinterpret_cast<Bytef*>(m_in.data());
+                    m_zs.avail_in = static_cast<uInt>(cnt);
+                }
+            }
+            int ret = deflate(&m_zs, m_eof ? Z_FINISH : Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                m_done = true;
+                break;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                UpnpPrintf(UPNP_ERROR, HTTP, __FILE__, __LINE__,
+                           "CompressingReader: deflate error %d\n", ret);
+                return MHD_CONTENT_READER_END_WITH_ERROR;
+            }
+            if (m_zs.avail_out == 0)
+                break;
+        }
+        auto produced = initialavail - m_zs.avail_out;
+        if (produced == 0 && m_done)
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        return static_cast<ssize_t>(produced);
+    }
+
+private:
+    z_stream m_zs;
+    bool m_initok{false};
+    std::string m_in;
+    uint64_t m_inpos{0};
+    bool m_eof{false};
+    bool m_done{false};
+    MHD_ContentReaderCallback m_crc;
+    void *m_crc_cls;
+    MHD_ContentReaderFreeCallback m_crfc;
+};
+
+static ssize_t compressing_reader(void *cls, uint64_t, char *buf, size_t max)
+{
+    return static_cast<CompressingReader*>(cls)->read(buf, max);
+}
+
+static void compressing_reader_free(void *cls)
+{
+    delete static_cast<CompressingReader*>(cls);
+}
+#endif /* USE_ZLIB */
+
+struct MHD_Response *http_create_callback_response(
+    MHDTransaction *mhdt, size_t blocksize, MHD_ContentReaderCallback crc,
+    void *crc_cls, MHD_ContentReaderFreeCallback crfc)
+{
+#ifdef USE_ZLIB
+    auto coding = http_choose_coding(mhdt, MHD_SIZE_UNKNOWN);
+    if (coding != HttpContentCoding::IDENTITY) {
+        auto reader = new CompressingReader(blocksize, crc, crc_cls, crfc);
+        if (reader->init(coding)) {
+            auto response = MHD_create_response_from_callback(
+                MHD_SIZE_UNKNOWN, blocksize, compressing_reader, reader, compressing_reader_free);
+            if (nullptr == response) {
+                // As for MHD, the caller's data is not freed on failure.
+                reader->release();
+                delete reader;
+                return nullptr;
+            }
+            add_coding_headers(response, coding);
+            return response;
+        }
+        // Let the caller's data go out uncompressed.
+        reader->release();
+        delete reader;
+    }
+#else
+    (void)mhdt;
+#endif
+    auto response =
+        MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, blocksize, crc, crc_cls, crfc);
+    if (response && http_compression_possible(MHD_SIZE_UNKNOWN))
+        MHD_add_response_header(response, "Vary", "Accept-Encoding");
+    return response;
+}
+
 bool timeout_header_value(std::map<std::string, std::string>& headers,
                           int *time_out)
 {
@@ -460,6 +730,108 @@ std::string query_encode(const std::string& qs)
     return out;
 }
 
+/* Cache of idle curl easy handles, indexed by host:port. A handle keeps its
+   connection open after a transfer, so using it again for the same host saves
+   a TCP connection setup. The most recently used handles are at the back. */
+struct IdleCurlHandle {
+    CURL *easy;
+    time_t lastuse;
+};
+static std::mutex gCurlCacheMutex;
+static std::unordered_map<std::string, std::vector<IdleCurlHandle>> gCurlCache;
+static size_t gCurlCacheMaxPerHost{HTTP_CLIENT_MAX_IDLE_PER_HOST};
+static int gCurlCacheIdleTimeout{HTTP_CLIENT_IDLE_TIMEOUT};
+static time_t gCurlCacheLastPrune;
+
+// Move the expired handles to the output vector. Called with the lock held.
+static void curl_cache_prune(time_t now, std::vector<CURL*>& expired)
+{
+    if (now == gCurlCacheLastPrune)
+        return;
+    gCurlCacheLastPrune = now;
+    for (auto it = gCurlCache.begin(); it != gCurlCache.end();) {
+        auto& handles = it->second;
+        // Handles are sorted by last use, oldest first.
+        auto first_alive = std::find_if(
+            handles.begin(), handles.end(), [now](const IdleCurlHandle& h) {
+                return now - h.lastuse < gCurlCacheIdleTimeout;});
+        for (auto hit = handles.begin(); hit != first_alive; hit++)
+            expired.push_back(hit->easy);
+        handles.erase(handles.begin(), first_alive);
+        if (handles.empty()) {
+            it = gCurlCache.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+CURL *http_get_curl_handle(const std::string& hostport)
+{
+    CURL *easy{nullptr};
+    std::vector<CURL*> expired;
+    {
+        std::scoped_lock lock(gCurlCacheMutex);
+        curl_cache_prune(time(nullptr), expired);
+        auto it = gCurlCache.find(hostport);
+        if (it != gCurlCache.end()) {
+            easy = it->second.back().easy;
+            it->second.pop_back();
+            if (it->second.empty())
+                gCurlCache.erase(it);
+        }
+    }
+    for (auto handle : expired)
+        curl_easy_cleanup(handle);
+    if (nullptr == easy) {
+        easy = curl_easy_init();
+    }
+    return easy;
+}
+
+void http_release_curl_handle(const std::string& hostport, CURL *easy, bool reusable)
+{
+    if (nullptr == easy)
+        return;
+    if (reusable) {
+        // Forget the options (which may point to the caller's data), but keep
+        // the connection and the DNS cache.
+        curl_easy_reset(easy);
+        std::scoped_lock lock(gCurlCacheMutex);
+        if (gCurlCacheMaxPerHost > 0) {
+            auto& handles = gCurlCache[hostport];
+            if (handles.size() < gCurlCacheMaxPerHost) {
+                handles.push_back({easy, time(nullptr)});
+                return;
+            }
+        }
+    }
+    curl_easy_cleanup(easy);
+}
+
+void http_set_curl_cache(int maxperhost, int idletimeoutsecs)
+{
+    {
+        std::scoped_lock lock(gCurlCacheMutex);
+        gCurlCacheMaxPerHost = maxperhost > 0 ? maxperhost : 0;
+        gCurlCacheIdleTimeout = idletimeoutsecs;
+    }
+    if (maxperhost <= 0)
+        http_clear_curl_handles();
+}
+
+void http_clear_curl_handles()
+{
+    std::unordered_map<std::string, std::vector<IdleCurlHandle>> cache;
+    {
+        std::scoped_lock lock(gCurlCacheMutex);
+        cache.swap(gCurlCache);
+    }
+    for (const auto& [hostport, handles] : cache)
+        for (const auto& handle : handles)
+            curl_easy_cleanup(handle.easy);
+}
+
 size_t header_callback_curl(char *buffer, size_t size, size_t nitems,
                             std::map<std::string, std::string> *headers)
 {
@@ -17,8 +17,14 @@
 
 #include "utf8iter.h"
 
+#include <array>
+#include <cstring>
 #include <unordered_set>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 void utf8truncate(std::string& s, int maxlen, int flags, const std::string& ellipsis,
                   const std::string& ws)
 {
@@ -90,34 +96,77 @@ size_t utf8len(const std::string& s)
 
 static const std::string replchar{"\xef\xbf\xbd"};
 
-// Check utf-8 encoding, replacing errors with the ? char above
+// Sequence length for each possible lead byte, 0 for bytes which can't start
+// a character. Same rules as Utf8Iter::get_cl()
+static constexpr std::array<uint8_t, 256> utf8seqlens()
+{
+    std::array<uint8_t, 256> lens{};
+    for (unsigned int z = 0; z < 256; z++) {
+        lens[z] = z <= 127 ? 1 : (z & 224) == 192 ? 2 : (z & 240) == 224 ? 3 :
+            (z & 248) == 240 ? 4 : 0;
+    }
+    return lens;
+}
+static constexpr std::array<uint8_t, 256> utf8_seqlen = utf8seqlens();
+
+// Return the length of the initial pure ASCII part of the input, looking
+// at 16 (SSE2) or 8 bytes at a time.
+static size_t utf8asciispan(const unsigned char *s, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, s + i, 8);
+        if (v & 0x8080808080808080ULL)
+            break;
+    }
+    while (i < len && s[i] < 128)
+        i++;
+    return i;
+}
+
+// Check utf-8 encoding, replacing errors with the ? char above. ASCII runs
+// are skipped in bulk, the multibyte sequences are checked with the lead
+// byte table, and the valid data is copied to the output in whole spans.
 int utf8check(const std::string& in, bool fixit, std::string *out, int maxrepl)
 {
     int cnt = 0;
-    Utf8Iter it(in);
-    for (;!it.eof(); it++) {
-        if (it.error()) {
-            if (!fixit) {
-                return -1;
-            }
-            *out += replchar;
-            ++cnt;
-            for (; cnt < maxrepl; cnt++) {
-                it.retryfurther();
-                if (it.eof())
-                    return cnt;
-                if (!it.error())
-                    break;
-                *out += replchar;
-            }
-            if (it.error()) {
-                return -1;
-            }
+    const auto s = reinterpret_cast<const unsigned char*>(in.data());
+    const size_t len = in.size();
+    size_t pos = 0;
+    // Start of the valid data not yet copied to the output
+    size_t copied = 0;
+    while (pos < len) {
+        pos += utf8asciispan(s + pos, len - pos);
+        if (pos == len)
+            break;
+        size_t l = utf8_seqlen[s[pos]];
+        bool ok = l > 0 && pos + l <= len;
+        for (size_t i = 1; ok && i < l; i++) {
+            ok = (s[pos + i] & 192) == 128;
         }
-        // We have reached a good char and eof is false
-        if (fixit) {
-            it.appendchartostring(*out);
+        if (ok) {
+            pos += l;
+            continue;
         }
+        if (!fixit || ++cnt >= maxrepl) {
+            return -1;
+        }
+        // Replace the bad byte and retry from the next one
+        out->append(in, copied, pos - copied);
+        *out += replchar;
+        copied = ++pos;
+    }
+    if (fixit) {
+        out->append(in, copied, len - copied);
     }
     return cnt;
 }
@@ -198,6 +198,9 @@ static std::string gWebServerCorsString;
 struct LocalDoc {
     std::string data;
     time_t last_modified{};
+    // Compressed versions, computed on first request.
+    std::string gzipdata;
+    std::string deflatedata;
 };
 
 // Data which we serve directly: usually description
@@ -242,7 +245,7 @@ int web_server_set_localdoc(const std::string& path, const std::string& data, ti
     if (path.empty() || path.front() != '/') {
         return UPNP_E_INVALID_PARAM;
     }
-    LocalDoc doc{data, last_modified};
+    LocalDoc doc{data, last_modified, {}, {}};
     std::scoped_lock lck(gWebMutex);
     localDocs[path] = doc;
     return UPNP_E_SUCCESS;
@@ -257,6 +260,21 @@ int web_server_unset_localdoc(const std::string& path)
     return UPNP_E_SUCCESS;
 }
 
+/* Return the local document data in the chosen coding, compressing and
+   caching it on first use. Falls back to identity if compression fails. */
+static const std::string& localdoc_data(LocalDoc& doc, HttpContentCoding& coding)
+{
+    if (coding == HttpContentCoding::IDENTITY)
+        return doc.data;
+    auto& cached = coding == HttpContentCoding::GZIP ? doc.gzipdata : doc.deflatedata;
+    if (cached.empty() && !http_compress(doc.data, coding, cached)) {
+        cached.clear();
+        coding = HttpContentCoding::IDENTITY;
+        return doc.data;
+    }
+    return cached;
+}
+
 /* Get file information, local file system version */
 static int get_file_info(const char *filename, struct File_Info *info)
 {
@@ -424,6 +442,8 @@ static int process_request(
 {
     struct File_Info finfo;
     LocalDoc localdoc;
+    auto coding = HttpContentCoding::IDENTITY;
+    bool varies{false};
     
     assert(mhdt->method == HTTPMETHOD_GET ||
            mhdt->method == HTTPMETHOD_HEAD ||
@@ -483,7 +503,10 @@ static int process_request(
         // map<string,share_ptr> like the original, but I don't think
         // that the perf impact is significant
         if (localdocit != localDocs.end()) {
-            localdoc = localdocit->second;
+            varies = http_compression_possible(localdocit->second.data.size());
+            coding = http_choose_coding(mhdt, localdocit->second.data.size());
+            localdoc.data = localdoc_data(localdocit->second, coding);
+            localdoc.last_modified = localdocit->second.last_modified;
         }
     }
     if (entryp) {
@@ -597,6 +620,12 @@ static int process_request(
     if (!finfo.content_type.empty()) {
         headers["content-type"] = finfo.content_type;
     }
+    if (coding != HttpContentCoding::IDENTITY) {
+        headers["content-encoding"] = http_coding_name(coding);
+    }
+    if (varies) {
+        headers["vary"] = "Accept-Encoding";
+    }
     if (RespInstr->AcceptLanguageHeader[0] && WEB_SERVER_CONTENT_LANGUAGE[0]) {
         headers["content-language"] = WEB_SERVER_CONTENT_LANGUAGE;
     }
@@ -0,0 +1,154 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Compare the cost of a multi-step operation written as JobWorker objects which requeue each
+// other (as the GENA notification jobs do without coroutines), and as a PoolTask coroutine
+// which requeues itself with resumeOn(). Each chain runs a number of trivial steps, the
+// measure is the total number of steps per second.
+
+#include "ThreadPool.h"
+#include "PoolTask.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+#include <unistd.h>
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "bench_pooltask [-c chains] [-s steps] [-t threads]\n"
+    "  Run chains of requeued steps, as chained jobs and as coroutines (if available)\n"
+    "  Defaults: 64 chains of 20000 steps on 4 threads\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+static ThreadPool pool;
+static std::atomic<unsigned long> nsteps;
+static std::mutex donemutex;
+static std::condition_variable donecv;
+static int chainsleft;
+
+static void chainDone()
+{
+    std::unique_lock<std::mutex> lck(donemutex);
+    if (--chainsleft == 0)
+        donecv.notify_all();
+}
+
+class StepJobWorker : public JobWorker {
+public:
+    explicit StepJobWorker(int left)
+        : m_left(left) {}
+    void work() override {
+        nsteps++;
+        if (--m_left == 0) {
+            chainDone();
+            return;
+        }
+        if (pool.addJob(std::make_unique<StepJobWorker>(m_left)) != 0) {
+            cerr << "addJob failed\n";
+            exit(1);
+        }
+    }
+private:
+    int m_left;
+};
+
+#ifdef NPUPNP_HAVE_COROUTINES
+static PoolTask stepTask(int steps)
+{
+    for (int i = 0; i < steps; i++) {
+        nsteps++;
+        if (i != steps - 1)
+            co_await resumeOn(pool);
+    }
+    chainDone();
+}
+#endif
+
+// Start the chains and wait for them to complete. Returns the steps per second.
+template <typename F> static double runChains(int chains, F starter)
+{
+    nsteps = 0;
+    chainsleft = chains;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < chains; i++) {
+        if (starter() != 0) {
+            cerr << "Could not start chain\n";
+            exit(1);
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lck(donemutex);
+        donecv.wait(lck, [] { return chainsleft == 0; });
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return nsteps / elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    int chains = 64;
+    int steps = 20000;
+    int threads = 4;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:s:t:")) != -1) {
+        switch (opt) {
+        case 'c': chains = atoi(optarg); break;
+        case 's': steps = atoi(optarg); break;
+        case 't': threads = atoi(optarg); break;
+        default: Usage();
+        }
+    }
+    if (optind != argc || chains <= 0 || steps <= 0 || threads <= 0)
+        Usage();
+
+    ThreadPoolAttr attr;
+    attr.minThreads = threads;
+    attr.maxThreads = threads;
+    // Each chain has at most one queued job at any time.
+    attr.maxJobsTotal = chains + 10;
+    if (pool.start(&attr) != 0) {
+        cerr << "Could not start the thread pool\n";
+        return 1;
+    }
+
+    double jobrate = runChains(
+        chains, [steps] { return pool.addJob(std::make_unique<StepJobWorker>(steps)); });
+    cout << "Chained jobs: " << static_cast<long>(jobrate) << " steps/s\n";
+#ifdef NPUPNP_HAVE_COROUTINES
+    double corate = runChains(chains, [steps] { return stepTask(steps).start(pool); });
+    cout << "Coroutines:   " << static_cast<long>(corate) << " steps/s\n";
+#else
+    cout << "Coroutines:   not available (needs C++20)\n";
+#endif
+    pool.shutdown();
+    return 0;
+}
@@ -0,0 +1,385 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Time the SOAP message processing done by the device side, and measure its heap use (peak
+// bytes above the starting point, and allocation count, for one call):
+// - A Browse response with a big DIDL-Lite Result, built in memory and copied for the HTTP
+//   server (resdata), or produced progressively into the HTTP server buffer (resstream).
+// - Action requests, decoded by the full XML parser (args and xmlAction), or by the argument
+//   scanner, which decodes in place and returns views (UPNP_FLAG_ACTION_ARG_VIEWS). Only the
+//   C++ allocations are counted: with expat, its own buffers (malloc) are not.
+// - Control point action requests, built by soapBuildMessage(), or by a copy of the previous
+//   code (ostringstream and per-character xmlQuote()).
+
+#include "genut.h"
+#include "soap_message.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "bench_soapmsg [-n items] [-l loops]\n"
+    "  Run the SOAP message functions with a DIDL-Lite document of (default 2000) items,\n"
+    "  (default 50) times each, and print the average time, the peak heap use and the\n"
+    "  allocation count per call. The action requests are decoded 100 times more, and\n"
+    "  the control point requests are built 4000 times more.\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+// Heap accounting: all the allocations go through these. The size is stored in front of the
+// block. The program is single-threaded. operator delete is not inlined, else gcc warns about
+// free() being called on memory from operator new.
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+static size_t heapnow;
+static size_t heappeak;
+static size_t heapallocs;
+static constexpr size_t heaphdr{alignof(std::max_align_t)};
+
+void *operator new(size_t size)
+{
+    auto p = static_cast<char*>(malloc(size + heaphdr));
+    if (nullptr == p)
+        throw std::bad_alloc();
+    *reinterpret_cast<size_t*>(p) = size;
+    heapnow += size;
+    if (heapnow > heappeak)
+        heappeak = heapnow;
+    heapallocs++;
+    return p + heaphdr;
+}
+BENCH_NOINLINE void operator delete(void *p) noexcept
+{
+    if (nullptr == p)
+        return;
+    auto base = static_cast<char*>(p) - heaphdr;
+    heapnow -= *reinterpret_cast<size_t*>(base);
+    free(base);
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+
+static const string servicetype{"urn:schemas-upnp-org:service:ContentDirectory:1"};
+static const string soapepilog{"</s:Body></s:Envelope>"};
+
+static string makeDidl(int items)
+{
+    string didl(R"(<DIDL-Lite xmlns="urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/" )"
+                R"(xmlns:dc="http://purl.org/dc/elements/1.1/" )"
+                R"(xmlns:upnp="urn:schemas-upnp-org:metadata-1-0/upnp/">)");
+    for (int i = 0; i < items; i++) {
+        auto n = to_string(i);
+        didl += R"(<item id="0$=Artist$)" + n + R"(" parentID="0$=Artist" restricted="1">)"
+            "<dc:title>Track " + n + " - Les \xc3\xa9t\xc3\xa9s &amp; the \"Winters\"</dc:title>"
+            "<upnp:artist>Some Artist &lt;feat. Another&gt;</upnp:artist>"
+            "<upnp:album>An Album Title Which Is Somewhat Long</upnp:album>"
+            "<upnp:genre>Rock</upnp:genre>"
+            "<upnp:originalTrackNumber>" + n + "</upnp:originalTrackNumber>"
+            "<upnp:albumArtURI>http://192.168.1.10:9790/minimserver/*/Music/Artist/Album/"
+            "cover.jpg</upnp:albumArtURI>"
+            R"(<res duration="0:04:12.000" size="31245678" bitsPerSample="16" )"
+            R"(sampleFrequency="44100" nrAudioChannels="2" )"
+            R"(protocolInfo="http-get:*:audio/x-flac:DLNA.ORG_PN=FLAC;DLNA.ORG_OP=01">)"
+            "http://192.168.1.10:9790/minimserver/*/Music/Artist/Album/" + n +
+            "%20Track.flac</res></item>";
+    }
+    didl += "</DIDL-Lite>";
+    return didl;
+}
+
+// Run f once to measure its heap use, then loops times for the timing.
+static void measure(const char *what, int loops, const function<void()>& f)
+{
+    heappeak = heapnow;
+    auto base = heapnow;
+    auto allocs = heapallocs;
+    f();
+    auto peak = heappeak - base;
+    allocs = heapallocs - allocs;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < loops; i++)
+        f();
+    chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+    auto us = elapsed.count() / loops;
+    cout << what << ": ";
+    if (us < 10)
+        cout << static_cast<long>(us * 1000) << " ns";
+    else
+        cout << static_cast<long>(us) << " us";
+    cout << ", peak heap " << peak / 1024 << " KB, " << allocs << " allocations\n";
+}
+
+// The buffered response: the result values are quoted into the response string, which MHD
+// copies (MHD_RESPMEM_MUST_COPY, see http_create_data_response()).
+static string bufferedResponse(const vector<pair<string, string>>& resdata)
+{
+    string txt;
+    soapBuildMessage(txt, {soap_response_prolog}, "Browse", "Response", servicetype, resdata,
+                     soapepilog);
+    return txt;
+}
+
+static vector<UpnpStreamedArg> streamedArgs(const shared_ptr<const string>& didl,
+                                            const string& count)
+{
+    return {{"Result", UpnpStreamView(*didl, didl)}, {"NumberReturned", UpnpStreamValue(count)},
+            {"TotalMatches", UpnpStreamValue(count)}, {"UpdateID", UpnpStreamValue("1")}};
+}
+
+static void benchResponse(int items, int loops)
+{
+    auto didl = make_shared<const string>(makeDidl(items));
+    const string count = to_string(items);
+    // The application data, as it would be returned by the action callback.
+    const vector<pair<string, string>> resdata{
+        {"Result", *didl}, {"NumberReturned", count}, {"TotalMatches", count}, {"UpdateID", "1"}};
+    // The HTTP server buffer (MHD allocates it once per connection).
+    vector<char> mhdbuf(32 * 1024);
+
+    // Check that both methods produce the same data.
+    const string buffered = bufferedResponse(resdata);
+    string streamed;
+    {
+        ActionResponseStreamer streamer("Browse", servicetype, streamedArgs(didl, count));
+        size_t cnt;
+        while ((cnt = streamer.read(mhdbuf.data(), mhdbuf.size())) > 0)
+            streamed.append(mhdbuf.data(), cnt);
+    }
+    if (streamed != buffered) {
+        cerr << "The streamed and buffered responses differ\n";
+        exit(1);
+    }
+    cout << "Browse response, DIDL " << didl->size() << " bytes, response " << buffered.size() <<
+        " bytes\n";
+
+    size_t sink{0};
+    measure("buffered response (resdata)", loops, [&] {
+        auto txt = bufferedResponse(resdata);
+        string mhdcopy(txt);
+        sink += mhdcopy.size();
+    });
+    measure("streamed response (resstream)", loops, [&] {
+        ActionResponseStreamer streamer("Browse", servicetype, streamedArgs(didl, count));
+        size_t cnt;
+        while ((cnt = streamer.read(mhdbuf.data(), mhdbuf.size())) > 0)
+            sink += cnt;
+    });
+    if (sink == 0)
+        exit(1);
+}
+
+static string makeRequest(const string& actname, const vector<pair<string, string>>& args)
+{
+    string body;
+    soapBuildMessage(body, {soap_response_prolog}, actname, "",
+                     "urn:schemas-upnp-org:service:AVTransport:1", args, soapepilog);
+    return body;
+}
+
+static void benchRequest(const string& what, const string& actname,
+                         const vector<pair<string, string>>& args, int loops)
+{
+    const string request = makeRequest(actname, args);
+    // The scanner decodes in place: restore the body before each call. This does not allocate.
+    string body;
+    body.reserve(request.size());
+
+    // Check that both methods find the same arguments.
+    body = request;
+    string_view actqname;
+    vector<pair<string_view, string_view>> views;
+    if (!soap_scan_action_args(body, actname, actqname, views)) {
+        cerr << what << ": the argument scanner refused the request\n";
+        exit(1);
+    }
+    vector<pair<string, string>> parsed;
+    UPnPActionRequestParser parser(request, actname, parsed, false);
+    if (!parser.Parse() || parsed.size() != views.size() || parsed != args) {
+        cerr << what << ": bad parse result\n";
+        exit(1);
+    }
+    for (size_t i = 0; i < views.size(); i++) {
+        if (views[i].first != parsed[i].first || views[i].second != parsed[i].second) {
+            cerr << what << ": the scanner and the parser differ\n";
+            exit(1);
+        }
+    }
+    cout << what << ", " << request.size() << " bytes\n";
+
+    size_t sink{0};
+    measure("  full parser (args, xmlAction)", loops, [&] {
+        vector<pair<string, string>> args;
+        string xmlAction;
+        UPnPActionRequestParser parser(request, actname, args, false);
+        parser.Parse();
+        xmlAction.swap(parser.outxml);
+        sink += args.size() + xmlAction.size();
+    });
+    measure("  argument scanner (argviews)", loops, [&] {
+        body.assign(request);
+        string_view actqname;
+        vector<pair<string_view, string_view>> argviews;
+        soap_scan_action_args(body, actname, actqname, argviews);
+        sink += argviews.size();
+    });
+    if (sink == 0)
+        exit(1);
+}
+
+static void benchRequests(int loops)
+{
+    benchRequest("Browse request", "Browse", {
+            {"ObjectID", "0$=Artist$12$albums"}, {"BrowseFlag", "BrowseDirectChildren"},
+            {"Filter", "*"}, {"StartingIndex", "0"}, {"RequestedCount", "100"},
+            {"SortCriteria", ""}}, loops);
+    const string url{"http://192.168.1.10:9790/minimserver/*/Music/Artist/Album/01%20Track.flac"};
+    benchRequest("SetAVTransportURI request", "SetAVTransportURI", {
+            {"InstanceID", "0"}, {"CurrentURI", url}, {"CurrentURIMetaData", makeDidl(1)}},
+        loops);
+    benchRequest("SetAVTransportURI request, 50 items metadata", "SetAVTransportURI", {
+            {"InstanceID", "0"}, {"CurrentURI", url}, {"CurrentURIMetaData", makeDidl(50)}},
+        loops / 10 + 1);
+}
+
+// The previous control point request code (soap_prepare_action()), with the previous xmlQuote().
+static string oldXmlQuote(const string& in)
+{
+    string out;
+    out.reserve(in.size());
+    for (char i : in) {
+        switch (i) {
+        case '"': out += "&quot;"; break;
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '\'': out += "&apos;"; break;
+        default: out += i;
+        }
+    }
+    return out;
+}
+
+static const string xml_start{
+    R"(<?xml version="1.0" encoding="utf-8"?>)" "\r\n"
+    R"(<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" )"
+    R"(s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">)" "\r\n"};
+static const string xml_body_start{"<s:Body>"};
+static const string xml_end{"</s:Body>\r\n</s:Envelope>\r\n"};
+
+static string oldActionPayload(const string& actionName, const string& serviceType,
+                               const vector<pair<string, string>>& actionArgs)
+{
+    ostringstream act;
+    act << "<u:" << actionName << R"( xmlns:u=")" << serviceType << R"(">)" "\n";
+    for (const auto& [name, val] : actionArgs)
+        act << "<" << name << ">" << oldXmlQuote(val) << "</" << name << ">\n";
+    act << "</u:" << actionName << ">\n";
+    string payload = xml_start;
+    payload += xml_body_start + act.str() + xml_end;
+    return payload;
+}
+
+static string newActionPayload(const string& actionName, const string& serviceType,
+                               const vector<pair<string, string>>& actionArgs)
+{
+    string payload;
+    soapBuildMessage(payload, {xml_start, xml_body_start}, actionName, "", serviceType,
+                     actionArgs, xml_end);
+    return payload;
+}
+
+static void benchBuild(const string& what, const string& actname,
+                       const vector<pair<string, string>>& args, int loops)
+{
+    const string servicetype{"urn:schemas-upnp-org:service:AVTransport:1"};
+    const string payload = newActionPayload(actname, servicetype, args);
+    if (payload != oldActionPayload(actname, servicetype, args)) {
+        cerr << what << ": the old and new payloads differ\n";
+        exit(1);
+    }
+    cout << what << ", " << payload.size() << " bytes\n";
+
+    size_t sink{0};
+    measure("  ostringstream and xmlQuote (old)", loops, [&] {
+        sink += oldActionPayload(actname, servicetype, args).size();
+    });
+    measure("  soapBuildMessage", loops, [&] {
+        sink += newActionPayload(actname, servicetype, args).size();
+    });
+    if (sink == 0)
+        exit(1);
+}
+
+static void benchBuilds(int loops)
+{
+    benchBuild("Seek request, 2 small args", "Seek",
+               {{"InstanceID", "0"}, {"Unit", "REL_TIME"}}, loops);
+    benchBuild("SetAVTransportURI request", "SetAVTransportURI", {
+            {"InstanceID", "0"},
+            {"CurrentURI",
+             "http://192.168.1.10:9790/minimserver/*/Music/Artist/Album/01%20Track.flac"},
+            {"CurrentURIMetaData", makeDidl(1)}}, loops);
+    string text;
+    while (text.size() < 4096)
+        text += "Some plain text, with no characters which need escaping in XML. ";
+    text.resize(4096);
+    benchBuild("4 KB plain text arg", "SetText", {{"InstanceID", "0"}, {"Text", text}}, loops);
+}
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    int items = 2000;
+    int loops = 50;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:")) != -1) {
+        switch (opt) {
+        case 'n': items = atoi(optarg); break;
+        case 'l': loops = atoi(optarg); break;
+        default: Usage();
+        }
+    }
+    if (optind != argc || items <= 0 || loops <= 0)
+        Usage();
+
+    benchResponse(items, loops);
+    benchRequests(loops * 100);
+    benchBuilds(loops * 4000);
+    return 0;
+}
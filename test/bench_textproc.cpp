@@ -0,0 +1,202 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Time the text processing functions which run on the big action arguments: XML quoting
+// (xmlQuoteAppend()), parsing with entities (PicoXMLParser, PicoXMLViewParser, and expat if
+// available), and UTF-8 checking and repair (utf8check()). The data is a DIDL-Lite document
+// similar to a Browse result.
+
+#include "autoconfig.h"
+#include "genut.h"
+#include "picoxml.h"
+#include "picoxmlview.h"
+#include "utf8iter.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#ifdef USE_EXPAT
+#include "expatmm.h"
+#endif
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "bench_textproc [-n items] [-l loops]\n"
+    "  Run the text functions on a DIDL-Lite document of (default 50) items, (default 200)\n"
+    "  times each, and print the average time per call.\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+static string makeDidl(int items)
+{
+    string didl(R"(<DIDL-Lite xmlns="urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/" )"
+                R"(xmlns:dc="http://purl.org/dc/elements/1.1/" )"
+                R"(xmlns:upnp="urn:schemas-upnp-org:metadata-1-0/upnp/">)");
+    for (int i = 0; i < items; i++) {
+        auto n = to_string(i);
+        didl += R"(<item id="0$=Artist$)" + n + R"(" parentID="0$=Artist" restricted="1">)"
+            "<dc:title>Track " + n + " - Les \xc3\xa9t\xc3\xa9s &amp; the \"Winters\"</dc:title>"
+            "<upnp:artist>Some Artist &lt;feat. Another&gt;</upnp:artist>"
+            "<upnp:album>An Album Title Which Is Somewhat Long</upnp:album>"
+            "<upnp:genre>Rock</upnp:genre>"
+            "<upnp:originalTrackNumber>" + n + "</upnp:originalTrackNumber>"
+            "<upnp:albumArtURI>http://192.168.1.10:9790/minimserver/*/Music/Artist/Album/"
+            "cover.jpg</upnp:albumArtURI>"
+            R"(<res duration="0:04:12.000" size="31245678" bitsPerSample="16" )"
+            R"(sampleFrequency="44100" nrAudioChannels="2" )"
+            R"(protocolInfo="http-get:*:audio/x-flac:DLNA.ORG_PN=FLAC;DLNA.ORG_OP=01">)"
+            "http://192.168.1.10:9790/minimserver/*/Music/Artist/Album/" + n +
+            "%20Track.flac</res></item>";
+    }
+    didl += "</DIDL-Lite>";
+    return didl;
+}
+
+// The parsers count the character data, as the SOAP parsers would collect it.
+class CountingParser : public PicoXMLParser {
+public:
+    explicit CountingParser(const string& in)
+        : PicoXMLParser(in) {}
+    size_t chars{0};
+protected:
+    void characterData(const string& data) override {
+        chars += data.size();
+    }
+};
+
+class CountingViewParser : public PicoXMLViewParser {
+public:
+    explicit CountingViewParser(const string& in)
+        : PicoXMLViewParser(in) {}
+    size_t chars{0};
+protected:
+    void characterData(string_view data) override {
+        chars += data.size();
+    }
+};
+
+#ifdef USE_EXPAT
+class CountingExpatParser : public inputRefXMLParser {
+public:
+    explicit CountingExpatParser(const string& in)
+        : inputRefXMLParser(in) {}
+    size_t chars{0};
+protected:
+    void CharacterData(const XML_Char *, int len) override {
+        chars += len;
+    }
+};
+#endif
+
+template <typename P> static size_t parse(const string& doc)
+{
+    P parser(doc);
+    if (!parser.Parse()) {
+        cerr << "Parse failed\n";
+        exit(1);
+    }
+    return parser.chars;
+}
+
+static void timeit(const char *what, int loops, const function<void()>& f)
+{
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < loops; i++)
+        f();
+    chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+    cout << what << ": " << static_cast<long>(elapsed.count() / loops) << " us\n";
+}
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    int items = 50;
+    int loops = 200;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:")) != -1) {
+        switch (opt) {
+        case 'n': items = atoi(optarg); break;
+        case 'l': loops = atoi(optarg); break;
+        default: Usage();
+        }
+    }
+    if (optind != argc || items <= 0 || loops <= 0)
+        Usage();
+
+    const string didl = makeDidl(items);
+    string quoted;
+    xmlQuoteAppend(quoted, didl);
+    // The quoted document, as the value of a Result argument in a response
+    const string response = "<Result>" + quoted + "</Result>";
+    // A bigger document with one bad byte in the middle, for the repair
+    string big;
+    while (big.size() < 1024 * 1024)
+        big += didl;
+    string bad(big);
+    bad[bad.size() / 2] = '\xff';
+
+    cout << "DIDL " << didl.size() << " bytes, quoted " << quoted.size() << " bytes, " <<
+        "UTF-8 data " << big.size() << " bytes\n";
+    size_t sink{0};
+    timeit("escape DIDL", loops, [&] {
+        string out;
+        xmlQuoteAppend(out, didl);
+        sink += out.size();
+    });
+    timeit("parse quoted DIDL (picoxml)", loops, [&] {
+        sink += parse<CountingParser>(response);
+    });
+    timeit("parse quoted DIDL (picoxmlview)", loops, [&] {
+        sink += parse<CountingViewParser>(response);
+    });
+#ifdef USE_EXPAT
+    timeit("parse quoted DIDL (expat)", loops, [&] {
+        sink += parse<CountingExpatParser>(response);
+    });
+#endif
+    timeit("parse DIDL (picoxml)", loops, [&] {
+        sink += parse<CountingParser>(didl);
+    });
+    timeit("parse DIDL (picoxmlview)", loops, [&] {
+        sink += parse<CountingViewParser>(didl);
+    });
+#ifdef USE_EXPAT
+    timeit("parse DIDL (expat)", loops, [&] {
+        sink += parse<CountingExpatParser>(didl);
+    });
+#endif
+    timeit("validate UTF-8", loops, [&] {
+        sink += utf8check(big);
+    });
+    timeit("repair UTF-8 (1 error)", loops, [&] {
+        string fixed;
+        sink += utf8check(bad, true, &fixed);
+    });
+    // Keep the compiler from removing the loops
+    return sink == 0 ? 1 : 0;
+}
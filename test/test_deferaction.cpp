@@ -0,0 +1,279 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Deferred actions test: a device which answers all its actions from another thread with
+// UpnpDeferAction()/UpnpCompleteAction(), after a delay, while many control points send
+// actions concurrently. Checks that each request gets its own answer, and prints the time it
+// took, which should be close to the delay times the number of actions per client if the
+// requests are processed concurrently.
+
+#include "upnp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "test_deferaction [-i ifname] [-v] [-c clients] [-n actions] [-t ms]\n"
+    "  Run (default 20) clients each sending (default 10) actions in sequence to a device\n"
+    "  which answers them after (default 100) ms from another thread. Fails if a response\n"
+    "  is missing or does not match the request, or if the deferred actions hold up the\n"
+    "  HTTP server threads (the default client count is more than the thread count).\n"
+    "  -v: use argument views (UPNP_FLAG_ACTION_ARG_VIEWS)\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+static const char *UDN = "uuid:6c0a51f4-0d4e-4a57-9a2c-0f3b4ad1e2c7";
+static const char *SERVICETYPE = "urn:schemas-upnp-org:service:RenderingControl:1";
+static const char *CTLURL = "/ctl-RenderingControl";
+static const string description =
+    string(R"(<?xml version="1.0" encoding="utf-8"?>
+<root xmlns="urn:schemas-upnp-org:device-1-0">
+  <specVersion><major>1</major><minor>1</minor></specVersion>
+  <device>
+    <deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType>
+    <friendlyName>test_deferaction</friendlyName>
+    <manufacturer>npupnp</manufacturer>
+    <modelName>test_deferaction</modelName>
+    <UDN>)") + UDN + R"(</UDN>
+    <serviceList>
+      <service>
+        <serviceType>)" + SERVICETYPE + R"(</serviceType>
+        <serviceId>urn:upnp-org:serviceId:RenderingControl</serviceId>
+        <SCPDURL>/RenderingControl.xml</SCPDURL>
+        <controlURL>)" + CTLURL + R"(</controlURL>
+        <eventSubURL>/evt-RenderingControl</eventSubURL>
+      </service>
+    </serviceList>
+  </device>
+</root>
+)";
+
+static bool useviews;
+static int delayms = 100;
+
+// The deferred actions, answered in order by the completer thread once their time has come.
+struct Pending {
+    UpnpDeferredAction handle;
+    string value;
+    chrono::steady_clock::time_point due;
+};
+static mutex pendingmutex;
+static condition_variable pendingcv;
+static deque<Pending> pending;
+static bool stopping;
+static atomic<int> deferfailures;
+
+static int deviceCallback(Upnp_EventType et, const void *evp, void *)
+{
+    if (et != UPNP_CONTROL_ACTION_REQUEST)
+        return UPNP_E_SUCCESS;
+    auto req = static_cast<Upnp_Action_Request *>(const_cast<void *>(evp));
+    UpnpDeferredAction handle;
+    if (UpnpDeferAction(req, &handle) != UPNP_E_SUCCESS) {
+        deferfailures++;
+        return UPNP_E_INTERNAL_ERROR;
+    }
+    // The views are read after UpnpDeferAction(), which copied them.
+    string value;
+    if (useviews) {
+        for (const auto& [name, val] : req->argviews) {
+            if (name == "InstanceID")
+                value = val;
+        }
+    } else {
+        for (const auto& [name, val] : req->args) {
+            if (name == "InstanceID")
+                value = val;
+        }
+    }
+    std::scoped_lock lock(pendingmutex);
+    pending.push_back({handle, value, chrono::steady_clock::now() +
+                       chrono::milliseconds(delayms)});
+    pendingcv.notify_all();
+    return UPNP_E_SUCCESS;
+}
+
+static void completer()
+{
+    std::unique_lock<std::mutex> lock(pendingmutex);
+    for (;;) {
+        pendingcv.wait(lock, [] { return stopping || !pending.empty(); });
+        if (pending.empty())
+            return;
+        auto due = pending.front().due;
+        if (chrono::steady_clock::now() < due) {
+            pendingcv.wait_until(lock, due);
+            continue;
+        }
+        auto p = std::move(pending.front());
+        pending.pop_front();
+        lock.unlock();
+        Upnp_Action_Request result{};
+        result.resdata.emplace_back("CurrentVolume", p.value);
+        UpnpCompleteAction(p.handle, UPNP_E_SUCCESS, &result);
+        lock.lock();
+    }
+}
+
+// Send one GetVolume action on a new connection and return the whole response
+static string sendAction(const string& host, int devport, const string& instance)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(devport);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return string();
+    }
+    string body = string(R"(<?xml version="1.0"?>)"
+                         R"(<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" )"
+                         R"(s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">)"
+                         R"(<s:Body><u:GetVolume xmlns:u=")") + SERVICETYPE + R"(">)" +
+        "<InstanceID>" + instance + "</InstanceID><Channel>Master</Channel>"
+        "</u:GetVolume></s:Body></s:Envelope>";
+    string req = string("POST ") + CTLURL + " HTTP/1.1\r\n" +
+        "HOST: " + host + ":" + to_string(devport) + "\r\n" +
+        "CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n" +
+        "SOAPACTION: \"" + SERVICETYPE + "#GetVolume\"\r\n" +
+        "CONTENT-LENGTH: " + to_string(body.size()) + "\r\n" +
+        "Connection: close\r\n\r\n" + body;
+    string resp;
+    if (write(fd, req.c_str(), req.size()) == ssize_t(req.size())) {
+        char tmp[4096];
+        ssize_t n;
+        while ((n = read(fd, tmp, sizeof(tmp))) > 0)
+            resp.append(tmp, n);
+    }
+    close(fd);
+    return resp;
+}
+
+static atomic<int> good;
+static atomic<int> bad;
+
+static void client(const string& host, int devport, int idx, int nactions)
+{
+    for (int i = 0; i < nactions; i++) {
+        string instance = to_string(idx * 1000 + i);
+        string resp = sendAction(host, devport, instance);
+        if (resp.compare(0, 12, "HTTP/1.1 200") == 0 &&
+            resp.find("<CurrentVolume>" + instance + "</CurrentVolume>") != string::npos) {
+            good++;
+        } else {
+            bad++;
+            cerr << "Client " << idx << " action " << i << ": bad response [" <<
+                resp.substr(0, 200) << "]\n";
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    const char *ifname = nullptr;
+    int nclients = 20;
+    int nactions = 10;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "-i" && i + 1 < argc) {
+            ifname = argv[++i];
+        } else if (arg == "-v") {
+            useviews = true;
+        } else if (arg == "-c" && i + 1 < argc) {
+            nclients = atoi(argv[++i]);
+        } else if (arg == "-n" && i + 1 < argc) {
+            nactions = atoi(argv[++i]);
+        } else if (arg == "-t" && i + 1 < argc) {
+            delayms = atoi(argv[++i]);
+        } else {
+            Usage();
+        }
+    }
+    if (nclients <= 0 || nactions <= 0 || delayms < 0)
+        Usage();
+
+    int ret = UpnpInitWithOptions(ifname, 0,
+                                  useviews ? UPNP_FLAG_ACTION_ARG_VIEWS : UPNP_FLAG_NONE,
+                                  UPNP_OPTION_END);
+    if (ret != UPNP_E_SUCCESS) {
+        cerr << "UpnpInitWithOptions failed: " << ret << "\n";
+        return 1;
+    }
+    UpnpDevice_Handle dvhandle;
+    ret = UpnpRegisterRootDevice2(UPNPREG_BUF_DESC, description.c_str(), description.size(), 0,
+                                  deviceCallback, nullptr, &dvhandle);
+    if (ret != UPNP_E_SUCCESS) {
+        cerr << "UpnpRegisterRootDevice2 failed: " << ret << "\n";
+        return 1;
+    }
+    string host = UpnpGetServerIpAddress();
+    int devport = UpnpGetServerPort();
+
+    thread compthread(completer);
+    auto start = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (int i = 0; i < nclients; i++) {
+        clients.emplace_back(client, host, devport, i, nactions);
+    }
+    for (auto& t : clients) {
+        t.join();
+    }
+    auto ms = chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - start).count();
+    cout << good << " good and " << bad << " bad responses for " << nclients * nactions <<
+        " actions in " << ms << " ms (" << nactions * delayms << " ms if fully concurrent)\n";
+
+    {
+        std::scoped_lock lock(pendingmutex);
+        stopping = true;
+        pendingcv.notify_all();
+    }
+    compthread.join();
+    UpnpUnRegisterRootDevice(dvhandle);
+    UpnpFinish();
+    if (deferfailures)
+        cerr << deferfailures << " UpnpDeferAction failures\n";
+    // The waiting connections must not use the server threads, else the actions are answered
+    // a few at a time.
+    bool serialized = ms > 3 * nactions * delayms;
+    if (serialized)
+        cerr << "The actions were not answered concurrently\n";
+    return bad || deferfailures || serialized || good != nclients * nactions ? 1 : 0;
+}
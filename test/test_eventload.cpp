@@ -0,0 +1,378 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Event delivery load test: a device with many subscribed control points, some of which never
+// answer the NOTIFY requests. Checks that the events reach the responsive subscribers in order,
+// and prints the time it took. Run with and without -a (UPNP_FLAG_ASYNC_EVENTS) to compare.
+
+#include "upnp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "test_eventload [-i ifname] [-a] [-m threads] [-s subscribers] [-d dead] [-e events] "
+    "[-t ms]\n"
+    "  Subscribe (default 1000) control points to a device, (default 100) of them never\n"
+    "  answering, then send (default 10) events spaced by (default 100) ms, and wait for the\n"
+    "  responsive subscribers to receive them all. Fails if the events of a subscriber are\n"
+    "  out of order, or if one did not get the last event.\n"
+    "  -a: use asynchronous event delivery (UPNP_FLAG_ASYNC_EVENTS)\n"
+    "  -m: maximum threads in the send pool. The timer uses one, so with 2 there is no room\n"
+    "      for the asynchronous delivery thread, and the library must fall back to jobs.\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+static const char *UDN = "uuid:0ae4d2d2-8b5b-4a7c-93f3-5b1e3c0e7a10";
+static const char *SERVICEID = "urn:upnp-org:serviceId:RenderingControl";
+static const char *EVTURL = "/evt-RenderingControl";
+static const string description =
+    string(R"(<?xml version="1.0" encoding="utf-8"?>
+<root xmlns="urn:schemas-upnp-org:device-1-0">
+  <specVersion><major>1</major><minor>1</minor></specVersion>
+  <device>
+    <deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType>
+    <friendlyName>test_eventload</friendlyName>
+    <manufacturer>npupnp</manufacturer>
+    <modelName>test_eventload</modelName>
+    <UDN>)") + UDN + R"(</UDN>
+    <serviceList>
+      <service>
+        <serviceType>urn:schemas-upnp-org:service:RenderingControl:1</serviceType>
+        <serviceId>)" + SERVICEID + R"(</serviceId>
+        <SCPDURL>/RenderingControl.xml</SCPDURL>
+        <controlURL>/ctl-RenderingControl</controlURL>
+        <eventSubURL>)" + EVTURL + R"(</eventSubURL>
+      </service>
+    </serviceList>
+  </device>
+</root>
+)";
+
+static UpnpDevice_Handle dvhandle;
+
+static int deviceCallback(Upnp_EventType et, const void *evp, void *)
+{
+    if (et == UPNP_EVENT_SUBSCRIPTION_REQUEST) {
+        auto req = static_cast<const UpnpSubscriptionRequest *>(evp);
+        const char *names[] = {"LastChange"};
+        const char *values[] = {"initial"};
+        UpnpAcceptSubscription(dvhandle, req->UDN, req->ServiceId, names, values, 1, req->Sid);
+    }
+    return UPNP_E_SUCCESS;
+}
+
+// Value of a header in a request or response head, or empty. name is lowercase, with the colon
+static string headerValue(const string& head, const string& name)
+{
+    string lower(head);
+    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    auto pos = lower.find("\r\n" + name);
+    if (pos == string::npos)
+        return string();
+    pos += 2 + name.size();
+    auto end = head.find("\r\n", pos);
+    string value = head.substr(pos, end - pos);
+    value.erase(0, value.find_first_not_of(" \t"));
+    return value;
+}
+
+static int listenSocket(int *port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *)&addr, len) < 0 || listen(fd, SOMAXCONN) < 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("listen socket");
+        exit(1);
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// The responsive control points: a single thread serving all the connections, recording the
+// SEQ values received by each subscriber. The callback URL path is /sub/<index>.
+static mutex seqsmutex;
+static vector<vector<long>> seqs;
+// Number of the last event received by each subscriber (0 for the initial one)
+static vector<int> lastevent;
+static atomic<int> gotlast;
+static int nevents = 10;
+static atomic<int> received;
+static atomic<int> connections;
+static atomic<bool> stopping;
+
+static void handleRequests(string& buf, int fd)
+{
+    for (;;) {
+        auto hend = buf.find("\r\n\r\n");
+        if (hend == string::npos)
+            return;
+        string head = buf.substr(0, hend + 2);
+        size_t clen = atol(headerValue(head, "content-length:").c_str());
+        if (buf.size() < hend + 4 + clen)
+            return;
+        string body = buf.substr(hend + 4, clen);
+        buf.erase(0, hend + 4 + clen);
+        auto pos = head.find("/sub/");
+        if (pos != string::npos) {
+            size_t idx = atol(head.c_str() + pos + 5);
+            long seq = atol(headerValue(head, "seq:").c_str());
+            auto epos = body.find(">event ");
+            int ev = epos == string::npos ? 0 : atoi(body.c_str() + epos + 7);
+            std::scoped_lock lock(seqsmutex);
+            if (idx < seqs.size()) {
+                seqs[idx].push_back(seq);
+                if (ev == nevents && lastevent[idx] != nevents)
+                    gotlast++;
+                lastevent[idx] = ev;
+            }
+        }
+        received++;
+        static const string resp("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+        if (write(fd, resp.c_str(), resp.size()) < 0)
+            return;
+    }
+}
+
+static void serveSubscribers(int lfd)
+{
+    vector<struct pollfd> fds{{lfd, POLLIN, 0}};
+    vector<string> bufs{string()};
+    while (!stopping) {
+        if (poll(&fds[0], fds.size(), 100) <= 0)
+            continue;
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (!(fds[i].revents & (POLLIN|POLLHUP|POLLERR)))
+                continue;
+            char tmp[8192];
+            auto n = read(fds[i].fd, tmp, sizeof(tmp));
+            if (n <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                continue;
+            }
+            bufs[i].append(tmp, n);
+            handleRequests(bufs[i], fds[i].fd);
+        }
+        if (fds[0].revents & POLLIN) {
+            int cfd = accept(lfd, nullptr, nullptr);
+            if (cfd >= 0) {
+                connections++;
+                fds.push_back({cfd, POLLIN, 0});
+                bufs.emplace_back();
+            }
+        }
+        for (size_t i = fds.size() - 1; i > 0; i--) {
+            if (fds[i].fd < 0) {
+                fds.erase(fds.begin() + i);
+                bufs.erase(bufs.begin() + i);
+            }
+        }
+    }
+    for (size_t i = 1; i < fds.size(); i++)
+        close(fds[i].fd);
+}
+
+// Send a SUBSCRIBE request to the device, return the SID or an empty string
+static string subscribe(const string& host, int devport, const string& callback)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(devport);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return string();
+    }
+    string req = string("SUBSCRIBE ") + EVTURL + " HTTP/1.1\r\n" +
+        "HOST: " + host + ":" + to_string(devport) + "\r\n" +
+        "CALLBACK: <" + callback + ">\r\n" +
+        "NT: upnp:event\r\n" +
+        "TIMEOUT: Second-1800\r\n\r\n";
+    string resp;
+    if (write(fd, req.c_str(), req.size()) == ssize_t(req.size())) {
+        char tmp[4096];
+        ssize_t n;
+        while (resp.find("\r\n\r\n") == string::npos && (n = read(fd, tmp, sizeof(tmp))) > 0)
+            resp.append(tmp, n);
+    }
+    close(fd);
+    return headerValue(resp, "sid:");
+}
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    const char *ifname = nullptr;
+    unsigned int flags = UPNP_FLAG_NONE;
+    int maxthreads = 0;
+    int nsubs = 1000;
+    int ndead = 100;
+    int intervalms = 100;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "-i" && i + 1 < argc) {
+            ifname = argv[++i];
+        } else if (arg == "-a") {
+            flags |= UPNP_FLAG_ASYNC_EVENTS;
+        } else if (arg == "-m" && i + 1 < argc) {
+            maxthreads = atoi(argv[++i]);
+        } else if (arg == "-s" && i + 1 < argc) {
+            nsubs = atoi(argv[++i]);
+        } else if (arg == "-d" && i + 1 < argc) {
+            ndead = atoi(argv[++i]);
+        } else if (arg == "-e" && i + 1 < argc) {
+            nevents = atoi(argv[++i]);
+        } else if (arg == "-t" && i + 1 < argc) {
+            intervalms = atoi(argv[++i]);
+        } else {
+            Usage();
+        }
+    }
+    if (ndead > nsubs)
+        Usage();
+
+    int ret;
+    if (maxthreads > 0) {
+        ret = UpnpInitWithOptions(ifname, 0, flags, UPNP_OPTION_THREADPOOL_SIZE,
+                                  UPNP_THREADPOOL_SEND, 1, maxthreads, UPNP_OPTION_END);
+    } else {
+        ret = UpnpInitWithOptions(ifname, 0, flags, UPNP_OPTION_END);
+    }
+    if (ret != UPNP_E_SUCCESS) {
+        cerr << "UpnpInitWithOptions failed: " << ret << "\n";
+        return 1;
+    }
+    ret = UpnpRegisterRootDevice2(UPNPREG_BUF_DESC, description.c_str(), description.size(), 0,
+                                  deviceCallback, nullptr, &dvhandle);
+    if (ret != UPNP_E_SUCCESS) {
+        cerr << "UpnpRegisterRootDevice2 failed: " << ret << "\n";
+        return 1;
+    }
+    string host = UpnpGetServerIpAddress();
+    int devport = UpnpGetServerPort();
+
+    // The dead control points: the connections are queued by the kernel, but never accepted.
+    int liveport, deadport;
+    int livefd = listenSocket(&liveport);
+    int deadfd = listenSocket(&deadport);
+    seqs.resize(nsubs);
+    lastevent.resize(nsubs);
+    thread server(serveSubscribers, livefd);
+
+    // Subscribers [0, ndead) are the dead ones. They get the events first.
+    for (int i = 0; i < nsubs; i++) {
+        int port = i < ndead ? deadport : liveport;
+        string callback = "http://" + host + ":" + to_string(port) + "/sub/" + to_string(i);
+        if (subscribe(host, devport, callback).empty()) {
+            cerr << "Subscription " << i << " failed\n";
+            return 1;
+        }
+    }
+    cout << nsubs << " subscriptions (" << ndead << " dead) done\n";
+
+    auto start = chrono::steady_clock::now();
+    for (int ev = 1; ev <= nevents; ev++) {
+        const char *names[] = {"LastChange"};
+        string value = "event " + to_string(ev);
+        const char *values[] = {value.c_str()};
+        UpnpNotify(dvhandle, UDN, SERVICEID, names, values, 1);
+        this_thread::sleep_for(chrono::milliseconds(intervalms));
+    }
+
+    // Initial event + nevents for each live subscriber. Wait for all of them to get the last one:
+    // some events may be discarded on the way (see below).
+    int expected = (nsubs - ndead) * (nevents + 1);
+    while (gotlast < nsubs - ndead &&
+           chrono::steady_clock::now() - start < chrono::seconds(120)) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    auto ms = chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - start).count();
+    cout << "Received " << received << " events of " << expected << " in " << ms <<
+        " ms, over " << connections << " connections\n";
+
+    int errors = 0;
+    int incomplete = 0;
+    {
+        std::scoped_lock lock(seqsmutex);
+        for (int i = ndead; i < nsubs; i++) {
+            for (size_t j = 0; j < seqs[i].size(); j++) {
+                if (seqs[i][j] != long(j)) {
+                    cerr << "Subscriber " << i << ": event " << j << " has SEQ " <<
+                        seqs[i][j] << "\n";
+                    errors++;
+                    break;
+                }
+            }
+            if (seqs[i].size() != size_t(nevents + 1))
+                incomplete++;
+        }
+    }
+    // Events may be discarded by the library if a subscription queue gets too long, e.g.
+    // because the pool is busy with the dead subscribers, so this is not an error. Not getting
+    // the last one means that the subscription is stuck.
+    if (incomplete)
+        cout << incomplete << " subscribers did not get all the events\n";
+    if (gotlast != nsubs - ndead) {
+        cerr << nsubs - ndead - gotlast << " subscribers did not get the last event\n";
+        errors++;
+    }
+
+    UpnpEventDeliveryStats stats;
+    UpnpGetEventDeliveryStats(&stats);
+    cout << "Delivery stats: notifications " << stats.notifications << " failures " <<
+        stats.failures << " new connections " << stats.newConnections << " reused " <<
+        stats.reusedConnections << "\n";
+
+    UpnpUnRegisterRootDevice(dvhandle);
+    UpnpFinish();
+    stopping = true;
+    server.join();
+    close(livefd);
+    close(deadfd);
+    return errors ? 1 : 0;
+}
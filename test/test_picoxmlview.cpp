@@ -0,0 +1,231 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// PicoXMLViewParser test: run it and PicoXMLParser on the same documents and check that they
+// produce the same callbacks and the same result. With -t, also time both parsers on a
+// DIDL-Lite document.
+
+#include "picoxml.h"
+#include "picoxmlview.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "test_picoxmlview [-v] [-t loops]\n"
+    "  Compare the callbacks from PicoXMLViewParser and PicoXMLParser on a set of documents\n"
+    "  -v: print the traces\n"
+    "  -t: time both parsers on a DIDL-Lite document, averaged over loops calls\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+// Each parser records its callbacks as text lines. Consecutive character data is merged, the
+// attributes are sorted by name (the documents have no duplicate attributes).
+class Trace {
+public:
+    string text;
+    void event(const string& line) {
+        text += line + "\n";
+        indata = false;
+    }
+    void data(const char *data, size_t len) {
+        if (len == 0)
+            return;
+        if (indata) {
+            text.pop_back();
+        } else {
+            text += "DATA ";
+        }
+        text.append(data, len);
+        text += "\n";
+        indata = true;
+    }
+private:
+    bool indata{false};
+};
+
+class TracingParser : public PicoXMLParser {
+public:
+    explicit TracingParser(const string& in)
+        : PicoXMLParser(in) {}
+    Trace trace;
+protected:
+    void startElement(const string& nm, const map<string, string>& attrs) override {
+        string line = "START " + nm;
+        for (const auto& [name, value] : attrs)
+            line += " " + name + "=[" + value + "]";
+        trace.event(line);
+    }
+    void endElement(const string& nm) override {
+        trace.event("END " + nm);
+    }
+    void characterData(const string& data) override {
+        trace.data(data.c_str(), data.size());
+    }
+};
+
+class TracingViewParser : public PicoXMLViewParser {
+public:
+    explicit TracingViewParser(string_view in)
+        : PicoXMLViewParser(in) {}
+    Trace trace;
+protected:
+    void startElement(string_view nm, const Attributes& attrs) override {
+        string line = "START " + string(nm);
+        Attributes sorted(attrs);
+        sort(sorted.begin(), sorted.end());
+        for (const auto& [name, value] : sorted)
+            line += " " + string(name) + "=[" + string(value) + "]";
+        trace.event(line);
+        // The m_path name views must stay valid when the stack grows.
+        names.emplace_back(nm);
+        if (m_path.size() != names.size())
+            trace.event("BAD PATH SIZE");
+        for (size_t i = 0; i < m_path.size() && i < names.size(); i++) {
+            if (m_path[i].name != names[i])
+                trace.event("BAD PATH ELEMENT " + names[i]);
+        }
+    }
+    void endElement(string_view nm) override {
+        trace.event("END " + string(nm));
+        names.pop_back();
+    }
+    void characterData(string_view data) override {
+        trace.data(data.data(), data.size());
+    }
+private:
+    vector<string> names;
+};
+
+static const char *docs[] = {
+    "",
+    "<?xml version=\"1.0\"?>\n<a>text</a>",
+    "<a><b>1</b><b>2</b><c/></a>",
+    "<a x=\"1\" y='two' z=\"a &amp; b &lt;c&gt; &quot;d&quot; &apos;e&apos;\">v</a>",
+    "<a>R&amp;B &lt;live&gt; &#65;&#x42;</a>",
+    "<a><!-- comment <b> --><b>after comment</b></a>",
+    "<a>\n  <b>\n    <c>deep</c>\n  </b>\n</a>\n",
+    // Enough levels to make the name buffers and the path grow
+    "<l1><l2><l3><l4><l5><l6><l7><l8><l9><l10><l11><l12><l13><l14><l15><l16><l17>x"
+    "</l17></l16></l15></l14></l13></l12></l11></l10></l9></l8></l7></l6></l5></l4></l3>"
+    "</l2></l1>",
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\"><s:Body>"
+    "<u:BrowseResponse xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\">"
+    "<Result>&lt;DIDL-Lite&gt;&lt;item id=&quot;1&quot;/&gt;&lt;/DIDL-Lite&gt;</Result>"
+    "<NumberReturned>1</NumberReturned></u:BrowseResponse></s:Body></s:Envelope>",
+    "<a>\xc3\xa9t\xc3\xa9</a>",
+    // Errors
+    "<a>",
+    "<a></b>",
+    "<a><b></a>",
+    "<>",
+    "<a",
+    "<a></a/>",
+    "<a x=\"1>v</a>",
+};
+
+static string makeDidl(int items)
+{
+    string didl(R"(<DIDL-Lite xmlns="urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/" )"
+                R"(xmlns:dc="http://purl.org/dc/elements/1.1/" )"
+                R"(xmlns:upnp="urn:schemas-upnp-org:metadata-1-0/upnp/">)");
+    for (int i = 0; i < items; i++) {
+        auto n = to_string(i);
+        didl += R"(<item id="0$=Artist$)" + n + R"(" parentID="0$=Artist" restricted="1">)"
+            "<dc:title>Track " + n + " - Les \xc3\xa9t\xc3\xa9s &amp; the Winters</dc:title>"
+            "<upnp:artist>Some Artist &lt;feat. Another&gt;</upnp:artist>"
+            "<upnp:album>An Album Title Which Is Somewhat Long</upnp:album>"
+            "<upnp:originalTrackNumber>" + n + "</upnp:originalTrackNumber>"
+            R"(<res duration="0:04:12.000" size="31245678" sampleFrequency="44100" )"
+            R"(protocolInfo="http-get:*:audio/x-flac:DLNA.ORG_PN=FLAC;DLNA.ORG_OP=01">)"
+            "http://192.168.1.10:9790/minimserver/*/Music/Artist/Album/" + n +
+            "%20Track.flac</res></item>";
+    }
+    didl += "</DIDL-Lite>";
+    return didl;
+}
+
+template <typename P> static long timeParser(const string& doc, int loops)
+{
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < loops; i++) {
+        P parser(doc);
+        if (!parser.Parse()) {
+            cerr << "Parse failed: " << parser.getLastErrorMessage() << "\n";
+            exit(1);
+        }
+    }
+    chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+    return static_cast<long>(elapsed.count() / loops);
+}
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    bool verbose = false;
+    int loops = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "vt:")) != -1) {
+        switch (opt) {
+        case 'v': verbose = true; break;
+        case 't': loops = atoi(optarg); if (loops <= 0) Usage(); break;
+        default: Usage();
+        }
+    }
+    if (optind != argc)
+        Usage();
+
+    int errors = 0;
+    for (const auto cdoc : docs) {
+        // PicoXMLParser keeps a reference to its input
+        const string doc(cdoc);
+        TracingParser parser(doc);
+        bool ok = parser.Parse();
+        TracingViewParser vparser(doc);
+        bool vok = vparser.Parse();
+        bool same = ok == vok && parser.trace.text == vparser.trace.text;
+        if (!same)
+            errors++;
+        if (!same || verbose) {
+            cout << (same ? "OK  " : "BAD ") << "[" << doc << "]\n";
+            cout << "PicoXMLParser: " << (ok ? "ok" : "error") << "\n" << parser.trace.text;
+            cout << "PicoXMLViewParser: " << (vok ? "ok" : "error") << "\n" << vparser.trace.text;
+        }
+    }
+    cout << sizeof(docs) / sizeof(docs[0]) - errors << " documents OK, " << errors << " BAD\n";
+
+    if (loops) {
+        const string didl = makeDidl(50);
+        cout << "DIDL " << didl.size() << " bytes: PicoXMLParser " <<
+            timeParser<PicoXMLParser>(didl, loops) << " us, PicoXMLViewParser " <<
+            timeParser<PicoXMLViewParser>(didl, loops) << " us\n";
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Repeatedly initialize and shut down the library, checking that the threads are all stopped
+// by UpnpFinish() and that the memory usage does not grow.
+
+#include "upnp.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "test_reinit [-i ifname] [-n count]\n"
+    "  Loop count times on UpnpInit/UpnpFinish (default 50)\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+// Read a numeric field (e.g. Threads, VmRSS) from /proc/self/status. Returns -1 if not found,
+// e.g. on systems without /proc
+static long procStatus(const string& name)
+{
+    ifstream input("/proc/self/status");
+    string line;
+    while (getline(input, line)) {
+        if (line.compare(0, name.size() + 1, name + ":") == 0) {
+            return atol(line.c_str() + name.size() + 1);
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    const char *ifname = nullptr;
+    int count = 50;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "-i" && i + 1 < argc) {
+            ifname = argv[++i];
+        } else if (arg == "-n" && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else {
+            Usage();
+        }
+    }
+
+    long basethreads = procStatus("Threads");
+    long baserss{-1};
+    // Allow some slack for the allocator and libraries caching things
+    const long maxrssgrowthkb = 2048;
+    int errors = 0;
+    for (int i = 0; i < count; i++) {
+        auto start = chrono::steady_clock::now();
+        int ret = UpnpInitWithOptions(ifname, 0, UPNP_FLAG_NONE,
+                                      UPNP_OPTION_NETWORK_WAIT, 0, UPNP_OPTION_END);
+        if (ret != UPNP_E_SUCCESS) {
+            cerr << "UpnpInitWithOptions failed: " << ret << "\n";
+            return 1;
+        }
+        long runthreads = procStatus("Threads");
+        UpnpFinish();
+        auto ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - start).count();
+        long threads = procStatus("Threads");
+        long rss = procStatus("VmRSS");
+        // The first cycles initialize the libraries static data.
+        if (i == 2)
+            baserss = rss;
+        cout << "cycle " << i << ": " << ms << " ms, threads running " << runthreads <<
+            " after finish " << threads << ", rss " << rss << " kB\n";
+        if (threads > basethreads) {
+            cerr << "Threads still running after UpnpFinish\n";
+            errors++;
+        }
+        if (baserss > 0 && rss - baserss > maxrssgrowthkb) {
+            cerr << "RSS grew by " << rss - baserss << " kB\n";
+            errors++;
+        }
+        if (errors)
+            return 1;
+    }
+    return 0;
+}
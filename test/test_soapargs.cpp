@@ -0,0 +1,305 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Test the fast SOAP argument scanner used with UPNP_FLAG_ACTION_ARG_VIEWS
+// (soap_scan_action_args()): it must handle the usual request forms, and refuse everything
+// else, in which case the library uses the full parser. With expat, each document is also
+// parsed by expat: the scanner must never accept a document which expat rejects, and the
+// arguments must be the same.
+
+#include "autoconfig.h"
+#include "soap_message.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#ifdef USE_EXPAT
+#include <expat.h>
+#endif
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "test_soapargs [-v] [-n count]\n"
+    "  Check the fast action argument scanner on valid and invalid requests\n"
+    "  -v: print all the results\n"
+    "  -n: number of random mutations of the test documents checked against expat\n"
+    "      (default 20000, ignored without expat)\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+static const string prolog =
+    R"(<?xml version="1.0" encoding="utf-8"?>)" "\n"
+    R"(<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" )"
+    R"(s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">)" "\n"
+    "<s:Body>\n"
+    R"(<u:Browse xmlns:u="urn:schemas-upnp-org:service:ContentDirectory:1">)";
+static const string epilog = "</u:Browse>\n</s:Body>\n</s:Envelope>\n";
+
+enum Expect {
+    // Handled by the scanner
+    FAST,
+    // Valid, but left to the full parser
+    FULL,
+    // Invalid: expat fails, the scanner must refuse it
+    BAD,
+};
+
+struct TestCase {
+    const char *what;
+    string doc;
+    Expect expect;
+    // For FAST: the arguments, as name=value lines
+    string args;
+};
+
+static vector<TestCase> cases {
+    {"browse", prolog + "<ObjectID>0</ObjectID><BrowseFlag>BrowseDirectChildren</BrowseFlag>"
+     "<Filter>*</Filter><StartingIndex>0</StartingIndex><RequestedCount>100</RequestedCount>"
+     "<SortCriteria></SortCriteria>" + epilog, FAST,
+     "ObjectID=0\nBrowseFlag=BrowseDirectChildren\nFilter=*\nStartingIndex=0\n"
+     "RequestedCount=100\nSortCriteria=\n"},
+    {"no declaration, single quotes",
+     "<s:Envelope xmlns:s='http://schemas.xmlsoap.org/soap/envelope/'><s:Body>"
+     "<u:Browse xmlns:u='urn:schemas-upnp-org:service:ContentDirectory:1'>"
+     "<ObjectID>1</ObjectID></u:Browse></s:Body></s:Envelope>", FAST, "ObjectID=1\n"},
+    {"references", prolog + "<ObjectID>&lt;a&gt; &amp; &quot;b&quot; &#233; &#x20AC;</ObjectID>" +
+     epilog, FAST, "ObjectID=<a> & \"b\" \xc3\xa9 \xe2\x82\xac\n"},
+    {"empty and self-closing", prolog + "<ObjectID></ObjectID><Filter/><Sort />" + epilog,
+     FAST, "ObjectID=\nFilter=\nSort=\n"},
+    {"trimming and line ends", prolog + "<ObjectID>\r\n  a\r\nb\rc  \n</ObjectID>" + epilog,
+     FAST, "ObjectID=a\nb\nc\n"},
+    {"comments", prolog + "<!-- first --><ObjectID>0</ObjectID>\n<!-- second -->" + epilog,
+     FAST, "ObjectID=0\n"},
+    {"self-closing action", string(R"(<?xml version="1.0"?>)") +
+     "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\"><s:Body>"
+     "<u:Browse xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\"/>"
+     "</s:Body></s:Envelope>", FAST, ""},
+    {"declaration with standalone", string(R"(<?xml version='1.0' encoding='UTF-8' )"
+     "standalone='yes'?>") + prolog.substr(prolog.find('\n')) + "<ObjectID>0</ObjectID>" +
+     epilog, FAST, "ObjectID=0\n"},
+
+    {"CDATA", prolog + "<ObjectID><![CDATA[<a>]]></ObjectID>" + epilog, FULL, ""},
+    {"nested element", prolog + "<ObjectID><b>0</b></ObjectID>" + epilog, FULL, ""},
+    {"latin1", string(R"(<?xml version="1.0" encoding="ISO-8859-1"?>)") +
+     prolog.substr(prolog.find('\n')) + "<ObjectID>\xe9</ObjectID>" + epilog, FULL, ""},
+    {"header", string("<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+                      "<s:Header><h:x xmlns:h=\"urn:h\">1</h:x></s:Header><s:Body>"
+                      "<u:Browse xmlns:u=\"urn:u\"><ObjectID>0</ObjectID></u:Browse>"
+                      "</s:Body></s:Envelope>"), FULL, ""},
+    {"processing instruction", prolog + "<?pi data?><ObjectID>0</ObjectID>" + epilog, FULL, ""},
+    {"non-ASCII name", prolog + "<Obj\xc3\xa9>0</Obj\xc3\xa9>" + epilog, FULL, ""},
+
+    {"mismatched end tag", prolog + "<ObjectID>0</Filter>" + epilog, BAD, ""},
+    {"unclosed argument", prolog + "<ObjectID>0", BAD, ""},
+    {"argument open at the action end", prolog + "<ObjectID>0" + epilog, BAD, ""},
+    {"unclosed envelope", prolog + "<ObjectID>0</ObjectID></u:Browse></s:Body>", BAD, ""},
+    {"surrogate between arguments", prolog + "<ObjectID>0</ObjectID>&#xD800;" + epilog, BAD, ""},
+    {"unknown entity between arguments", prolog + "&bogus;<ObjectID>0</ObjectID>" + epilog,
+     BAD, ""},
+    {"bare ampersand", prolog + "<ObjectID>0</ObjectID> & " + epilog, BAD, ""},
+    {"control character", prolog + "<ObjectID>0</ObjectID>\x01" + epilog, BAD, ""},
+    {"bad reference in argument", prolog + "<ObjectID>&#0;</ObjectID>" + epilog, BAD, ""},
+    {"text after the root", prolog + "<ObjectID>0</ObjectID>" + epilog + "junk", BAD, ""},
+    {"second root", prolog + "<ObjectID>0</ObjectID>" + epilog + "<a/>", BAD, ""},
+    {"double hyphen in comment", prolog + "<!-- a -- b --><ObjectID>0</ObjectID>" + epilog,
+     BAD, ""},
+    {"duplicate attribute", string("<s:Envelope a=\"1\" a=\"2\"><s:Body><u:Browse>"
+                                   "<ObjectID>0</ObjectID></u:Browse></s:Body></s:Envelope>"),
+     BAD, ""},
+    {"unquoted attribute", string("<s:Envelope a=1><s:Body><u:Browse>"
+                                  "<ObjectID>0</ObjectID></u:Browse></s:Body></s:Envelope>"),
+     BAD, ""},
+    {"less-than in attribute", string("<s:Envelope a=\"<\"><s:Body><u:Browse>"
+                                      "<ObjectID>0</ObjectID></u:Browse></s:Body></s:Envelope>"),
+     BAD, ""},
+    {"junk in end tag", prolog + "<ObjectID>0</ObjectID x>" + epilog, BAD, ""},
+    {"bad UTF-8", prolog + "<ObjectID>\xff</ObjectID>" + epilog, BAD, ""},
+    {"declaration not at start", "\n" + prolog + "<ObjectID>0</ObjectID>" + epilog, BAD, ""},
+    {"unknown encoding", string(R"(<?xml version="1.0" encoding="utf-8x"?>)") +
+     prolog.substr(prolog.find('\n')) + "<ObjectID>0</ObjectID>" + epilog, BAD, ""},
+    {"CDATA end in text", prolog + "<ObjectID>a]]>b</ObjectID>" + epilog, BAD, ""},
+};
+
+#ifdef USE_EXPAT
+// Reference: the arguments as the full parser computes them, the trimmed character data of
+// the children of the action element.
+struct ExpatRef {
+    int depth{0};
+    string data;
+    string args;
+};
+
+static void startElement(void *ud, const XML_Char *, const XML_Char **)
+{
+    auto ref = static_cast<ExpatRef*>(ud);
+    ref->depth++;
+    ref->data.clear();
+}
+
+static void endElement(void *ud, const XML_Char *name)
+{
+    auto ref = static_cast<ExpatRef*>(ud);
+    if (ref->depth == 4) {
+        auto first = ref->data.find_first_not_of(" \t\n\r");
+        auto value = first == string::npos ? string() :
+            ref->data.substr(first, ref->data.find_last_not_of(" \t\n\r") - first + 1);
+        ref->args += string(name) + "=" + value + "\n";
+    }
+    ref->depth--;
+    ref->data.clear();
+}
+
+static void characterData(void *ud, const XML_Char *s, int len)
+{
+    static_cast<ExpatRef*>(ud)->data.append(s, len);
+}
+
+static bool expatParse(const string& doc, string& args)
+{
+    ExpatRef ref;
+    XML_Parser parser = XML_ParserCreate(nullptr);
+    XML_SetUserData(parser, &ref);
+    XML_SetElementHandler(parser, startElement, endElement);
+    XML_SetCharacterDataHandler(parser, characterData);
+    bool ok = XML_Parse(parser, doc.c_str(), static_cast<int>(doc.size()), 1) == XML_STATUS_OK;
+    XML_ParserFree(parser);
+    args = ref.args;
+    return ok;
+}
+
+// Random single-character edits of the valid documents, using characters which matter to
+// the syntax. Returns the number of mutated documents which the scanner accepts although
+// expat refuses them or gives other arguments.
+static int mutationTest(int count, bool verbose)
+{
+    static const string chars("<>/&;#x!-?='\" \r\n\x01]\xff");
+    unsigned long seed = 42;
+    auto rnd = [&seed](size_t max) {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        return static_cast<size_t>((seed >> 33) % max);
+    };
+    vector<const TestCase*> valid;
+    for (const auto& tc : cases) {
+        if (tc.expect == FAST)
+            valid.push_back(&tc);
+    }
+    int errors = 0;
+    int accepted = 0;
+    for (int i = 0; i < count; i++) {
+        string doc = valid[rnd(valid.size())]->doc;
+        auto pos = rnd(doc.size());
+        auto c = chars[rnd(chars.size())];
+        switch (rnd(3)) {
+        case 0: doc[pos] = c; break;
+        case 1: doc.insert(pos, 1, c); break;
+        default: doc.erase(pos, 1); break;
+        }
+        string body(doc);
+        string_view actqname;
+        vector<pair<string_view, string_view>> views;
+        if (!soap_scan_action_args(body, "Browse", actqname, views))
+            continue;
+        accepted++;
+        string args;
+        for (const auto& [name, value] : views)
+            args += string(name) + "=" + string(value) + "\n";
+        string expargs;
+        if (!expatParse(doc, expargs) || args != expargs) {
+            errors++;
+            if (verbose || errors <= 10)
+                cout << "BAD mutation accepted by the scanner: [" << doc << "]\n";
+        }
+    }
+    cout << count << " mutations, " << accepted << " accepted by the scanner, " << errors <<
+        " BAD\n";
+    return errors;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    bool verbose = false;
+    int mutations = 20000;
+    int opt;
+    while ((opt = getopt(argc, argv, "vn:")) != -1) {
+        switch (opt) {
+        case 'v': verbose = true; break;
+        case 'n': mutations = atoi(optarg); break;
+        default: Usage();
+        }
+    }
+    if (optind != argc)
+        Usage();
+
+    int errors = 0;
+    for (const auto& tc : cases) {
+        string body(tc.doc);
+        string_view actqname;
+        vector<pair<string_view, string_view>> views;
+        bool fast = soap_scan_action_args(body, "Browse", actqname, views);
+        string args;
+        for (const auto& [name, value] : views)
+            args += string(name) + "=" + string(value) + "\n";
+        string problem;
+        if (fast != (tc.expect == FAST)) {
+            problem = fast ? "accepted by the scanner" : "refused by the scanner";
+        } else if (fast && (args != tc.args || actqname != "u:Browse")) {
+            problem = "bad arguments [" + args + "]";
+        } else if (!fast && body != tc.doc) {
+            problem = "body modified";
+        }
+#ifdef USE_EXPAT
+        string expargs;
+        bool expok = expatParse(tc.doc, expargs);
+        if (problem.empty()) {
+            if (expok != (tc.expect != BAD)) {
+                problem = expok ? "accepted by expat" : "refused by expat";
+            } else if (fast && args != expargs) {
+                problem = "arguments differ from expat [" + expargs + "]";
+            }
+        }
+#endif
+        if (!problem.empty())
+            errors++;
+        if (!problem.empty() || verbose) {
+            cout << (problem.empty() ? "OK  " : "BAD ") << tc.what <<
+                (problem.empty() ? "" : ": ") << problem << "\n";
+        }
+    }
+    cout << cases.size() - errors << " documents OK, " << errors << " BAD" <<
+#ifdef USE_EXPAT
+        " (checked with expat)" <<
+#endif
+        "\n";
+#ifdef USE_EXPAT
+    errors += mutationTest(mutations, verbose);
+#else
+    (void)mutations;
+#endif
+    return errors ? 1 : 0;
+}
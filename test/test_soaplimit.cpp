@@ -0,0 +1,209 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// SOAP request size limit test (UpnpSetMaxContentLength()): send actions of various sizes to a
+// device, with a Content-Length header or chunked, and check which ones are processed and which
+// ones get a 413 error.
+
+#include "upnp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static const char *thisprog;
+static char usage [] =
+    "test_soaplimit [-i ifname]\n"
+    "  Check that the SOAP requests above the maximum content length are refused\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+static const char *UDN = "uuid:2f6d8e0a-5c3b-4e1f-8a7d-9b4c6e2d1f30";
+static const char *SERVICETYPE = "urn:schemas-upnp-org:service:RenderingControl:1";
+static const char *CTLURL = "/ctl-RenderingControl";
+static const string description =
+    string(R"(<?xml version="1.0" encoding="utf-8"?>
+<root xmlns="urn:schemas-upnp-org:device-1-0">
+  <specVersion><major>1</major><minor>1</minor></specVersion>
+  <device>
+    <deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType>
+    <friendlyName>test_soaplimit</friendlyName>
+    <manufacturer>npupnp</manufacturer>
+    <modelName>test_soaplimit</modelName>
+    <UDN>)") + UDN + R"(</UDN>
+    <serviceList>
+      <service>
+        <serviceType>)" + SERVICETYPE + R"(</serviceType>
+        <serviceId>urn:upnp-org:serviceId:RenderingControl</serviceId>
+        <SCPDURL>/RenderingControl.xml</SCPDURL>
+        <controlURL>)" + CTLURL + R"(</controlURL>
+        <eventSubURL>/evt-RenderingControl</eventSubURL>
+      </service>
+    </serviceList>
+  </device>
+</root>
+)";
+
+// Answer with the size of the Channel argument
+static int deviceCallback(Upnp_EventType et, const void *evp, void *)
+{
+    if (et != UPNP_CONTROL_ACTION_REQUEST)
+        return UPNP_E_SUCCESS;
+    auto req = static_cast<Upnp_Action_Request *>(const_cast<void *>(evp));
+    for (const auto& [name, value] : req->args) {
+        if (name == "Channel")
+            req->resdata.emplace_back("CurrentVolume", to_string(value.size()));
+    }
+    return UPNP_E_SUCCESS;
+}
+
+// Send a GetVolume action with a Channel argument of the specified size and return the HTTP
+// status, or -1 for a network error. The device answers a too large Content-Length before
+// reading the body and may close the connection, so write errors are ignored. A too large
+// chunked body is read to the end before the answer.
+// Returns the size echoed by the device in *echoed.
+static int sendAction(const string& host, int devport, size_t argsize, bool chunked,
+                      long *echoed)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(devport);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    string body = string(R"(<?xml version="1.0"?>)"
+                         R"(<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" )"
+                         R"(s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">)"
+                         R"(<s:Body><u:GetVolume xmlns:u=")") + SERVICETYPE + R"(">)" +
+        "<InstanceID>0</InstanceID><Channel>" + string(argsize, 'x') + "</Channel>"
+        "</u:GetVolume></s:Body></s:Envelope>";
+    string req = string("POST ") + CTLURL + " HTTP/1.1\r\n" +
+        "HOST: " + host + ":" + to_string(devport) + "\r\n" +
+        "CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n" +
+        "SOAPACTION: \"" + SERVICETYPE + "#GetVolume\"\r\n" +
+        "Connection: close\r\n";
+    if (chunked) {
+        char hex[20];
+        snprintf(hex, sizeof(hex), "%zx", body.size());
+        req += string("Transfer-Encoding: chunked\r\n\r\n") + hex + "\r\n" + body + "\r\n0\r\n\r\n";
+    } else {
+        req += "CONTENT-LENGTH: " + to_string(body.size()) + "\r\n\r\n" + body;
+    }
+    // Write errors are expected if the device refuses the request early
+    size_t written = 0;
+    while (written < req.size()) {
+        auto n = write(fd, req.c_str() + written, req.size() - written);
+        if (n <= 0)
+            break;
+        written += n;
+    }
+    string resp;
+    char tmp[4096];
+    ssize_t n;
+    while ((n = read(fd, tmp, sizeof(tmp))) > 0)
+        resp.append(tmp, n);
+    close(fd);
+    if (resp.compare(0, 9, "HTTP/1.1 ") != 0)
+        return -1;
+    auto pos = resp.find("<CurrentVolume>");
+    *echoed = pos == string::npos ? -1 : atol(resp.c_str() + pos + 15);
+    return atoi(resp.c_str() + 9);
+}
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    const char *ifname = nullptr;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "-i" && i + 1 < argc) {
+            ifname = argv[++i];
+        } else {
+            Usage();
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int ret = UpnpInitWithOptions(ifname, 0, UPNP_FLAG_NONE, UPNP_OPTION_END);
+    if (ret != UPNP_E_SUCCESS) {
+        cerr << "UpnpInitWithOptions failed: " << ret << "\n";
+        return 1;
+    }
+    UpnpDevice_Handle dvhandle;
+    ret = UpnpRegisterRootDevice2(UPNPREG_BUF_DESC, description.c_str(), description.size(), 0,
+                                  deviceCallback, nullptr, &dvhandle);
+    if (ret != UPNP_E_SUCCESS) {
+        cerr << "UpnpRegisterRootDevice2 failed: " << ret << "\n";
+        return 1;
+    }
+    string host = UpnpGetServerIpAddress();
+    int devport = UpnpGetServerPort();
+
+    struct {
+        size_t limit;
+        size_t argsize;
+        bool chunked;
+        int status;
+    } cases[] {
+        // The default limit leaves room for big metadata arguments
+        {0, 100000, false, 200},
+        {0, 100000, true, 200},
+        {4000, 2000, false, 200},
+        {4000, 2000, true, 200},
+        {4000, 8000, false, 413},
+        {4000, 8000, true, 413},
+        // No limit
+        {size_t(-1), 2000000, false, 200},
+    };
+    int errors = 0;
+    for (const auto& c : cases) {
+        if (c.limit == size_t(-1)) {
+            UpnpSetMaxContentLength(0);
+        } else if (c.limit) {
+            UpnpSetMaxContentLength(c.limit);
+        }
+        long echoed{-1};
+        int status = sendAction(host, devport, c.argsize, c.chunked, &echoed);
+        bool ok = status == c.status && (status != 200 || echoed == long(c.argsize));
+        cout << (ok ? "OK  " : "BAD ") << "argument size " << c.argsize <<
+            (c.chunked ? " chunked" : "") << ": status " << status << " (expected " <<
+            c.status << ")\n";
+        if (!ok)
+            errors++;
+    }
+
+    UpnpUnRegisterRootDevice(dvhandle);
+    UpnpFinish();
+    return errors ? 1 : 0;
+}
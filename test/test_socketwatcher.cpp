@@ -0,0 +1,263 @@
+/* Copyright (C) 2026 J.F.Dockes
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// SocketWatcher test, on local socket pairs: readiness, timeouts, shutdown. If coroutines are
+// available, also run a ping-pong between two PoolTask coroutines waiting with socketReady().
+
+#include "PoolTask.h"
+#include "SocketWatcher.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static const char *thisprog;
+static char usage [] =
+    "test_socketwatcher [-r rounds]\n"
+    "  Test the socket readiness notifications. With coroutines, also exchange (default 1000)\n"
+    "  messages between two tasks\n"
+    ;
+static void Usage(void)
+{
+    cerr << thisprog << ": usage:\n" << usage;
+    exit(1);
+}
+
+static int errors;
+
+static void check(bool ok, const string& what)
+{
+    cout << (ok ? "OK  " : "BAD ") << what << "\n";
+    if (!ok)
+        errors++;
+}
+
+// Result of one watch() call, set from the watcher thread.
+class Outcome {
+public:
+    void set(int v) {
+        std::scoped_lock lck(mutex);
+        value = v;
+        done = true;
+        cv.notify_all();
+    }
+    // Wait for the callback, return its value, or -2 if it was not called in time.
+    int wait(milliseconds limit = seconds(5)) {
+        std::unique_lock lck(mutex);
+        if (!cv.wait_for(lck, limit, [this] { return done; }))
+            return -2;
+        return value;
+    }
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done{false};
+    int value{0};
+};
+
+static void testWatcher(ThreadPool& pool)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    SocketWatcher watcher(&pool);
+
+    {
+        Outcome out;
+        watcher.watch(sv[0], SocketWatcher::READABLE, seconds(5),
+                      [&out](int events) { out.set(events); });
+        this_thread::sleep_for(milliseconds(50));
+        if (write(sv[1], "x", 1) != 1)
+            perror("write");
+        check(out.wait() == SocketWatcher::READABLE, "readable after write");
+        char c;
+        if (read(sv[0], &c, 1) != 1)
+            perror("read");
+    }
+    {
+        Outcome out;
+        watcher.watch(sv[0], SocketWatcher::WRITABLE, seconds(5),
+                      [&out](int events) { out.set(events); });
+        check(out.wait() == SocketWatcher::WRITABLE, "writable");
+    }
+    {
+        Outcome out;
+        auto start = steady_clock::now();
+        watcher.watch(sv[0], SocketWatcher::READABLE, milliseconds(100),
+                      [&out](int events) { out.set(events); });
+        int events = out.wait();
+        auto elapsed = steady_clock::now() - start;
+        check(events == 0 && elapsed >= milliseconds(100), "timeout");
+    }
+    {
+        // The shorter timeout must not wait for the longer one.
+        Outcome outlong, outshort;
+        auto start = steady_clock::now();
+        watcher.watch(sv[0], SocketWatcher::READABLE, seconds(5),
+                      [&outlong](int events) { outlong.set(events); });
+        watcher.watch(sv[1], SocketWatcher::READABLE, milliseconds(50),
+                      [&outshort](int events) { outshort.set(events); });
+        int events = outshort.wait();
+        auto elapsed = steady_clock::now() - start;
+        check(events == 0 && elapsed < seconds(2), "shorter timeout first");
+        watcher.shutdown();
+        check(outlong.wait() == -1, "pending watch cancelled by shutdown");
+    }
+    check(watcher.watch(sv[0], SocketWatcher::READABLE, seconds(1), [](int) {}) == -1,
+          "watch after shutdown fails");
+    close(sv[0]);
+    close(sv[1]);
+}
+
+#ifdef NPUPNP_HAVE_COROUTINES
+static std::mutex taskmutex;
+static std::condition_variable taskcv;
+static int tasksleft;
+static int taskerrors;
+
+static void taskDone(bool ok)
+{
+    std::scoped_lock lck(taskmutex);
+    if (!ok)
+        taskerrors++;
+    if (--tasksleft == 0)
+        taskcv.notify_all();
+}
+
+// Send a counter to the peer and wait for it to come back incremented, or increment what the
+// peer sent, for the specified number of rounds.
+static PoolTask pingPong(SocketWatcher& watcher, ThreadPool& pool, int fd, bool first,
+                         int rounds)
+{
+    bool ok = true;
+    int value = 0;
+    for (int i = 0; i < rounds && ok; i++) {
+        if (first || i > 0) {
+            if (write(fd, &value, sizeof(value)) != sizeof(value)) {
+                ok = false;
+                break;
+            }
+        }
+        if (first && i == rounds - 1)
+            break;
+        int events = co_await socketReady(watcher, pool, fd, SocketWatcher::READABLE,
+                                          seconds(5));
+        if (events != SocketWatcher::READABLE ||
+            read(fd, &value, sizeof(value)) != sizeof(value)) {
+            ok = false;
+            break;
+        }
+        value++;
+    }
+    taskDone(ok);
+}
+
+static PoolTask timeoutTask(SocketWatcher& watcher, ThreadPool& pool, int fd)
+{
+    auto start = steady_clock::now();
+    int events = co_await socketReady(watcher, pool, fd, SocketWatcher::READABLE,
+                                      milliseconds(100));
+    taskDone(events == 0 && steady_clock::now() - start >= milliseconds(100));
+}
+
+static PoolTask stoppedTask(SocketWatcher& watcher, ThreadPool& pool, int fd)
+{
+    int events = co_await socketReady(watcher, pool, fd, SocketWatcher::READABLE, seconds(1));
+    taskDone(events == -1);
+}
+
+static bool waitTasks(int count, const std::function<void()>& starter)
+{
+    {
+        std::scoped_lock lck(taskmutex);
+        tasksleft = count;
+        taskerrors = 0;
+    }
+    starter();
+    std::unique_lock lck(taskmutex);
+    if (!taskcv.wait_for(lck, seconds(30), [] { return tasksleft == 0; }))
+        return false;
+    return taskerrors == 0;
+}
+
+static void testCoroutines(ThreadPool& pool, int rounds)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    SocketWatcher watcher(&pool);
+    check(waitTasks(2, [&] {
+        pingPong(watcher, pool, sv[0], true, rounds).start(pool);
+        pingPong(watcher, pool, sv[1], false, rounds).start(pool);
+    }), "coroutine ping-pong, " + to_string(rounds) + " rounds");
+    check(waitTasks(1, [&] { timeoutTask(watcher, pool, sv[0]).start(pool); }),
+          "coroutine timeout");
+    watcher.shutdown();
+    check(waitTasks(1, [&] { stoppedTask(watcher, pool, sv[0]).start(pool); }),
+          "coroutine with stopped watcher");
+    close(sv[0]);
+    close(sv[1]);
+}
+#endif /* NPUPNP_HAVE_COROUTINES */
+
+int main(int argc, char **argv)
+{
+    thisprog = argv[0];
+    int rounds = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+        case 'r': rounds = atoi(optarg); break;
+        default: Usage();
+        }
+    }
+    if (optind != argc || rounds <= 0)
+        Usage();
+
+    ThreadPool pool;
+    ThreadPoolAttr attr;
+    attr.minThreads = 4;
+    attr.maxThreads = 4;
+    if (pool.start(&attr) != 0) {
+        cerr << "Could not start the thread pool\n";
+        return 1;
+    }
+    testWatcher(pool);
+#ifdef NPUPNP_HAVE_COROUTINES
+    testCoroutines(pool, rounds);
+#else
+    cout << "Coroutines not available (needs C++20)\n";
+#endif
+    pool.shutdown();
+    return errors ? 1 : 0;
+}